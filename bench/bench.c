@@ -0,0 +1,267 @@
+/*
+ * Benchmark harness, see bench.h
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <uthread.h>
+
+#include "bench.h"
+
+#ifndef BENCH_VERSION
+#define BENCH_VERSION "unknown"
+#endif
+
+#define MAX_FIELDS 16
+#define MAX_SELECTED 16
+#define FIELD_SIZE 64
+
+enum format { FORMAT_TEXT, FORMAT_JSON, FORMAT_CSV };
+
+struct field {
+  char key[FIELD_SIZE];
+  char value[FIELD_SIZE];
+};
+
+static const char *suite;
+static enum format format = FORMAT_TEXT;
+static FILE *out;
+static int quick;
+static const char *selected[MAX_SELECTED];
+static int nselected;
+static int nrecords;
+
+/* current record */
+static const char *name;
+static struct field tags[MAX_FIELDS], metrics[MAX_FIELDS];
+static int ntags, nmetrics;
+
+static void usage(const char *prog)
+{
+  fprintf(stderr, "Usage: %s [-f text|json|csv] [-o FILE] [-b NAME]... [-q]\n",
+          prog);
+  exit(1);
+}
+
+/* print a string as a JSON string (our strings need no escaping but quotes) */
+static void json_string(const char *s)
+{
+  fputc('"', out);
+  for (; *s; s++) {
+    if (*s == '"' || *s == '\\')
+      fputc('\\', out);
+    fputc(*s, out);
+  }
+  fputc('"', out);
+}
+
+void bench_init(int argc, char **argv, const char *suite_name)
+{
+  int opt;
+
+  suite = suite_name;
+  out = stdout;
+
+  while ((opt = getopt(argc, argv, "f:o:b:q")) != -1) {
+    switch (opt) {
+      case 'f':
+        if (!strcmp(optarg, "text"))
+          format = FORMAT_TEXT;
+        else if (!strcmp(optarg, "json"))
+          format = FORMAT_JSON;
+        else if (!strcmp(optarg, "csv"))
+          format = FORMAT_CSV;
+        else
+          usage(argv[0]);
+        break;
+      case 'o':
+        out = fopen(optarg, "w");
+        if (!out) {
+          perror("fopen");
+          exit(1);
+        }
+        break;
+      case 'b':
+        if (nselected == MAX_SELECTED)
+          usage(argv[0]);
+        selected[nselected++] = optarg;
+        break;
+      case 'q':
+        quick = 1;
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
+
+  switch (format) {
+    case FORMAT_TEXT:
+      fprintf(out, "# %s, libuthread %s, %ld CPUs\n", suite, BENCH_VERSION,
+              sysconf(_SC_NPROCESSORS_ONLN));
+      break;
+    case FORMAT_JSON:
+      fprintf(out, "{\n  \"suite\": ");
+      json_string(suite);
+      fprintf(out, ",\n  \"version\": ");
+      json_string(BENCH_VERSION);
+      fprintf(out, ",\n  \"date\": %ld,\n  \"cpus\": %ld,\n  \"quick\": %s,\n"
+              "  \"results\": [", (long)time(NULL),
+              sysconf(_SC_NPROCESSORS_ONLN), quick ? "true" : "false");
+      break;
+    case FORMAT_CSV:
+      fprintf(out, "suite,version,benchmark,config,metric,value\n");
+      break;
+  }
+}
+
+void bench_finish(void)
+{
+  if (format == FORMAT_JSON)
+    fprintf(out, "\n  ]\n}\n");
+  fflush(out);
+  if (out != stdout)
+    fclose(out);
+}
+
+int bench_quick(void)
+{
+  return quick;
+}
+
+int bench_selected(const char *name)
+{
+  int i;
+
+  if (nselected == 0)
+    return 1;
+  for (i = 0; i < nselected; i++)
+    if (!strcmp(selected[i], name))
+      return 1;
+  return 0;
+}
+
+void bench_begin(const char *benchmark)
+{
+  name = benchmark;
+  ntags = 0;
+  nmetrics = 0;
+}
+
+void bench_tag(const char *key, const char *fmt, ...)
+{
+  va_list ap;
+
+  if (ntags == MAX_FIELDS)
+    return;
+
+  snprintf(tags[ntags].key, FIELD_SIZE, "%s", key);
+  va_start(ap, fmt);
+  vsnprintf(tags[ntags].value, FIELD_SIZE, fmt, ap);
+  va_end(ap);
+  ntags++;
+}
+
+void bench_metric(const char *key, double value)
+{
+  if (nmetrics == MAX_FIELDS)
+    return;
+
+  snprintf(metrics[nmetrics].key, FIELD_SIZE, "%s", key);
+  snprintf(metrics[nmetrics].value, FIELD_SIZE, "%.6g", value);
+  nmetrics++;
+}
+
+void bench_end(void)
+{
+  int i;
+
+  switch (format) {
+    case FORMAT_TEXT:
+      fprintf(out, "%-12s", name);
+      for (i = 0; i < ntags; i++)
+        fprintf(out, " %s=%s", tags[i].key, tags[i].value);
+      fprintf(out, " |");
+      for (i = 0; i < nmetrics; i++)
+        fprintf(out, " %s=%s", metrics[i].key, metrics[i].value);
+      fprintf(out, "\n");
+      break;
+
+    case FORMAT_JSON:
+      fprintf(out, "%s\n    {\"benchmark\": ", nrecords ? "," : "");
+      json_string(name);
+      fprintf(out, ", \"config\": {");
+      for (i = 0; i < ntags; i++) {
+        fprintf(out, "%s", i ? ", " : "");
+        json_string(tags[i].key);
+        fprintf(out, ": ");
+        json_string(tags[i].value);
+      }
+      fprintf(out, "}, \"metrics\": {");
+      for (i = 0; i < nmetrics; i++) {
+        fprintf(out, "%s", i ? ", " : "");
+        json_string(metrics[i].key);
+        fprintf(out, ": %s", metrics[i].value);
+      }
+      fprintf(out, "}}");
+      break;
+
+    case FORMAT_CSV:
+      /* long format, so that every record has the same columns */
+      for (i = 0; i < nmetrics; i++) {
+        int j;
+        fprintf(out, "%s,%s,%s,", suite, BENCH_VERSION, name);
+        for (j = 0; j < ntags; j++)
+          fprintf(out, "%s%s=%s", j ? ";" : "", tags[j].key, tags[j].value);
+        fprintf(out, ",%s,%s\n", metrics[i].key, metrics[i].value);
+      }
+      break;
+  }
+
+  fflush(out);
+  nrecords++;
+}
+
+uint64_t bench_now_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int compare_double(const void *a, const void *b)
+{
+  double x = *(const double*)a, y = *(const double*)b;
+  return (x > y) - (x < y);
+}
+
+double bench_percentile(double *samples, size_t n, double p)
+{
+  size_t i;
+
+  if (n == 0)
+    return 0;
+
+  qsort(samples, n, sizeof(double), compare_double);
+  i = (size_t)(p / 100 * n);
+  return samples[i < n ? i : n - 1];
+}
+
+int bench_spawn(int user, pthread_t *tid, void *(*func)(void*), void *arg)
+{
+  if (user)
+    return uthread_create(tid, func, arg);
+  return pthread_create(tid, NULL, func, arg) ? -1 : 0;
+}
+
+int bench_join(int user, pthread_t tid)
+{
+  if (user)
+    return uthread_join(tid, NULL);
+  return pthread_join(tid, NULL) ? -1 : 0;
+}
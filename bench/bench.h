@@ -0,0 +1,115 @@
+#ifndef _BENCH_H
+#define _BENCH_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Benchmark harness
+ *
+ * Every benchmark program measures a set of configurations and reports one
+ * record per configuration: the name of the benchmark, the tags describing the
+ * configuration (thread backend, primitive, sizes...), and the measured
+ * metrics, whose names end with their unit. Records are printed as text, as a
+ * JSON document, or as CSV with one row per metric, so that results can be
+ * compared across versions of the library and across backends.
+ *
+ * Common options:
+ *   -f text|json|csv  output format (default: text)
+ *   -o FILE           write the results to FILE instead of stdout
+ *   -b NAME           only run the benchmark called NAME (can be repeated)
+ *   -q                quick run, with fewer iterations, as a smoke test
+ */
+
+/*
+ * bench_init - Parse the common options and start the output
+ * @argc, @argv: Arguments of the program
+ * @suite_name: Name of the benchmark suite, which every record belongs to
+ */
+void bench_init(int argc, char **argv, const char *suite_name);
+
+/*
+ * bench_finish - Terminate the output
+ */
+void bench_finish(void);
+
+/*
+ * bench_quick - Whether to run with fewer iterations
+ *
+ * Return: 1 if -q was given, 0 otherwise.
+ */
+int bench_quick(void);
+
+/*
+ * bench_selected - Whether to run a benchmark
+ * @name: Name of the benchmark
+ *
+ * Return: 1 if no -b option was given or if one of them is @name, 0 otherwise.
+ */
+int bench_selected(const char *name);
+
+/*
+ * bench_begin - Start a record
+ * @name: Name of the benchmark
+ */
+void bench_begin(const char *name);
+
+/*
+ * bench_tag - Add a configuration tag to the current record
+ * @key: Name of the tag
+ * @fmt: printf() format of the value of the tag
+ */
+void bench_tag(const char *key, const char *fmt, ...)
+  __attribute__((format(printf, 2, 3)));
+
+/*
+ * bench_metric - Add a metric to the current record
+ * @key: Name of the metric, ending with its unit (e.g. "latency_ns")
+ * @value: Measured value
+ */
+void bench_metric(const char *key, double value);
+
+/*
+ * bench_end - Print the current record
+ */
+void bench_end(void);
+
+/*
+ * bench_now_ns - Monotonic time
+ *
+ * Return: Current time of CLOCK_MONOTONIC, in nanoseconds.
+ */
+uint64_t bench_now_ns(void);
+
+/*
+ * bench_percentile - Percentile of a set of samples
+ * @samples: Samples, which get sorted in place
+ * @n: Number of samples
+ * @p: Percentile, between 0 and 100
+ *
+ * Return: The sample below which @p percent of the samples fall, 0 if @n is 0.
+ */
+double bench_percentile(double *samples, size_t n, double p);
+
+/*
+ * bench_spawn - Create a thread
+ * @user: 1 for a user thread, 0 for a pthread
+ * @tid: Address of thread ID where the new thread's ID is received
+ * @func: Function to run in the new thread
+ * @arg: Argument to pass to @func
+ *
+ * Return: -1 in case of failure. 0 if the thread was successfully created.
+ */
+int bench_spawn(int user, pthread_t *tid, void *(*func)(void*), void *arg);
+
+/*
+ * bench_join - Wait for a thread created by bench_spawn()
+ * @user: Same as given to bench_spawn()
+ * @tid: ID of thread to wait for
+ *
+ * Return: -1 in case of failure. 0 if the thread was successfully joined.
+ */
+int bench_join(int user, pthread_t tid);
+
+#endif /* _BENCH_H */
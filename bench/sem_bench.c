@@ -0,0 +1,438 @@
+/*
+ * Semaphore benchmarks
+ *
+ * uncontended: cost of sem_down and sem_up when no thread ever waits
+ * pingpong:    round trip latency between two threads (p50/p99/p999)
+ * prodcons:    throughput of a bounded buffer, across buffer sizes and numbers
+ *              of producers and consumers
+ * convoy:      many threads taking turns on one semaphore used as a lock: rate
+ *              of acquisitions, time spent waiting, and how often the thread
+ *              releasing the semaphore takes it right back
+ *
+ * Each benchmark runs on pthreads and on user threads, with the semaphores of
+ * sem.h in both wakeup modes, and with process-shared semaphores (pthreads
+ * only, since they block the whole worker of a user thread).
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <psem.h>
+#include <sem.h>
+
+#include "bench.h"
+
+struct primitive {
+  const char *name;
+  void *(*create)(size_t count);
+  void (*destroy)(void *sem);
+  void (*down)(void *sem);
+  void (*up)(void *sem);
+  int user; /* usable by user threads */
+};
+
+static void *barging_create(size_t count)
+{
+  return sem_create(count);
+}
+
+static void *handoff_create(size_t count)
+{
+  sem_t sem = sem_create(count);
+  sem_setmode(sem, SEM_MODE_HANDOFF);
+  return sem;
+}
+
+static void sem_destroy_(void *sem)
+{
+  sem_destroy(sem);
+}
+
+static void sem_down_(void *sem)
+{
+  sem_down(sem);
+}
+
+static void sem_up_(void *sem)
+{
+  sem_up(sem);
+}
+
+static void *psem_create(size_t count)
+{
+  psem_t sem = malloc(sizeof(struct psem));
+  psem_init(sem, count);
+  return sem;
+}
+
+static void psem_destroy(void *sem)
+{
+  psem_fini(sem);
+  free(sem);
+}
+
+static void psem_down_(void *sem)
+{
+  psem_down(sem);
+}
+
+static void psem_up_(void *sem)
+{
+  psem_up(sem);
+}
+
+static const struct primitive primitives[] = {
+  { "sem", barging_create, sem_destroy_, sem_down_, sem_up_, 1 },
+  { "sem-handoff", handoff_create, sem_destroy_, sem_down_, sem_up_, 1 },
+  { "psem", psem_create, psem_destroy, psem_down_, psem_up_, 0 },
+};
+
+#define NPRIMITIVES (sizeof(primitives) / sizeof(primitives[0]))
+
+static const char *threads[] = { "pthread", "uthread" };
+
+/* burn a little CPU, in or out of a critical section */
+static void work(int n)
+{
+  volatile int i;
+
+  for (i = 0; i < n; i++)
+    ;
+}
+
+static void tag_config(const struct primitive *prim, int user)
+{
+  bench_tag("threads", "%s", threads[user]);
+  bench_tag("primitive", "%s", prim->name);
+}
+
+/* UNCONTENDED ---------------------------------------------------------------*/
+
+struct uncontended {
+  const struct primitive *prim;
+  size_t n;
+  double down_ns;
+  double up_ns;
+};
+
+static void *uncontended_thread(void *arg)
+{
+  struct uncontended *u = arg;
+  void *sem = u->prim->create(u->n);
+  uint64_t start;
+  size_t i;
+
+  start = bench_now_ns();
+  for (i = 0; i < u->n; i++)
+    u->prim->down(sem);
+  u->down_ns = (double)(bench_now_ns() - start) / u->n;
+
+  start = bench_now_ns();
+  for (i = 0; i < u->n; i++)
+    u->prim->up(sem);
+  u->up_ns = (double)(bench_now_ns() - start) / u->n;
+
+  u->prim->destroy(sem);
+  return NULL;
+}
+
+static void bench_uncontended(const struct primitive *prim, int user)
+{
+  struct uncontended u = { prim, bench_quick() ? 10000 : 1000000, 0, 0 };
+  pthread_t tid;
+
+  bench_spawn(user, &tid, uncontended_thread, &u);
+  bench_join(user, tid);
+
+  bench_begin("uncontended");
+  tag_config(prim, user);
+  bench_metric("down_ns", u.down_ns);
+  bench_metric("up_ns", u.up_ns);
+  bench_end();
+}
+
+/* PING-PONG -----------------------------------------------------------------*/
+
+struct pingpong {
+  const struct primitive *prim;
+  void *ping;
+  void *pong;
+  size_t rounds;
+  double *samples;
+};
+
+static void *pinger(void *arg)
+{
+  struct pingpong *p = arg;
+  size_t i;
+
+  for (i = 0; i < p->rounds; i++) {
+    uint64_t start = bench_now_ns();
+    p->prim->up(p->ping);
+    p->prim->down(p->pong);
+    p->samples[i] = bench_now_ns() - start;
+  }
+  return NULL;
+}
+
+static void *ponger(void *arg)
+{
+  struct pingpong *p = arg;
+  size_t i;
+
+  for (i = 0; i < p->rounds; i++) {
+    p->prim->down(p->ping);
+    p->prim->up(p->pong);
+  }
+  return NULL;
+}
+
+static void bench_pingpong(const struct primitive *prim, int user)
+{
+  struct pingpong p;
+  pthread_t a, b;
+  double total = 0;
+  size_t i;
+
+  p.prim = prim;
+  p.ping = prim->create(0);
+  p.pong = prim->create(0);
+  p.rounds = bench_quick() ? 1000 : 50000;
+  p.samples = malloc(p.rounds * sizeof(double));
+
+  bench_spawn(user, &b, ponger, &p);
+  bench_spawn(user, &a, pinger, &p);
+  bench_join(user, a);
+  bench_join(user, b);
+
+  for (i = 0; i < p.rounds; i++)
+    total += p.samples[i];
+
+  bench_begin("pingpong");
+  tag_config(prim, user);
+  bench_metric("mean_ns", total / p.rounds);
+  bench_metric("p50_ns", bench_percentile(p.samples, p.rounds, 50));
+  bench_metric("p99_ns", bench_percentile(p.samples, p.rounds, 99));
+  bench_metric("p999_ns", bench_percentile(p.samples, p.rounds, 99.9));
+  bench_end();
+
+  prim->destroy(p.ping);
+  prim->destroy(p.pong);
+  free(p.samples);
+}
+
+/* PRODUCER/CONSUMER ---------------------------------------------------------*/
+
+struct prodcons {
+  const struct primitive *prim;
+  void *lock;
+  void *empty; /* free slots */
+  void *full;  /* items in the buffer */
+  size_t *buffer;
+  size_t size, head, tail;
+  size_t per_producer, per_consumer;
+  unsigned long long sum;
+};
+
+static void *producer(void *arg)
+{
+  struct prodcons *p = arg;
+  size_t i;
+
+  for (i = 1; i <= p->per_producer; i++) {
+    p->prim->down(p->empty);
+    p->prim->down(p->lock);
+    p->buffer[p->tail] = i;
+    p->tail = (p->tail + 1) % p->size;
+    p->prim->up(p->lock);
+    p->prim->up(p->full);
+  }
+  return NULL;
+}
+
+static void *consumer(void *arg)
+{
+  struct prodcons *p = arg;
+  unsigned long long sum = 0;
+  size_t i;
+
+  for (i = 0; i < p->per_consumer; i++) {
+    p->prim->down(p->full);
+    p->prim->down(p->lock);
+    sum += p->buffer[p->head];
+    p->head = (p->head + 1) % p->size;
+    p->prim->up(p->lock);
+    p->prim->up(p->empty);
+  }
+
+  __atomic_fetch_add(&p->sum, sum, __ATOMIC_RELAXED);
+  return NULL;
+}
+
+static void bench_prodcons(const struct primitive *prim, int user,
+                           size_t size, int nthreads)
+{
+  size_t items = bench_quick() ? 2000 : 200000;
+  pthread_t tids[2 * nthreads];
+  struct prodcons p;
+  uint64_t start, elapsed;
+  int i;
+
+  p.prim = prim;
+  p.lock = prim->create(1);
+  p.empty = prim->create(size);
+  p.full = prim->create(0);
+  p.buffer = malloc(size * sizeof(size_t));
+  p.size = size;
+  p.head = p.tail = 0;
+  p.per_producer = p.per_consumer = items / nthreads;
+  p.sum = 0;
+
+  start = bench_now_ns();
+  for (i = 0; i < nthreads; i++) {
+    bench_spawn(user, &tids[2 * i], consumer, &p);
+    bench_spawn(user, &tids[2 * i + 1], producer, &p);
+  }
+  for (i = 0; i < 2 * nthreads; i++)
+    bench_join(user, tids[i]);
+  elapsed = bench_now_ns() - start;
+
+  /* each producer produced 1..per_producer */
+  if (p.sum != (unsigned long long)nthreads * p.per_producer *
+               (p.per_producer + 1) / 2) {
+    fprintf(stderr, "prodcons: lost items\n");
+    exit(1);
+  }
+
+  items = p.per_producer * nthreads;
+  bench_begin("prodcons");
+  tag_config(prim, user);
+  bench_tag("buffer", "%zu", size);
+  bench_tag("producers", "%d", nthreads);
+  bench_tag("consumers", "%d", nthreads);
+  bench_metric("items_per_sec", items * 1e9 / elapsed);
+  bench_metric("item_ns", (double)elapsed / items);
+  bench_end();
+
+  prim->destroy(p.lock);
+  prim->destroy(p.empty);
+  prim->destroy(p.full);
+  free(p.buffer);
+}
+
+/* CONVOY --------------------------------------------------------------------*/
+
+struct convoy {
+  const struct primitive *prim;
+  void *lock;
+  size_t per_thread;
+  double *waits;
+  int owner;            /* last thread in the critical section */
+  size_t reacquired;    /* acquisitions by the previous owner */
+};
+
+struct convoy_thread {
+  struct convoy *c;
+  int id;
+};
+
+static void *convoy_thread(void *arg)
+{
+  struct convoy_thread *t = arg;
+  struct convoy *c = t->c;
+  double *waits = c->waits + t->id * c->per_thread;
+  size_t i;
+
+  for (i = 0; i < c->per_thread; i++) {
+    uint64_t start = bench_now_ns();
+    c->prim->down(c->lock);
+    waits[i] = bench_now_ns() - start;
+
+    if (c->owner == t->id)
+      c->reacquired++;
+    c->owner = t->id;
+    work(100);
+
+    c->prim->up(c->lock);
+    work(100);
+  }
+  return NULL;
+}
+
+static void bench_convoy(const struct primitive *prim, int user, int nthreads)
+{
+  size_t total = bench_quick() ? 1000 : 50000;
+  struct convoy_thread args[nthreads];
+  pthread_t tids[nthreads];
+  struct convoy c;
+  uint64_t start, elapsed;
+  size_t n;
+  int i;
+
+  c.prim = prim;
+  c.lock = prim->create(1);
+  c.per_thread = total / nthreads;
+  c.owner = -1;
+  c.reacquired = 0;
+  n = c.per_thread * nthreads;
+  c.waits = malloc(n * sizeof(double));
+
+  start = bench_now_ns();
+  for (i = 0; i < nthreads; i++) {
+    args[i].c = &c;
+    args[i].id = i;
+    bench_spawn(user, &tids[i], convoy_thread, &args[i]);
+  }
+  for (i = 0; i < nthreads; i++)
+    bench_join(user, tids[i]);
+  elapsed = bench_now_ns() - start;
+
+  bench_begin("convoy");
+  tag_config(prim, user);
+  bench_tag("waiters", "%d", nthreads);
+  bench_metric("acquires_per_sec", n * 1e9 / elapsed);
+  bench_metric("wait_p50_ns", bench_percentile(c.waits, n, 50));
+  bench_metric("wait_p99_ns", bench_percentile(c.waits, n, 99));
+  bench_metric("wait_max_ns", bench_percentile(c.waits, n, 100));
+  bench_metric("reacquired_ratio", (double)c.reacquired / n);
+  bench_end();
+
+  prim->destroy(c.lock);
+  free(c.waits);
+}
+
+int main(int argc, char **argv)
+{
+  static const size_t sizes[] = { 1, 16, 256 };
+  static const int counts[] = { 1, 2, 4 };
+  static const int waiters[] = { 4, 16, 64 };
+  size_t p, i, j;
+  int user;
+
+  bench_init(argc, argv, "sem");
+
+  for (p = 0; p < NPRIMITIVES; p++) {
+    const struct primitive *prim = &primitives[p];
+
+    for (user = 0; user <= 1; user++) {
+      if (user && !prim->user)
+        continue;
+
+      if (bench_selected("uncontended"))
+        bench_uncontended(prim, user);
+      if (bench_selected("pingpong"))
+        bench_pingpong(prim, user);
+      if (bench_selected("prodcons"))
+        for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+          for (j = 0; j < sizeof(counts) / sizeof(counts[0]); j++)
+            bench_prodcons(prim, user, sizes[i], counts[j]);
+      if (bench_selected("convoy"))
+        for (i = 0; i < sizeof(waiters) / sizeof(waiters[0]); i++)
+          bench_convoy(prim, user, waiters[i]);
+    }
+  }
+
+  bench_finish();
+  return 0;
+}
@@ -0,0 +1,376 @@
+/*
+ * TPS benchmarks
+ *
+ * churn:     tps_create followed by tps_destroy
+ * io:        tps_read and tps_write latency by transfer size
+ * clone:     tps_clone fan-out from one area, then the first write of each
+ *            clone (which copies the area) and the following ones
+ * registry:  tps_create and tps_read as the number of live areas grows up to
+ *            100k (10k with -q)
+ * broadcast: reading the broadcast region through its pointer, against
+ *            tps_read of a clone, and publishing new versions of it
+ * page:      the diff kernel of each instruction set, with a given number of
+ *            changed bytes, against memcmp
+ *
+ * Every record reports the mmap, munmap and mprotect calls per operation along
+ * with the time. They are counted by wrapping the functions at link time, as
+ * is thread_self(), so that one thread can own as many areas as needed by
+ * posing as as many different threads.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include <page.h>
+#include <thread.h>
+#include <tps.h>
+
+#include "bench.h"
+
+/* SYSCALL COUNTING ----------------------------------------------------------*/
+
+static unsigned long nmmap, nmunmap, nmprotect;
+
+void *__real_mmap(void *addr, size_t len, int prot, int flags, int fd,
+                  off_t off);
+int __real_munmap(void *addr, size_t len);
+int __real_mprotect(void *addr, size_t len, int prot);
+pthread_t __real_thread_self(void);
+
+void *__wrap_mmap(void *addr, size_t len, int prot, int flags, int fd,
+                  off_t off)
+{
+  nmmap++;
+  return __real_mmap(addr, len, prot, flags, fd, off);
+}
+
+int __wrap_munmap(void *addr, size_t len)
+{
+  nmunmap++;
+  return __real_munmap(addr, len);
+}
+
+int __wrap_mprotect(void *addr, size_t len, int prot)
+{
+  nmprotect++;
+  return __real_mprotect(addr, len, prot);
+}
+
+/* thread which the TPS functions think is calling them, if not 0 */
+static pthread_t posing;
+
+pthread_t __wrap_thread_self(void)
+{
+  return posing ? posing : __real_thread_self();
+}
+
+/* fake thread IDs, even so as to never look like user thread IDs */
+static pthread_t fake_tid(size_t i)
+{
+  return (pthread_t)(0x10000 + 2 * i);
+}
+
+/* MEASUREMENT ---------------------------------------------------------------*/
+
+struct measure {
+  uint64_t start;
+  unsigned long mmap, munmap, mprotect;
+};
+
+static void measure_start(struct measure *m)
+{
+  m->mmap = nmmap;
+  m->munmap = nmunmap;
+  m->mprotect = nmprotect;
+  m->start = bench_now_ns();
+}
+
+/* add the time and syscalls per operation since measure_start() */
+static void measure_report(struct measure *m, const char *prefix, size_t ops)
+{
+  uint64_t elapsed = bench_now_ns() - m->start;
+  char key[64];
+
+  snprintf(key, sizeof(key), "%s_ns", prefix);
+  bench_metric(key, (double)elapsed / ops);
+  snprintf(key, sizeof(key), "%s_mmap_per_op", prefix);
+  bench_metric(key, (double)(nmmap - m->mmap) / ops);
+  snprintf(key, sizeof(key), "%s_munmap_per_op", prefix);
+  bench_metric(key, (double)(nmunmap - m->munmap) / ops);
+  snprintf(key, sizeof(key), "%s_mprotect_per_op", prefix);
+  bench_metric(key, (double)(nmprotect - m->mprotect) / ops);
+}
+
+static void check(int ret, const char *what)
+{
+  if (ret == -1) {
+    fprintf(stderr, "%s failed\n", what);
+    exit(1);
+  }
+}
+
+/* BENCHMARKS ----------------------------------------------------------------*/
+
+static void bench_churn(void)
+{
+  size_t n = bench_quick() ? 1000 : 100000, i;
+  struct measure m;
+
+  bench_begin("churn");
+  measure_start(&m);
+  for (i = 0; i < n; i++) {
+    check(tps_create(), "tps_create");
+    check(tps_destroy(), "tps_destroy");
+  }
+  measure_report(&m, "create_destroy", n);
+  bench_end();
+}
+
+static void bench_io(size_t size)
+{
+  size_t n = bench_quick() ? 1000 : 100000, i;
+  char buffer[TPS_SIZE];
+  struct measure m;
+
+  memset(buffer, 'x', sizeof(buffer));
+  check(tps_create(), "tps_create");
+
+  bench_begin("io");
+  bench_tag("size", "%zu", size);
+
+  measure_start(&m);
+  for (i = 0; i < n; i++)
+    check(tps_write(0, size, buffer), "tps_write");
+  measure_report(&m, "write", n);
+
+  measure_start(&m);
+  for (i = 0; i < n; i++)
+    check(tps_read(0, size, buffer), "tps_read");
+  measure_report(&m, "read", n);
+
+  bench_end();
+  check(tps_destroy(), "tps_destroy");
+}
+
+static void bench_clone(size_t nclones)
+{
+  char buffer[64] = "clone";
+  struct measure m;
+  size_t i;
+
+  /* the area everybody clones, owned by a thread of its own */
+  posing = fake_tid(0);
+  check(tps_create(), "tps_create");
+  check(tps_write(0, sizeof(buffer), buffer), "tps_write");
+
+  bench_begin("clone");
+  bench_tag("clones", "%zu", nclones);
+
+  measure_start(&m);
+  for (i = 1; i <= nclones; i++) {
+    posing = fake_tid(i);
+    check(tps_clone(fake_tid(0)), "tps_clone");
+  }
+  measure_report(&m, "clone", nclones);
+
+  measure_start(&m);
+  for (i = 1; i <= nclones; i++) {
+    posing = fake_tid(i);
+    check(tps_write(0, sizeof(buffer), buffer), "tps_write");
+  }
+  measure_report(&m, "first_write", nclones);
+
+  measure_start(&m);
+  for (i = 1; i <= nclones; i++) {
+    posing = fake_tid(i);
+    check(tps_write(0, sizeof(buffer), buffer), "tps_write");
+  }
+  measure_report(&m, "next_write", nclones);
+
+  bench_end();
+
+  for (i = 0; i <= nclones; i++) {
+    posing = fake_tid(i);
+    check(tps_destroy(), "tps_destroy");
+  }
+  posing = 0;
+}
+
+/* time tps_read of area i, n times */
+static void registry_read(size_t i, size_t n, const char *prefix)
+{
+  struct measure m;
+  char buffer[8];
+  size_t j;
+
+  posing = fake_tid(i);
+  measure_start(&m);
+  for (j = 0; j < n; j++)
+    check(tps_read(0, sizeof(buffer), buffer), "tps_read");
+  measure_report(&m, prefix, n);
+}
+
+static void bench_registry(void)
+{
+  size_t max = bench_quick() ? 10000 : 100000;
+  size_t live = 0, target, i;
+  struct measure m;
+
+  for (target = 1; target <= max; target *= 10) {
+    size_t created = target - live;
+
+    bench_begin("registry");
+    bench_tag("areas", "%zu", target);
+
+    measure_start(&m);
+    for (; live < target; live++) {
+      posing = fake_tid(live);
+      check(tps_create(), "tps_create");
+    }
+    measure_report(&m, "create", created);
+
+    /* areas are looked up in creation order */
+    registry_read(0, 100, "read_oldest");
+    registry_read(live - 1, 100, "read_newest");
+
+    bench_end();
+  }
+
+  /* oldest first, which is the fastest to look up */
+  for (i = 0; i < live; i++) {
+    posing = fake_tid(i);
+    check(tps_destroy(), "tps_destroy");
+  }
+  posing = 0;
+}
+
+static void bench_broadcast(size_t size)
+{
+  size_t n = bench_quick() ? 1000 : 100000, i;
+  tps_reader_t reader = tps_reader_create();
+  char buffer[TPS_SIZE];
+  struct measure m;
+
+  memset(buffer, 'x', sizeof(buffer));
+  check(tps_broadcast_publish(size, buffer), "tps_broadcast_publish");
+
+  /* the same data, in a clone of another thread's area */
+  posing = fake_tid(0);
+  check(tps_create(), "tps_create");
+  check(tps_write(0, size, buffer), "tps_write");
+  posing = fake_tid(1);
+  check(tps_clone(fake_tid(0)), "tps_clone");
+
+  bench_begin("broadcast");
+  bench_tag("size", "%zu", size);
+
+  measure_start(&m);
+  for (i = 0; i < n; i++) {
+    const char *data = tps_broadcast_enter(reader, NULL);
+    memcpy(buffer, data, size);
+    tps_broadcast_exit(reader);
+  }
+  measure_report(&m, "read", n);
+
+  measure_start(&m);
+  for (i = 0; i < n; i++)
+    check(tps_read(0, size, buffer), "tps_read");
+  measure_report(&m, "clone_read", n);
+
+  measure_start(&m);
+  for (i = 0; i < n; i++)
+    check(tps_broadcast_publish(size, buffer), "tps_broadcast_publish");
+  measure_report(&m, "publish", n);
+
+  bench_end();
+
+  check(tps_destroy(), "tps_destroy");
+  posing = fake_tid(0);
+  check(tps_destroy(), "tps_destroy");
+  posing = 0;
+  tps_reader_destroy(reader);
+}
+
+/* nanoseconds per call of @call, a statement using pages a and b */
+#define TIME_PAGE(ns, n, call)                                          \
+  do {                                                                  \
+    uint64_t start_ = bench_now_ns();                                   \
+    size_t i_;                                                          \
+    for (i_ = 0; i_ < (n); i_++) {                                      \
+      call;                                                             \
+      __asm__ __volatile__("" : : "r"(a), "r"(b) : "memory");           \
+    }                                                                   \
+    ns = (double)(bench_now_ns() - start_) / (n);                       \
+  } while (0)
+
+static void bench_page(const char *isa, size_t nchanges)
+{
+  static char a[TPS_SIZE] __attribute__((aligned(TPS_SIZE)));
+  static char b[TPS_SIZE] __attribute__((aligned(TPS_SIZE)));
+  static struct tps_range ranges[TPS_SIZE];
+  size_t n = bench_quick() ? 1000 : 200000, i;
+  volatile size_t sink = 0;
+  double ns;
+
+  if (page_use(isa) == -1)
+    return;
+
+  /* changed bytes spread over the page */
+  memset(a, 'x', sizeof(a));
+  memcpy(b, a, sizeof(b));
+  for (i = 0; i < nchanges; i++)
+    b[i * (TPS_SIZE / nchanges)] ^= 1;
+
+  bench_begin("page");
+  bench_tag("isa", "%s", isa);
+  bench_tag("changes", "%zu", nchanges);
+
+  /* the least a diff can cost, equal pages being read whole */
+  if (nchanges == 0) {
+    TIME_PAGE(ns, n, sink += memcmp(a, b, TPS_SIZE));
+    bench_metric("memcmp_ns", ns);
+  }
+
+  /* both pages are read */
+  TIME_PAGE(ns, n, sink += page_diff(a, b, ranges, TPS_SIZE));
+  bench_metric("diff_ns", ns);
+  bench_metric("diff_gb_per_sec", 2 * TPS_SIZE / ns);
+
+  bench_end();
+}
+
+int main(int argc, char **argv)
+{
+  static const size_t sizes[] = { 8, 64, 512, TPS_SIZE - 1 };
+  static const size_t clones[] = { 1, 16, 256, 4096 };
+  static const char *isas[] = { "avx2", "sse2", "scalar" };
+  static const size_t changes[] = { 0, 1, 64, 4096 };
+  size_t i, j;
+
+  bench_init(argc, argv, "tps");
+  tps_init(0);
+
+  if (bench_selected("churn"))
+    bench_churn();
+  if (bench_selected("io"))
+    for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+      bench_io(sizes[i]);
+  if (bench_selected("clone"))
+    for (i = 0; i < sizeof(clones) / sizeof(clones[0]); i++)
+      bench_clone(clones[i]);
+  if (bench_selected("registry"))
+    bench_registry();
+  if (bench_selected("broadcast"))
+    for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+      bench_broadcast(sizes[i]);
+  if (bench_selected("page"))
+    for (i = 0; i < sizeof(isas) / sizeof(isas[0]); i++)
+      for (j = 0; j < sizeof(changes) / sizeof(changes[0]); j++)
+        bench_page(isas[i], changes[j]);
+
+  bench_finish();
+  return 0;
+}
@@ -0,0 +1,97 @@
+#include <stdlib.h>
+
+#include "barrier.h"
+#include "thread.h"
+#include "waitq.h"
+
+int barrier_init(barrier_t barrier, unsigned int count)
+{
+  if (!barrier || count == 0) {
+    return -1;
+  }
+
+  barrier->count = count;
+  barrier->arrived = 0;
+  waitq_init(&barrier->waiting);
+  return 0;
+}
+
+int barrier_fini(barrier_t barrier)
+{
+  if (!barrier) {
+    return -1;
+  }
+
+  if (barrier->waiting.length > 0) {
+    return -1;
+  }
+
+  return 0;
+}
+
+barrier_t barrier_create(unsigned int count)
+{
+  if (count == 0) {
+    return NULL;
+  }
+
+  struct barrier *barrier = malloc(sizeof(struct barrier));
+  if (!barrier) {
+    return NULL;
+  }
+
+  barrier_init(barrier, count);
+  return barrier;
+}
+
+int barrier_destroy(barrier_t barrier)
+{
+  if (barrier_fini(barrier) == -1) {
+    return -1;
+  }
+
+  free(barrier);
+  return 0;
+}
+
+int barrier_wait(barrier_t barrier)
+{
+  if (!barrier) {
+    return -1;
+  }
+
+  enter_critical_section();
+
+  // last one in releases everybody, and resets the barrier for the next round
+  if (++barrier->arrived == barrier->count) {
+    struct waiter *waiter;
+
+    barrier->arrived = 0;
+    while ((waiter = waitq_pop(&barrier->waiting))) {
+      waiter->granted = 1;
+      thread_unblock(waiter->tid);
+    }
+
+    exit_critical_section();
+    return BARRIER_SERIAL_THREAD;
+  }
+
+  struct waiter waiter;
+  waiter.tid = thread_self();
+  waiter.granted = 0;
+  waiter.set = NULL;
+  waitq_push(&barrier->waiting, &waiter);
+
+  int ret = 0;
+  while (!waiter.granted) {
+    if (thread_block() == -1) {
+      waitq_remove(&barrier->waiting, &waiter);
+      barrier->arrived--;
+      ret = -1;
+      break;
+    }
+  }
+
+  exit_critical_section();
+  return ret;
+}
@@ -0,0 +1,82 @@
+#ifndef _BARRIER_H
+#define _BARRIER_H
+
+#include "waitq.h"
+
+/*
+ * barrier_t - Barrier type
+ *
+ * A barrier blocks the threads reaching it until a given number of threads
+ * have reached it, at which point they are all released at once and the
+ * barrier can be used again.
+ */
+typedef struct barrier *barrier_t;
+
+/*
+ * struct barrier - Barrier object
+ *
+ * The definition is only exposed so that barriers can be embedded in other
+ * structures and initialized with barrier_init(). Its fields must only be
+ * accessed through the functions below.
+ */
+struct barrier {
+  unsigned int count;
+  unsigned int arrived;
+  struct waitq waiting;
+};
+
+/*
+ * Value returned by barrier_wait() to exactly one of the released threads
+ */
+#define BARRIER_SERIAL_THREAD 1
+
+/*
+ * barrier_init - Initialize a barrier in place
+ * @barrier: Address of the barrier object to initialize
+ * @count: Number of threads to wait for
+ *
+ * Return: -1 if @barrier is NULL or if @count is 0. 0 if @barrier was
+ * successfully initialized.
+ */
+int barrier_init(barrier_t barrier, unsigned int count);
+
+/*
+ * barrier_fini - Finalize a barrier initialized in place
+ * @barrier: Barrier to finalize
+ *
+ * Return: -1 if @barrier is NULL, or if threads are still blocked on
+ * @barrier. 0 if @barrier was successfully finalized.
+ */
+int barrier_fini(barrier_t barrier);
+
+/*
+ * barrier_create - Create a barrier
+ * @count: Number of threads to wait for
+ *
+ * Return: Pointer to new barrier. NULL if @count is 0 or in case of failure
+ * when allocating the new barrier.
+ */
+barrier_t barrier_create(unsigned int count);
+
+/*
+ * barrier_destroy - Deallocate a barrier
+ * @barrier: Barrier to deallocate
+ *
+ * Return: -1 if @barrier is NULL, or if threads are still blocked on
+ * @barrier. 0 if @barrier was successfully destroyed.
+ */
+int barrier_destroy(barrier_t barrier);
+
+/*
+ * barrier_wait - Wait on a barrier
+ * @barrier: Barrier to wait on
+ *
+ * Block the caller thread until the number of threads given when initializing
+ * @barrier have called this function.
+ *
+ * Return: -1 if @barrier is NULL. BARRIER_SERIAL_THREAD for the last thread to
+ * reach the barrier, 0 for the other ones.
+ */
+int barrier_wait(barrier_t barrier);
+
+#endif /* _BARRIER_H */
@@ -0,0 +1,241 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "chan.h"
+#include "lfqueue.h"
+#include "sem.h"
+#include "thread.h"
+
+#define CHAN_CACHE_LINE 64
+
+// number of times a thread yields the cpu before blocking on a full or empty
+// channel
+#define CHAN_SPINS 2
+
+// threads blocked on one side of the channel. Blocking goes through the
+// semaphore, and the counter lets the other side skip it entirely as long as
+// nobody is waiting
+struct chan_park {
+  int waiters;
+  struct semaphore sem;
+};
+
+struct chan {
+  struct mpmc_queue ring;
+
+  struct chan_park not_full __attribute__((aligned(CHAN_CACHE_LINE)));
+  struct chan_park not_empty;
+};
+
+// RING BUFFER -----------------------------------------------------------------
+
+static int ring_push(chan_t chan, void *data)
+{
+  return mpmc_queue_enqueue(&chan->ring, data);
+}
+
+static int ring_pop(chan_t chan, void **data)
+{
+  return mpmc_queue_dequeue(&chan->ring, data);
+}
+
+// PARKING ---------------------------------------------------------------------
+
+// wake up to n threads blocked on park
+static void park_wake(struct chan_park *park, size_t n)
+{
+  // pairs with the registration in park_wait(): either the waiter sees the
+  // item we just made available, or we see the waiter
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+  int waiters = __atomic_load_n(&park->waiters, __ATOMIC_RELAXED);
+  while (waiters > 0 && n > 0) {
+    if (__atomic_compare_exchange_n(&park->waiters, &waiters, waiters - 1, 1,
+                                    __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+      sem_up(&park->sem);
+      waiters--;
+      n--;
+    }
+  }
+}
+
+// retry op until it succeeds, blocking on park in between. op is retried once
+// after registering as a waiter so that a wakeup cannot be missed
+static void park_wait(struct chan_park *park, chan_t chan, void **data,
+                      int (*op)(chan_t, void**))
+{
+  int spins = 0;
+
+  while (op(chan, data) == -1) {
+    // the other side is usually about to make progress, give it a chance
+    // before paying for a block and a wakeup
+    if (spins++ < CHAN_SPINS) {
+      thread_yield();
+      continue;
+    }
+
+    __atomic_fetch_add(&park->waiters, 1, __ATOMIC_SEQ_CST);
+
+    if (op(chan, data) == 0) {
+      // we no longer need to be woken up. If somebody already took our
+      // registration, the wakeup it sent has to be consumed
+      int waiters = __atomic_load_n(&park->waiters, __ATOMIC_RELAXED);
+      while (1) {
+        if (waiters == 0) {
+          sem_down(&park->sem);
+          break;
+        }
+        if (__atomic_compare_exchange_n(&park->waiters, &waiters, waiters - 1,
+                                        1, __ATOMIC_SEQ_CST,
+                                        __ATOMIC_RELAXED)) {
+          break;
+        }
+      }
+      return;
+    }
+
+    sem_down(&park->sem);
+  }
+}
+
+static int chan_push_op(chan_t chan, void **data)
+{
+  return ring_push(chan, *data);
+}
+
+// CHANNEL FUNCTIONS -----------------------------------------------------------
+
+chan_t chan_create(size_t capacity)
+{
+  if (capacity == 0) {
+    return NULL;
+  }
+
+  struct chan *chan;
+  if (posix_memalign((void**)&chan, CHAN_CACHE_LINE, sizeof(struct chan))) {
+    return NULL;
+  }
+  memset(chan, 0, sizeof(struct chan));
+
+  if (mpmc_queue_init(&chan->ring, capacity) == -1) {
+    free(chan);
+    return NULL;
+  }
+
+  sem_init(&chan->not_full.sem, 0);
+  sem_init(&chan->not_empty.sem, 0);
+
+  return chan;
+}
+
+int chan_destroy(chan_t chan)
+{
+  if (!chan) {
+    return -1;
+  }
+
+  // both semaphores are checked at once, so that a failed destroy leaves the
+  // channel untouched
+  enter_critical_section();
+  if (chan->not_full.sem.waiting.length > 0 ||
+      chan->not_empty.sem.waiting.length > 0) {
+    exit_critical_section();
+    return -1;
+  }
+  sem_fini(&chan->not_full.sem);
+  sem_fini(&chan->not_empty.sem);
+  exit_critical_section();
+
+  mpmc_queue_fini(&chan->ring);
+  free(chan);
+  return 0;
+}
+
+int chan_trysend(chan_t chan, void *data)
+{
+  if (!chan) {
+    return -1;
+  }
+
+  if (ring_push(chan, data) == -1) {
+    return -1;
+  }
+
+  park_wake(&chan->not_empty, 1);
+  return 0;
+}
+
+int chan_tryrecv(chan_t chan, void **data)
+{
+  if (!chan || !data) {
+    return -1;
+  }
+
+  if (ring_pop(chan, data) == -1) {
+    return -1;
+  }
+
+  park_wake(&chan->not_full, 1);
+  return 0;
+}
+
+int chan_send(chan_t chan, void *data)
+{
+  if (!chan) {
+    return -1;
+  }
+
+  park_wait(&chan->not_full, chan, &data, chan_push_op);
+  park_wake(&chan->not_empty, 1);
+  return 0;
+}
+
+int chan_recv(chan_t chan, void **data)
+{
+  if (!chan || !data) {
+    return -1;
+  }
+
+  park_wait(&chan->not_empty, chan, data, ring_pop);
+  park_wake(&chan->not_full, 1);
+  return 0;
+}
+
+int chan_send_batch(chan_t chan, void **data, size_t count)
+{
+  if (!chan || !data) {
+    return -1;
+  }
+
+  size_t i, sent = 0;
+  for (i = 0; i < count; i++) {
+    if (ring_push(chan, data[i]) == -1) {
+      // full: let the receivers drain what we sent so far before blocking
+      park_wake(&chan->not_empty, sent);
+      sent = 0;
+      park_wait(&chan->not_full, chan, &data[i], chan_push_op);
+    }
+    sent++;
+  }
+
+  park_wake(&chan->not_empty, sent);
+  return 0;
+}
+
+ssize_t chan_recv_batch(chan_t chan, void **data, size_t count)
+{
+  if (!chan || !data || count == 0) {
+    return -1;
+  }
+
+  // block for the first item only, then take whatever else is there
+  park_wait(&chan->not_empty, chan, &data[0], ring_pop);
+
+  size_t received = 1;
+  while (received < count && ring_pop(chan, &data[received]) == 0) {
+    received++;
+  }
+
+  park_wake(&chan->not_full, received);
+  return received;
+}
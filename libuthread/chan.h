@@ -0,0 +1,113 @@
+#ifndef _CHAN_H
+#define _CHAN_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+ * chan_t - Channel type
+ *
+ * A channel is a bounded FIFO of data items (pointers) shared by any number of
+ * sending and receiving threads. It is backed by a lock-free ring buffer in
+ * which every slot carries a sequence number telling whether it is ready to be
+ * written or read, so sending and receiving only take a couple of atomic
+ * operations and never enter the critical section. Threads only block, on
+ * semaphores, when the channel is full (senders) or empty (receivers).
+ */
+typedef struct chan *chan_t;
+
+/*
+ * chan_create - Create a channel
+ * @capacity: Maximum number of items in the channel, rounded up to the next
+ * power of 2, and to at least 2
+ *
+ * Return: Pointer to new empty channel. NULL if @capacity is 0 or in case of
+ * failure when allocating the new channel.
+ */
+chan_t chan_create(size_t capacity);
+
+/*
+ * chan_destroy - Deallocate a channel
+ * @chan: Channel to deallocate
+ *
+ * Items still in the channel are dropped.
+ *
+ * Return: -1 if @chan is NULL or if threads are still being blocked on @chan. 0
+ * if @chan was successfully destroyed.
+ */
+int chan_destroy(chan_t chan);
+
+/*
+ * chan_send - Send an item
+ * @chan: Channel to send to
+ * @data: Data item to send
+ *
+ * Add @data to channel @chan, blocking the caller thread as long as @chan is
+ * full.
+ *
+ * Return: -1 if @chan is NULL. 0 if @data was successfully sent.
+ */
+int chan_send(chan_t chan, void *data);
+
+/*
+ * chan_recv - Receive an item
+ * @chan: Channel to receive from
+ * @data: Address of data pointer where item is received
+ *
+ * Remove the oldest item of channel @chan and assign it to @data, blocking the
+ * caller thread as long as @chan is empty.
+ *
+ * Return: -1 if @chan or @data are NULL. 0 if an item was successfully
+ * received.
+ */
+int chan_recv(chan_t chan, void **data);
+
+/*
+ * chan_trysend - Send an item without blocking
+ * @chan: Channel to send to
+ * @data: Data item to send
+ *
+ * Return: -1 if @chan is NULL or if @chan is full. 0 if @data was successfully
+ * sent.
+ */
+int chan_trysend(chan_t chan, void *data);
+
+/*
+ * chan_tryrecv - Receive an item without blocking
+ * @chan: Channel to receive from
+ * @data: Address of data pointer where item is received
+ *
+ * Return: -1 if @chan or @data are NULL or if @chan is empty. 0 if an item was
+ * successfully received.
+ */
+int chan_tryrecv(chan_t chan, void **data);
+
+/*
+ * chan_send_batch - Send several items
+ * @chan: Channel to send to
+ * @data: Array of data items to send
+ * @count: Number of items in @data
+ *
+ * Send all the items of @data, in order, blocking whenever @chan is full.
+ * Blocked receivers are woken up once per batch rather than once per item.
+ *
+ * Return: -1 if @chan or @data are NULL. 0 if all the items were successfully
+ * sent.
+ */
+int chan_send_batch(chan_t chan, void **data, size_t count);
+
+/*
+ * chan_recv_batch - Receive several items
+ * @chan: Channel to receive from
+ * @data: Array receiving the data items
+ * @count: Maximum number of items to receive
+ *
+ * Receive as many items as are available in @chan, up to @count, blocking only
+ * if @chan is empty.
+ *
+ * Return: -1 if @chan or @data are NULL or if @count is 0. Number of items
+ * received otherwise, which is at least 1.
+ */
+ssize_t chan_recv_batch(chan_t chan, void **data, size_t count);
+
+#endif /* _CHAN_H */
@@ -0,0 +1,124 @@
+#include <limits.h>
+#include <stdlib.h>
+
+#include "cond.h"
+#include "mutex.h"
+#include "thread.h"
+#include "waitq.h"
+
+int cond_init(cond_t cond)
+{
+  if (!cond) {
+    return -1;
+  }
+
+  waitq_init(&cond->waiting);
+  return 0;
+}
+
+int cond_fini(cond_t cond)
+{
+  if (!cond) {
+    return -1;
+  }
+
+  if (cond->waiting.length > 0) {
+    return -1;
+  }
+
+  return 0;
+}
+
+cond_t cond_create(void)
+{
+  struct cond *cond = malloc(sizeof(struct cond));
+  if (!cond) {
+    return NULL;
+  }
+
+  cond_init(cond);
+  return cond;
+}
+
+int cond_destroy(cond_t cond)
+{
+  if (cond_fini(cond) == -1) {
+    return -1;
+  }
+
+  free(cond);
+  return 0;
+}
+
+int cond_wait(cond_t cond, mutex_t mutex)
+{
+  if (!cond || !mutex) {
+    return -1;
+  }
+
+  struct waiter waiter;
+  waiter.tid = thread_self();
+  waiter.granted = 0;
+  waiter.set = NULL;
+
+  // we are in the waiting list before the mutex is released, so a signal sent
+  // by the next holder of the mutex cannot be missed
+  enter_critical_section();
+  waitq_push(&cond->waiting, &waiter);
+  mutex_unlock(mutex);
+
+  while (!waiter.granted) {
+    if (thread_block() == -1) {
+      if (waitq_contains(&cond->waiting, &waiter)) {
+        waitq_remove(&cond->waiting, &waiter);
+      }
+      break;
+    }
+  }
+  exit_critical_section();
+
+  mutex_lock(mutex);
+  return 0;
+}
+
+// wake up at most n waiters
+static void cond_wake(cond_t cond, int n)
+{
+  // nobody to wake up. Waiters register before releasing the mutex, so this
+  // can't miss a waiter if the caller holds the mutex
+  if (__atomic_load_n(&cond->waiting.length, __ATOMIC_ACQUIRE) == 0) {
+    return;
+  }
+
+  enter_critical_section();
+  while (n-- > 0) {
+    struct waiter *waiter = waitq_pop(&cond->waiting);
+    if (!waiter) {
+      break;
+    }
+
+    waiter->granted = 1;
+    thread_unblock(waiter->tid);
+  }
+  exit_critical_section();
+}
+
+int cond_signal(cond_t cond)
+{
+  if (!cond) {
+    return -1;
+  }
+
+  cond_wake(cond, 1);
+  return 0;
+}
+
+int cond_broadcast(cond_t cond)
+{
+  if (!cond) {
+    return -1;
+  }
+
+  cond_wake(cond, INT_MAX);
+  return 0;
+}
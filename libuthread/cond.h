@@ -0,0 +1,93 @@
+#ifndef _COND_H
+#define _COND_H
+
+#include "mutex.h"
+#include "waitq.h"
+
+/*
+ * cond_t - Condition variable type
+ *
+ * A condition variable lets threads wait, while holding a mutex, for a
+ * condition on the data protected by that mutex to become true.
+ */
+typedef struct cond *cond_t;
+
+/*
+ * struct cond - Condition variable object
+ *
+ * The definition is only exposed so that condition variables can be embedded
+ * in other structures and initialized with cond_init(). Its fields must only
+ * be accessed through the functions below.
+ */
+struct cond {
+  struct waitq waiting;
+};
+
+/*
+ * cond_init - Initialize a condition variable in place
+ * @cond: Address of the condition variable object to initialize
+ *
+ * Return: -1 if @cond is NULL. 0 if @cond was successfully initialized.
+ */
+int cond_init(cond_t cond);
+
+/*
+ * cond_fini - Finalize a condition variable initialized in place
+ * @cond: Condition variable to finalize
+ *
+ * Return: -1 if @cond is NULL, or if threads are still waiting on @cond. 0 if
+ * @cond was successfully finalized.
+ */
+int cond_fini(cond_t cond);
+
+/*
+ * cond_create - Create a condition variable
+ *
+ * Return: Pointer to new condition variable. NULL in case of failure when
+ * allocating the new condition variable.
+ */
+cond_t cond_create(void);
+
+/*
+ * cond_destroy - Deallocate a condition variable
+ * @cond: Condition variable to deallocate
+ *
+ * Return: -1 if @cond is NULL, or if threads are still waiting on @cond. 0 if
+ * @cond was successfully destroyed.
+ */
+int cond_destroy(cond_t cond);
+
+/*
+ * cond_wait - Wait on a condition variable
+ * @cond: Condition variable to wait on
+ * @mutex: Mutex held by the caller
+ *
+ * Atomically unlock @mutex and block the caller thread until @cond is
+ * signaled, then lock @mutex again before returning. As with any condition
+ * variable, the caller should check its condition again when this returns.
+ *
+ * Return: -1 if @cond or @mutex are NULL. 0 otherwise.
+ */
+int cond_wait(cond_t cond, mutex_t mutex);
+
+/*
+ * cond_signal - Signal a condition variable
+ * @cond: Condition variable to signal
+ *
+ * Wake up the oldest thread waiting on @cond, if any.
+ *
+ * Return: -1 if @cond is NULL. 0 otherwise.
+ */
+int cond_signal(cond_t cond);
+
+/*
+ * cond_broadcast - Broadcast a condition variable
+ * @cond: Condition variable to broadcast
+ *
+ * Wake up all the threads waiting on @cond.
+ *
+ * Return: -1 if @cond is NULL. 0 otherwise.
+ */
+int cond_broadcast(cond_t cond);
+
+#endif /* _COND_H */
@@ -0,0 +1,275 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "dsem.h"
+#include "thread.h"
+#include "waitq.h"
+
+#define DSEM_CACHE_LINE 64
+#define DSEM_MAX_SHARDS 256
+
+// number of resources a shard grabs from the global count when it runs dry,
+// and number of resources a shard can hold before giving some back
+#define DSEM_BATCH      8
+#define DSEM_SHARD_MAX  (4 * DSEM_BATCH)
+
+struct dsem_shard {
+  long count;
+} __attribute__((aligned(DSEM_CACHE_LINE)));
+
+struct dsem {
+  struct dsem_shard *shards;
+  int nshards;
+
+  // global count and waiting list, protected by the critical section
+  long global;
+  struct waitq waiting;
+
+  // number of blocked threads, read without the critical section by
+  // dsem_up() to decide whether it can stay on the fast path
+  int nwaiters;
+};
+
+// HELPER FUNCTIONS ------------------------------------------------------------
+
+static struct dsem_shard *dsem_shard(dsem_t sem)
+{
+  static __thread unsigned int hint;
+
+  int cpu = sched_getcpu();
+  if (cpu < 0) {
+    // no cpu number available, spread threads according to their own address
+    if (hint == 0) {
+      hint = (unsigned int)((uintptr_t)&hint >> 12) | 1;
+    }
+    cpu = hint;
+  }
+
+  return &sem->shards[cpu % sem->nshards];
+}
+
+// move all the resources cached in the shards back into the global count.
+// Must be called inside the critical section
+static void dsem_drain(dsem_t sem)
+{
+  int i;
+
+  for (i = 0; i < sem->nshards; i++) {
+    if (__atomic_load_n(&sem->shards[i].count, __ATOMIC_RELAXED) > 0) {
+      sem->global += __atomic_exchange_n(&sem->shards[i].count, 0,
+                                         __ATOMIC_SEQ_CST);
+    }
+  }
+}
+
+// hand off available resources to blocked threads. Must be called inside the
+// critical section
+static void dsem_wake(dsem_t sem)
+{
+  dsem_drain(sem);
+
+  while (sem->global > 0 && sem->waiting.length > 0) {
+    struct waiter *waiter = waitq_pop(&sem->waiting);
+
+    sem->global--;
+    __atomic_fetch_sub(&sem->nwaiters, 1, __ATOMIC_SEQ_CST);
+    waiter->granted = 1;
+    thread_unblock(waiter->tid);
+  }
+}
+
+// DISTRIBUTED SEMAPHORE FUNCTIONS ---------------------------------------------
+
+dsem_t dsem_create(size_t count, int nshards)
+{
+  if (nshards <= 0) {
+    nshards = sysconf(_SC_NPROCESSORS_ONLN);
+  }
+  if (nshards <= 0) {
+    nshards = 1;
+  }
+  if (nshards > DSEM_MAX_SHARDS) {
+    nshards = DSEM_MAX_SHARDS;
+  }
+
+  struct dsem *sem = malloc(sizeof(struct dsem));
+  if (!sem) {
+    return NULL;
+  }
+
+  // each shard gets its own cache line so that cpus don't fight over them
+  void *shards;
+  if (posix_memalign(&shards, DSEM_CACHE_LINE,
+                     nshards * sizeof(struct dsem_shard)) != 0) {
+    free(sem);
+    return NULL;
+  }
+  memset(shards, 0, nshards * sizeof(struct dsem_shard));
+
+  sem->shards = shards;
+  sem->nshards = nshards;
+  sem->global = count;
+  waitq_init(&sem->waiting);
+  sem->nwaiters = 0;
+
+  return sem;
+}
+
+int dsem_destroy(dsem_t sem)
+{
+  if (!sem) {
+    return -1;
+  }
+
+  // cannot delete a semaphore while other threads are waiting on it
+  if (__atomic_load_n(&sem->nwaiters, __ATOMIC_SEQ_CST) > 0) {
+    return -1;
+  }
+
+  free(sem->shards);
+  free(sem);
+  return 0;
+}
+
+int dsem_down(dsem_t sem)
+{
+  if (!sem) {
+    return -1;
+  }
+
+  // fast path: take a resource cached in our shard
+  struct dsem_shard *shard = dsem_shard(sem);
+  long count = __atomic_load_n(&shard->count, __ATOMIC_RELAXED);
+  while (count > 0) {
+    if (__atomic_compare_exchange_n(&shard->count, &count, count - 1, 1,
+                                    __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+      return 0;
+    }
+  }
+
+  struct waiter waiter;
+  waiter.tid = thread_self();
+  waiter.granted = 0;
+
+  enter_critical_section();
+  while (1) {
+    // refill our shard from the global count, keeping one resource for us
+    if (sem->global > 0) {
+      long take = sem->global < DSEM_BATCH ? sem->global : DSEM_BATCH;
+      sem->global -= take;
+      if (take > 1) {
+        __atomic_fetch_add(&shard->count, take - 1, __ATOMIC_RELEASE);
+      }
+      exit_critical_section();
+      return 0;
+    }
+
+    // announce ourselves before looking at the other shards: a concurrent
+    // dsem_up() either adds to a shard we are about to drain, or sees us and
+    // takes the slow path to wake us up
+    __atomic_fetch_add(&sem->nwaiters, 1, __ATOMIC_SEQ_CST);
+    dsem_drain(sem);
+    if (sem->global > 0) {
+      __atomic_fetch_sub(&sem->nwaiters, 1, __ATOMIC_SEQ_CST);
+      continue;
+    }
+
+    // nothing left anywhere, wait for a resource to be handed off to us
+    waitq_push(&sem->waiting, &waiter);
+    while (!waiter.granted) {
+      if (thread_block() == -1) {
+        waitq_remove(&sem->waiting, &waiter);
+        __atomic_fetch_sub(&sem->nwaiters, 1, __ATOMIC_SEQ_CST);
+        exit_critical_section();
+        return -1;
+      }
+    }
+
+    exit_critical_section();
+    return 0;
+  }
+}
+
+int dsem_up(dsem_t sem)
+{
+  if (!sem) {
+    return -1;
+  }
+
+  // slow path right away if we know somebody is waiting
+  if (__atomic_load_n(&sem->nwaiters, __ATOMIC_RELAXED) > 0) {
+    enter_critical_section();
+    sem->global++;
+    dsem_wake(sem);
+    exit_critical_section();
+    return 0;
+  }
+
+  // fast path: cache the resource in our shard
+  struct dsem_shard *shard = dsem_shard(sem);
+  long count = __atomic_add_fetch(&shard->count, 1, __ATOMIC_SEQ_CST);
+
+  // a thread may have started waiting in the meantime and missed our resource
+  if (__atomic_load_n(&sem->nwaiters, __ATOMIC_SEQ_CST) > 0) {
+    enter_critical_section();
+    dsem_wake(sem);
+    exit_critical_section();
+    return 0;
+  }
+
+  // the shard overflows, give the excess back to the global count
+  if (count > DSEM_SHARD_MAX) {
+    enter_critical_section();
+    count = __atomic_load_n(&shard->count, __ATOMIC_RELAXED);
+    while (count > DSEM_BATCH) {
+      if (__atomic_compare_exchange_n(&shard->count, &count, DSEM_BATCH, 1,
+                                      __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+        sem->global += count - DSEM_BATCH;
+        break;
+      }
+    }
+    exit_critical_section();
+  }
+
+  return 0;
+}
+
+int dsem_getvalue(dsem_t sem, int *sval, int mode)
+{
+  if (!sem || !sval) {
+    return -1;
+  }
+
+  long count;
+  int waiting;
+
+  if (mode == DSEM_EXACT) {
+    enter_critical_section();
+    dsem_drain(sem);
+    count = sem->global;
+    waiting = sem->waiting.length;
+    exit_critical_section();
+  } else if (mode == DSEM_APPROX) {
+    int i;
+
+    count = __atomic_load_n(&sem->global, __ATOMIC_RELAXED);
+    for (i = 0; i < sem->nshards; i++) {
+      count += __atomic_load_n(&sem->shards[i].count, __ATOMIC_RELAXED);
+    }
+    waiting = __atomic_load_n(&sem->nwaiters, __ATOMIC_RELAXED);
+  } else {
+    return -1;
+  }
+
+  if (count > 0) {
+    *sval = count;
+  } else {
+    *sval = waiting * -1;
+  }
+
+  return 0;
+}
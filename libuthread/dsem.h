@@ -0,0 +1,93 @@
+#ifndef _DSEM_H
+#define _DSEM_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+ * dsem_t - Distributed semaphore type
+ *
+ * A distributed semaphore is a counting semaphore meant for resource pools
+ * which are taken and released at a very high rate from many CPUs. Instead of
+ * a single shared count, most of the resources are cached in per-CPU shards,
+ * each on its own cache line. Taking or releasing a resource normally only
+ * touches the shard of the current CPU with a single atomic operation, and
+ * the global count (protected by the critical section) is only used when a
+ * shard runs dry or overflows.
+ *
+ * Unlike regular semaphores, a running thread can take a resource cached in
+ * its shard even if other threads are blocked on the semaphore.
+ */
+typedef struct dsem *dsem_t;
+
+/*
+ * dsem_create - Create distributed semaphore
+ * @count: Semaphore count
+ * @nshards: Number of shards, or 0 for one shard per online CPU
+ *
+ * Return: Pointer to initialized semaphore. NULL in case of failure when
+ * allocating the new semaphore.
+ */
+dsem_t dsem_create(size_t count, int nshards);
+
+/*
+ * dsem_destroy - Deallocate a distributed semaphore
+ * @sem: Semaphore to deallocate
+ *
+ * Return: -1 if @sem is NULL or if other threads are still being blocked on
+ * @sem. 0 is @sem was successfully destroyed.
+ */
+int dsem_destroy(dsem_t sem);
+
+/*
+ * dsem_down - Take a distributed semaphore
+ * @sem: Semaphore to take
+ *
+ * Take a resource from semaphore @sem, blocking the caller thread until a
+ * resource becomes available.
+ *
+ * Return: -1 if @sem is NULL. 0 if semaphore was successfully taken.
+ */
+int dsem_down(dsem_t sem);
+
+/*
+ * dsem_up - Release a distributed semaphore
+ * @sem: Semaphore to release
+ *
+ * Release a resource to semaphore @sem. If threads are blocked on @sem, the
+ * resource is handed off to the oldest of them.
+ *
+ * Return: -1 if @sem is NULL. 0 if semaphore was successfully released.
+ */
+int dsem_up(dsem_t sem);
+
+/*
+ * Modes of dsem_getvalue()
+ *
+ * DSEM_APPROX: add up the shards without synchronizing with concurrent
+ * operations. This never slows down other threads but the result may be off
+ * by the number of operations running concurrently.
+ *
+ * DSEM_EXACT: move all the cached resources back into the global count first,
+ * which gives the same result as sem_getvalue() at the cost of invalidating
+ * every shard.
+ */
+#define DSEM_APPROX 0
+#define DSEM_EXACT  1
+
+/*
+ * dsem_getvalue - Inspect distributed semaphore's internal state
+ * @sem: Semaphore to inspect
+ * @sval: Address of data item where value is received
+ * @mode: DSEM_APPROX or DSEM_EXACT
+ *
+ * If resources are available, assign their number to the data item pointed
+ * by @sval. Otherwise, assign a negative number whose absolute value is the
+ * number of threads currently blocked in dsem_down().
+ *
+ * Return: -1 if @sem or @sval are NULL or if @mode is invalid. 0 if semaphore
+ * was successfully inspected.
+ */
+int dsem_getvalue(dsem_t sem, int *sval, int mode);
+
+#endif /* _DSEM_H */
@@ -0,0 +1,256 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lfqueue.h"
+
+// MPMC QUEUE ------------------------------------------------------------------
+
+// A slot whose sequence number is equal to the head position is free to be
+// written. Once written, its sequence number becomes head + 1, which makes it
+// ready to be read at that same position. Once read, it becomes position +
+// capacity, i.e. free for the next round of writes.
+
+int mpmc_queue_init(mpmc_queue_t queue, size_t capacity)
+{
+  if (!queue || capacity == 0) {
+    return -1;
+  }
+
+  // with a single slot, a written slot's sequence number would be the next
+  // position to write, so that it could be overwritten before being read
+  size_t size = 2;
+  while (size < capacity) {
+    size <<= 1;
+  }
+
+  queue->slots = malloc(size * sizeof(struct mpmc_slot));
+  if (!queue->slots) {
+    return -1;
+  }
+
+  size_t i;
+  for (i = 0; i < size; i++) {
+    queue->slots[i].seq = i;
+  }
+
+  queue->mask = size - 1;
+  queue->head = 0;
+  queue->tail = 0;
+  return 0;
+}
+
+int mpmc_queue_fini(mpmc_queue_t queue)
+{
+  if (!queue) {
+    return -1;
+  }
+
+  free(queue->slots);
+  return 0;
+}
+
+mpmc_queue_t mpmc_queue_create(size_t capacity)
+{
+  struct mpmc_queue *queue;
+  if (posix_memalign((void**)&queue, LFQUEUE_CACHE_LINE,
+                     sizeof(struct mpmc_queue))) {
+    return NULL;
+  }
+
+  if (mpmc_queue_init(queue, capacity) == -1) {
+    free(queue);
+    return NULL;
+  }
+
+  return queue;
+}
+
+int mpmc_queue_destroy(mpmc_queue_t queue)
+{
+  if (!queue || mpmc_queue_length(queue) != 0) {
+    return -1;
+  }
+
+  mpmc_queue_fini(queue);
+  free(queue);
+  return 0;
+}
+
+int mpmc_queue_enqueue(mpmc_queue_t queue, void *data)
+{
+  if (!queue) {
+    return -1;
+  }
+
+  size_t pos = __atomic_load_n(&queue->head, __ATOMIC_RELAXED);
+  struct mpmc_slot *slot;
+
+  while (1) {
+    slot = &queue->slots[pos & queue->mask];
+    size_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+    intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+
+    if (diff == 0) {
+      // the slot is free, try to claim it
+      if (__atomic_compare_exchange_n(&queue->head, &pos, pos + 1, 1,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        break;
+      }
+    } else if (diff < 0) {
+      // the slot still holds an item from the previous round: full
+      return -1;
+    } else {
+      // another producer claimed it first
+      pos = __atomic_load_n(&queue->head, __ATOMIC_RELAXED);
+    }
+  }
+
+  slot->data = data;
+  __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+  return 0;
+}
+
+int mpmc_queue_dequeue(mpmc_queue_t queue, void **data)
+{
+  if (!queue || !data) {
+    return -1;
+  }
+
+  size_t pos = __atomic_load_n(&queue->tail, __ATOMIC_RELAXED);
+  struct mpmc_slot *slot;
+
+  while (1) {
+    slot = &queue->slots[pos & queue->mask];
+    size_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+    intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+
+    if (diff == 0) {
+      // the slot holds an item, try to claim it
+      if (__atomic_compare_exchange_n(&queue->tail, &pos, pos + 1, 1,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        break;
+      }
+    } else if (diff < 0) {
+      // the slot was not written yet: empty
+      return -1;
+    } else {
+      // another consumer claimed it first
+      pos = __atomic_load_n(&queue->tail, __ATOMIC_RELAXED);
+    }
+  }
+
+  *data = slot->data;
+  __atomic_store_n(&slot->seq, pos + queue->mask + 1, __ATOMIC_RELEASE);
+  return 0;
+}
+
+int mpmc_queue_length(mpmc_queue_t queue)
+{
+  if (!queue) {
+    return -1;
+  }
+
+  size_t tail = __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE);
+  size_t head = __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE);
+
+  // both positions are read at different times, so clamp the difference
+  if (head < tail) {
+    return 0;
+  }
+  if (head - tail > queue->mask + 1) {
+    return queue->mask + 1;
+  }
+  return head - tail;
+}
+
+// MPSC QUEUE ------------------------------------------------------------------
+
+// Producers exchange the head pointer with their new node, then link the
+// previous head to it. The consumer owns the tail node, which is a dummy
+// whose item was already dequeued: dequeueing moves the item out of the node
+// after it, which then becomes the new dummy, and frees the old one.
+
+struct mpsc_node {
+  struct mpsc_node *next;
+  void *data;
+};
+
+struct mpsc_queue {
+  struct mpsc_node *head __attribute__((aligned(LFQUEUE_CACHE_LINE)));
+  struct mpsc_node *tail __attribute__((aligned(LFQUEUE_CACHE_LINE)));
+};
+
+mpsc_queue_t mpsc_queue_create(void)
+{
+  struct mpsc_queue *queue;
+  if (posix_memalign((void**)&queue, LFQUEUE_CACHE_LINE,
+                     sizeof(struct mpsc_queue))) {
+    return NULL;
+  }
+
+  struct mpsc_node *dummy = calloc(1, sizeof(struct mpsc_node));
+  if (!dummy) {
+    free(queue);
+    return NULL;
+  }
+
+  queue->head = dummy;
+  queue->tail = dummy;
+  return queue;
+}
+
+int mpsc_queue_destroy(mpsc_queue_t queue)
+{
+  if (!queue) {
+    return -1;
+  }
+
+  if (queue->tail != __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE)) {
+    return -1;
+  }
+
+  free(queue->tail);
+  free(queue);
+  return 0;
+}
+
+int mpsc_queue_enqueue(mpsc_queue_t queue, void *data)
+{
+  if (!queue) {
+    return -1;
+  }
+
+  struct mpsc_node *node = malloc(sizeof(struct mpsc_node));
+  if (!node) {
+    return -1;
+  }
+
+  node->next = NULL;
+  node->data = data;
+
+  // between these two steps the queue is cut at prev: the consumer sees it
+  // as ending there until the link is stored
+  struct mpsc_node *prev = __atomic_exchange_n(&queue->head, node,
+                                               __ATOMIC_ACQ_REL);
+  __atomic_store_n(&prev->next, node, __ATOMIC_RELEASE);
+  return 0;
+}
+
+int mpsc_queue_dequeue(mpsc_queue_t queue, void **data)
+{
+  if (!queue || !data) {
+    return -1;
+  }
+
+  struct mpsc_node *tail = queue->tail;
+  struct mpsc_node *next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+  if (!next) {
+    return -1;
+  }
+
+  *data = next->data;
+  queue->tail = next;
+  free(tail);
+  return 0;
+}
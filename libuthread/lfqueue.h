@@ -0,0 +1,163 @@
+#ifndef _LFQUEUE_H
+#define _LFQUEUE_H
+
+#include <stddef.h>
+
+/*
+ * Lock-free queues
+ *
+ * Unlike queue_t, which must be protected by the caller, these queues can be
+ * used concurrently by several threads without entering the critical section.
+ * Items are dequeued in the order they were enqueued (per enqueueing thread)
+ * and, unlike with queue_t, may be NULL.
+ */
+
+#define LFQUEUE_CACHE_LINE 64
+
+struct mpmc_slot {
+  size_t seq;
+  void *data;
+};
+
+/*
+ * mpmc_queue_t - Bounded multi-producer multi-consumer queue type
+ *
+ * A ring buffer of a fixed power-of-2 capacity of at least 2, in which every slot carries a
+ * sequence number telling whether it is ready to be written or read, so that
+ * both enqueueing and dequeueing only take a couple of atomic operations.
+ * struct mpmc_queue is exposed so that it can be embedded in other objects
+ * and initialized in place with mpmc_queue_init().
+ */
+struct mpmc_queue {
+  struct mpmc_slot *slots;
+  size_t mask;
+
+  // positions of the next slot to write and of the next slot to read, each on
+  // its own cache line since they are updated by different threads
+  size_t head __attribute__((aligned(LFQUEUE_CACHE_LINE)));
+  size_t tail __attribute__((aligned(LFQUEUE_CACHE_LINE)));
+};
+
+typedef struct mpmc_queue *mpmc_queue_t;
+
+/*
+ * mpmc_queue_init - Initialize queue in place
+ * @queue: Queue to initialize
+ * @capacity: Maximum number of items in @queue, rounded up to the next power
+ * of 2, and to at least 2
+ *
+ * Return: -1 if @queue is NULL, if @capacity is 0, or in case of failure when
+ * allocating the slots. 0 if @queue was successfully initialized.
+ */
+int mpmc_queue_init(mpmc_queue_t queue, size_t capacity);
+
+/*
+ * mpmc_queue_fini - Finalize queue in place
+ * @queue: Queue to finalize
+ *
+ * Items still in the queue are dropped.
+ *
+ * Return: -1 if @queue is NULL. 0 if @queue was successfully finalized.
+ */
+int mpmc_queue_fini(mpmc_queue_t queue);
+
+/*
+ * mpmc_queue_create - Allocate an empty queue
+ * @capacity: Maximum number of items in the queue, rounded up to the next
+ * power of 2, and to at least 2
+ *
+ * Return: Pointer to new empty queue. NULL if @capacity is 0 or in case of
+ * failure when allocating the new queue.
+ */
+mpmc_queue_t mpmc_queue_create(size_t capacity);
+
+/*
+ * mpmc_queue_destroy - Deallocate a queue
+ * @queue: Queue to deallocate
+ *
+ * Return: -1 if @queue is NULL or if @queue is not empty. 0 if @queue was
+ * successfully destroyed.
+ */
+int mpmc_queue_destroy(mpmc_queue_t queue);
+
+/*
+ * mpmc_queue_enqueue - Enqueue data item
+ * @queue: Queue in which to enqueue item
+ * @data: Data item to enqueue
+ *
+ * Return: -1 if @queue is NULL or if @queue is full. 0 if @data was
+ * successfully enqueued in @queue.
+ */
+int mpmc_queue_enqueue(mpmc_queue_t queue, void *data);
+
+/*
+ * mpmc_queue_dequeue - Dequeue data item
+ * @queue: Queue in which to dequeue item
+ * @data: Address of data pointer where item is received
+ *
+ * Return: -1 if @queue or @data are NULL, or if @queue is empty. 0 if @data
+ * was set with the oldest item available in @queue.
+ */
+int mpmc_queue_dequeue(mpmc_queue_t queue, void **data);
+
+/*
+ * mpmc_queue_length - Queue length
+ * @queue: Queue to get the length of
+ *
+ * The result is only a snapshot if other threads use @queue concurrently.
+ *
+ * Return: -1 if @queue is NULL. Length of @queue otherwise.
+ */
+int mpmc_queue_length(mpmc_queue_t queue);
+
+/*
+ * mpsc_queue_t - Unbounded multi-producer single-consumer queue type
+ *
+ * A linked list of nodes, in which producers append a node with a single
+ * atomic exchange, so that enqueueing never waits for other threads (it may
+ * still allocate memory). Only one thread at a time may dequeue.
+ */
+typedef struct mpsc_queue *mpsc_queue_t;
+
+/*
+ * mpsc_queue_create - Allocate an empty queue
+ *
+ * Return: Pointer to new empty queue. NULL in case of failure when allocating
+ * the new queue.
+ */
+mpsc_queue_t mpsc_queue_create(void);
+
+/*
+ * mpsc_queue_destroy - Deallocate a queue
+ * @queue: Queue to deallocate
+ *
+ * Return: -1 if @queue is NULL or if @queue is not empty. 0 if @queue was
+ * successfully destroyed.
+ */
+int mpsc_queue_destroy(mpsc_queue_t queue);
+
+/*
+ * mpsc_queue_enqueue - Enqueue data item
+ * @queue: Queue in which to enqueue item
+ * @data: Data item to enqueue
+ *
+ * Return: -1 if @queue is NULL, or in case of memory allocation error when
+ * enqueueing. 0 if @data was successfully enqueued in @queue.
+ */
+int mpsc_queue_enqueue(mpsc_queue_t queue, void *data);
+
+/*
+ * mpsc_queue_dequeue - Dequeue data item
+ * @queue: Queue in which to dequeue item
+ * @data: Address of data pointer where item is received
+ *
+ * Must only be called by one thread at a time. An item whose enqueueing is
+ * still in progress in another thread is not visible yet, and neither are the
+ * items enqueued after it.
+ *
+ * Return: -1 if @queue or @data are NULL, or if @queue is empty. 0 if @data
+ * was set with the oldest item available in @queue.
+ */
+int mpsc_queue_dequeue(mpsc_queue_t queue, void **data);
+
+#endif /* _LFQUEUE_H */
@@ -0,0 +1,133 @@
+#include <stdlib.h>
+
+#include "mutex.h"
+#include "thread.h"
+#include "waitq.h"
+
+int mutex_init(mutex_t mutex)
+{
+  if (!mutex) {
+    return -1;
+  }
+
+  mutex->state = 0;
+  waitq_init(&mutex->waiting);
+  return 0;
+}
+
+int mutex_fini(mutex_t mutex)
+{
+  if (!mutex) {
+    return -1;
+  }
+
+  if (__atomic_load_n(&mutex->state, __ATOMIC_ACQUIRE) != 0) {
+    return -1;
+  }
+
+  return 0;
+}
+
+mutex_t mutex_create(void)
+{
+  struct mutex *mutex = malloc(sizeof(struct mutex));
+  if (!mutex) {
+    return NULL;
+  }
+
+  mutex_init(mutex);
+  return mutex;
+}
+
+int mutex_destroy(mutex_t mutex)
+{
+  if (mutex_fini(mutex) == -1) {
+    return -1;
+  }
+
+  free(mutex);
+  return 0;
+}
+
+int mutex_trylock(mutex_t mutex)
+{
+  if (!mutex) {
+    return -1;
+  }
+
+  int unlocked = 0;
+  if (!__atomic_compare_exchange_n(&mutex->state, &unlocked, 1, 0,
+                                   __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+    return -1;
+  }
+
+  return 0;
+}
+
+int mutex_lock(mutex_t mutex)
+{
+  if (!mutex) {
+    return -1;
+  }
+
+  // fast path: the mutex is free
+  if (mutex_trylock(mutex) == 0) {
+    return 0;
+  }
+
+  struct waiter waiter;
+  waiter.tid = thread_self();
+  waiter.set = NULL;
+
+  // slow path: mark the mutex as contended so that its holder knows it has to
+  // wake us up, and sleep until it does. Since we don't know whether other
+  // threads are still waiting when we finally get the mutex, we leave it
+  // marked as contended. We stay in the waiting list until an unlock pops us
+  // out of it, so a spurious wakeup must not queue us a second time
+  enter_critical_section();
+  while (__atomic_exchange_n(&mutex->state, 2, __ATOMIC_ACQUIRE) != 0) {
+    waiter.granted = 0;
+    waitq_push(&mutex->waiting, &waiter);
+    while (!waiter.granted) {
+      if (thread_block() == -1) {
+        waitq_remove(&mutex->waiting, &waiter);
+        exit_critical_section();
+        return -1;
+      }
+    }
+  }
+  exit_critical_section();
+
+  return 0;
+}
+
+int mutex_unlock(mutex_t mutex)
+{
+  if (!mutex) {
+    return -1;
+  }
+
+  int state = __atomic_load_n(&mutex->state, __ATOMIC_RELAXED);
+  if (state == 0) {
+    return -1;
+  }
+
+  // fast path: nobody is waiting
+  if (__atomic_fetch_sub(&mutex->state, 1, __ATOMIC_RELEASE) == 1) {
+    return 0;
+  }
+
+  // contended: release the mutex and wake up the oldest waiter, which will
+  // compete for it again
+  __atomic_store_n(&mutex->state, 0, __ATOMIC_RELEASE);
+
+  enter_critical_section();
+  struct waiter *waiter = waitq_pop(&mutex->waiting);
+  if (waiter) {
+    waiter->granted = 1;
+    thread_unblock(waiter->tid);
+  }
+  exit_critical_section();
+
+  return 0;
+}
@@ -0,0 +1,94 @@
+#ifndef _MUTEX_H
+#define _MUTEX_H
+
+#include "waitq.h"
+
+/*
+ * mutex_t - Mutex type
+ *
+ * A mutex provides mutual exclusion between threads. Locking an unlocked mutex
+ * and unlocking a mutex nobody else is waiting for are a single atomic
+ * operation and never enter the critical section. Contended threads block on
+ * the mutex's waiting list, like on a semaphore.
+ */
+typedef struct mutex *mutex_t;
+
+/*
+ * struct mutex - Mutex object
+ *
+ * The definition is only exposed so that mutexes can be embedded in other
+ * structures and initialized with mutex_init(). Its fields must only be
+ * accessed through the functions below.
+ */
+struct mutex {
+  int state; // 0: unlocked, 1: locked, 2: locked and possibly contended
+  struct waitq waiting;
+};
+
+/*
+ * mutex_init - Initialize a mutex in place
+ * @mutex: Address of the mutex object to initialize
+ *
+ * Return: -1 if @mutex is NULL. 0 if @mutex was successfully initialized,
+ * unlocked.
+ */
+int mutex_init(mutex_t mutex);
+
+/*
+ * mutex_fini - Finalize a mutex initialized in place
+ * @mutex: Mutex to finalize
+ *
+ * Return: -1 if @mutex is NULL, or if @mutex is locked. 0 if @mutex was
+ * successfully finalized.
+ */
+int mutex_fini(mutex_t mutex);
+
+/*
+ * mutex_create - Create a mutex
+ *
+ * Return: Pointer to new unlocked mutex. NULL in case of failure when
+ * allocating the new mutex.
+ */
+mutex_t mutex_create(void);
+
+/*
+ * mutex_destroy - Deallocate a mutex
+ * @mutex: Mutex to deallocate
+ *
+ * Return: -1 if @mutex is NULL, or if @mutex is locked. 0 if @mutex was
+ * successfully destroyed.
+ */
+int mutex_destroy(mutex_t mutex);
+
+/*
+ * mutex_lock - Lock a mutex
+ * @mutex: Mutex to lock
+ *
+ * Lock @mutex, blocking the caller thread until @mutex is unlocked if another
+ * thread holds it.
+ *
+ * Return: -1 if @mutex is NULL. 0 if @mutex was successfully locked.
+ */
+int mutex_lock(mutex_t mutex);
+
+/*
+ * mutex_trylock - Lock a mutex without blocking
+ * @mutex: Mutex to lock
+ *
+ * Return: -1 if @mutex is NULL, or if @mutex is already locked. 0 if @mutex was
+ * successfully locked.
+ */
+int mutex_trylock(mutex_t mutex);
+
+/*
+ * mutex_unlock - Unlock a mutex
+ * @mutex: Mutex to unlock
+ *
+ * Unlock @mutex and wake up the oldest thread blocked on it, if any.
+ *
+ * Return: -1 if @mutex is NULL, or if @mutex is not locked. 0 if @mutex was
+ * successfully unlocked.
+ */
+int mutex_unlock(mutex_t mutex);
+
+#endif /* _MUTEX_H */
@@ -0,0 +1,258 @@
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PAGE_X86
+#endif
+
+#include "page.h"
+
+struct page_kernels {
+  const char *isa;
+  size_t (*diff)(const void *a, const void *b, struct tps_range *ranges,
+                 size_t max);
+};
+
+// ranges found so far by a diff. The last one is only stored once we know it
+// doesn't continue
+struct diff_state {
+  struct tps_range *ranges;
+  size_t max;
+  size_t count;
+  size_t start, end;
+};
+
+// HELPER FUNCTIONS ------------------------------------------------------------
+
+// inlined into each kernel, so that they are compiled for its instruction set:
+// calling SSE code with dirty AVX registers is very slow on some CPUs
+static inline __attribute__((always_inline))
+void diff_flush(struct diff_state *state)
+{
+  if (state->end == state->start) {
+    return;
+  }
+
+  if (state->count < state->max) {
+    state->ranges[state->count].offset = state->start;
+    state->ranges[state->count].length = state->end - state->start;
+  }
+  state->count++;
+}
+
+// add the differing bytes of the block at offset base, one bit per byte in
+// changed (at most 32)
+static inline __attribute__((always_inline))
+void diff_add(struct diff_state *state, uint64_t changed, size_t base)
+{
+  while (changed) {
+    size_t first = __builtin_ctzll(changed);
+    size_t length = __builtin_ctzll(~(changed >> first));
+
+    if (state->end == base + first && state->end != state->start) {
+      state->end += length;
+    } else {
+      diff_flush(state);
+      state->start = base + first;
+      state->end = state->start + length;
+    }
+
+    changed &= ~((((uint64_t)1 << length) - 1) << first);
+  }
+}
+
+// SCALAR KERNEL ---------------------------------------------------------------
+
+static size_t diff_scalar(const void *a, const void *b,
+                          struct tps_range *ranges, size_t max)
+{
+  const unsigned char *pa = a, *pb = b;
+  struct diff_state state = { ranges, max, 0, 0, 0 };
+  size_t i, j;
+
+  for (i = 0; i < TPS_SIZE; i += 8) {
+    uint64_t wa, wb;
+    memcpy(&wa, pa + i, 8);
+    memcpy(&wb, pb + i, 8);
+    if (wa == wb) {
+      continue;
+    }
+
+    uint64_t changed = 0;
+    for (j = 0; j < 8; j++) {
+      if (pa[i + j] != pb[i + j]) {
+        changed |= (uint64_t)1 << j;
+      }
+    }
+    diff_add(&state, changed, i);
+  }
+
+  diff_flush(&state);
+  return state.count;
+}
+
+#ifdef PAGE_X86
+
+// SSE2 KERNEL -----------------------------------------------------------------
+
+// bytes of the 64 bytes at a and b which are equal, one bit per byte
+__attribute__((target("sse2")))
+static inline uint64_t equal64_sse2(const __m128i *a, const __m128i *b)
+{
+  __m128i eq0 = _mm_cmpeq_epi8(_mm_loadu_si128(a), _mm_loadu_si128(b));
+  __m128i eq1 = _mm_cmpeq_epi8(_mm_loadu_si128(a + 1), _mm_loadu_si128(b + 1));
+  __m128i eq2 = _mm_cmpeq_epi8(_mm_loadu_si128(a + 2), _mm_loadu_si128(b + 2));
+  __m128i eq3 = _mm_cmpeq_epi8(_mm_loadu_si128(a + 3), _mm_loadu_si128(b + 3));
+
+  // all equal is the common case, checked with one movemask
+  __m128i eq = _mm_and_si128(_mm_and_si128(eq0, eq1), _mm_and_si128(eq2, eq3));
+  if (_mm_movemask_epi8(eq) == 0xffff) {
+    return ~0ULL;
+  }
+
+  return (uint64_t)(uint16_t)_mm_movemask_epi8(eq0) |
+         (uint64_t)(uint16_t)_mm_movemask_epi8(eq1) << 16 |
+         (uint64_t)(uint16_t)_mm_movemask_epi8(eq2) << 32 |
+         (uint64_t)(uint16_t)_mm_movemask_epi8(eq3) << 48;
+}
+
+__attribute__((target("sse2")))
+static size_t diff_sse2(const void *a, const void *b, struct tps_range *ranges,
+                        size_t max)
+{
+  struct diff_state state = { ranges, max, 0, 0, 0 };
+  size_t i;
+
+  for (i = 0; i < TPS_SIZE / 16; i += 4) {
+    uint64_t mask = equal64_sse2((const __m128i*)a + i, (const __m128i*)b + i);
+    if (mask != ~0ULL) {
+      diff_add(&state, ~mask & 0xffffffff, i * 16);
+      diff_add(&state, ~mask >> 32, i * 16 + 32);
+    }
+  }
+
+  diff_flush(&state);
+  return state.count;
+}
+
+// AVX2 KERNEL -----------------------------------------------------------------
+
+// bytes of the 64 bytes at a and b which are equal, one bit per byte
+__attribute__((target("avx2")))
+static inline uint64_t equal64_avx2(const __m256i *a, const __m256i *b)
+{
+  __m256i eq0 = _mm256_cmpeq_epi8(_mm256_loadu_si256(a),
+                                  _mm256_loadu_si256(b));
+  __m256i eq1 = _mm256_cmpeq_epi8(_mm256_loadu_si256(a + 1),
+                                  _mm256_loadu_si256(b + 1));
+
+  return (uint64_t)(uint32_t)_mm256_movemask_epi8(eq0) |
+         (uint64_t)(uint32_t)_mm256_movemask_epi8(eq1) << 32;
+}
+
+__attribute__((target("avx2")))
+static size_t diff_avx2(const void *a, const void *b, struct tps_range *ranges,
+                        size_t max)
+{
+  struct diff_state state = { ranges, max, 0, 0, 0 };
+  size_t i;
+
+  for (i = 0; i < TPS_SIZE / 32; i += 2) {
+    uint64_t mask = equal64_avx2((const __m256i*)a + i, (const __m256i*)b + i);
+    if (mask != ~0ULL) {
+      diff_add(&state, ~mask & 0xffffffff, i * 32);
+      diff_add(&state, ~mask >> 32, i * 32 + 32);
+    }
+  }
+
+  diff_flush(&state);
+  return state.count;
+}
+
+#endif
+
+// DISPATCH --------------------------------------------------------------------
+
+// best first
+static const struct page_kernels kernels[] = {
+#ifdef PAGE_X86
+  { "avx2", diff_avx2 },
+  { "sse2", diff_sse2 },
+#endif
+  { "scalar", diff_scalar },
+};
+
+#define NKERNELS (sizeof(kernels) / sizeof(kernels[0]))
+
+static const struct page_kernels *current = &kernels[NKERNELS - 1];
+
+static int page_supported(const struct page_kernels *k)
+{
+#ifdef PAGE_X86
+  __builtin_cpu_init();
+  if (strcmp(k->isa, "avx2") == 0) {
+    return __builtin_cpu_supports("avx2");
+  }
+  if (strcmp(k->isa, "sse2") == 0) {
+    return __builtin_cpu_supports("sse2");
+  }
+#endif
+  return 1;
+}
+
+__attribute__((constructor))
+static void page_select(void)
+{
+  size_t i;
+
+  for (i = 0; i < NKERNELS; i++) {
+    if (page_supported(&kernels[i])) {
+      current = &kernels[i];
+      return;
+    }
+  }
+}
+
+// PAGE FUNCTIONS --------------------------------------------------------------
+
+int page_use(const char *isa)
+{
+  size_t i;
+
+  if (!isa) {
+    return -1;
+  }
+
+  for (i = 0; i < NKERNELS; i++) {
+    if (strcmp(kernels[i].isa, isa) == 0 && page_supported(&kernels[i])) {
+      current = &kernels[i];
+      return 0;
+    }
+  }
+
+  return -1;
+}
+
+const char *page_isa(void)
+{
+  return current->isa;
+}
+
+// glibc already picks SIMD versions of memcpy and memcmp for the CPU, which
+// are at least as fast as our own kernels were
+void page_copy(void *dst, const void *src)
+{
+  memcpy(dst, src, TPS_SIZE);
+}
+
+int page_equal(const void *a, const void *b)
+{
+  return memcmp(a, b, TPS_SIZE) == 0;
+}
+
+size_t page_diff(const void *a, const void *b, struct tps_range *ranges,
+                 size_t max)
+{
+  return current->diff(a, b, ranges, max);
+}
@@ -0,0 +1,65 @@
+#ifndef _PAGE_H
+#define _PAGE_H
+
+#include <stddef.h>
+
+#include "tps.h"
+
+/*
+ * Page kernels
+ *
+ * Copy, compare and diff pages of TPS_SIZE bytes, aligned or not. The diff
+ * kernel has an AVX2, an SSE2 and a scalar version, and the best one the CPU
+ * supports is picked when the library is loaded. Copies and comparisons use
+ * memcpy and memcmp, for which glibc already picks the best version.
+ */
+
+/*
+ * page_use - Select the diff kernel to use
+ * @isa: "avx2", "sse2" or "scalar"
+ *
+ * Override the kernel picked for the CPU, e.g. to test or benchmark each of
+ * them.
+ *
+ * Return: -1 if @isa is unknown or not supported by the CPU. 0 if the kernel
+ * of @isa is now used.
+ */
+int page_use(const char *isa);
+
+/*
+ * page_isa - Get the diff kernel in use
+ *
+ * Return: Name of the kernel in use, as given to page_use().
+ */
+const char *page_isa(void);
+
+/*
+ * page_copy - Copy a page
+ * @dst: Destination page
+ * @src: Source page
+ */
+void page_copy(void *dst, const void *src);
+
+/*
+ * page_equal - Compare two pages
+ * @a, @b: Pages to compare
+ *
+ * Return: 1 if the pages hold the same bytes, 0 otherwise.
+ */
+int page_equal(const void *a, const void *b);
+
+/*
+ * page_diff - Find the bytes which differ between two pages
+ * @a, @b: Pages to compare
+ * @ranges: Array receiving the ranges of bytes which differ, in order
+ * @max: Number of entries of @ranges
+ *
+ * Adjacent differing bytes form one range.
+ *
+ * Return: Number of ranges of differing bytes, which only are all stored in
+ * @ranges if it is no larger than @max.
+ */
+size_t page_diff(const void *a, const void *b, struct tps_range *ranges,
+                 size_t max);
+
+#endif /* _PAGE_H */
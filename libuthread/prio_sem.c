@@ -0,0 +1,374 @@
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "prio_sem.h"
+#include "thread.h"
+#include "waitq.h"
+
+// maximum length of a chain of priority inheritance we follow, which protects
+// us against cycles of threads holding each other's semaphores
+#define PRIO_SEM_MAX_CHAIN 16
+
+struct prio_thread;
+
+// a blocked thread entry, living on the stack of the blocked thread
+struct prio_waiter {
+  struct waiter waiter;
+  int prio;
+  struct prio_thread *thread;
+};
+
+struct prio_semaphore {
+  int count;
+  int inherit;
+
+  // one FIFO list per priority level, and a bitmap of non-empty levels
+  struct waitq waiting[PRIO_SEM_LEVELS];
+  uint32_t levels;
+  int length;
+
+  // thread which last took the semaphore, when priority inheritance is on, and
+  // links in its list of held semaphores
+  struct prio_thread *holder;
+  struct prio_semaphore *held_prev, *held_next;
+};
+
+// per-thread priority information
+struct prio_thread {
+  int base; // priority set with prio_sem_setprio()
+  int effective; // priority including inherited priority
+
+  // semaphore we are currently blocked on, if any
+  struct prio_semaphore *blocked_on;
+  struct prio_waiter *waiter;
+
+  // semaphores we hold, whose waiters we inherit the priority of
+  struct prio_semaphore *held;
+};
+
+// the per-thread information lives in the private area of each thread, which
+// follows user threads from one worker to another
+_Static_assert(sizeof(struct prio_thread) <= THREAD_PRIVATE_SIZE,
+               "struct prio_thread must fit in the thread private area");
+
+static struct prio_thread *prio_self(void)
+{
+  return thread_private();
+}
+
+// HELPER FUNCTIONS ------------------------------------------------------------
+
+static void prio_push(struct prio_semaphore *sem, struct prio_waiter *w)
+{
+  waitq_push(&sem->waiting[w->prio], &w->waiter);
+  sem->levels |= (uint32_t)1 << w->prio;
+  sem->length++;
+}
+
+static void prio_remove(struct prio_semaphore *sem, struct prio_waiter *w)
+{
+  waitq_remove(&sem->waiting[w->prio], &w->waiter);
+  if (sem->waiting[w->prio].length == 0) {
+    sem->levels &= ~((uint32_t)1 << w->prio);
+  }
+  sem->length--;
+}
+
+// remove the oldest waiter of highest priority, NULL if nobody is waiting
+static struct prio_waiter *prio_pop(struct prio_semaphore *sem)
+{
+  if (sem->levels == 0) {
+    return NULL;
+  }
+
+  // the highest priority level with waiters is the highest bit set
+  int prio = 31 - __builtin_clz(sem->levels);
+  struct prio_waiter *w = (struct prio_waiter*) sem->waiting[prio].head;
+
+  prio_remove(sem, w);
+  return w;
+}
+
+// make thread the holder of sem, instead of its previous holder if any
+static void prio_hold(struct prio_semaphore *sem, struct prio_thread *thread)
+{
+  if (sem->holder == thread) {
+    return;
+  }
+
+  if (sem->holder) {
+    if (sem->held_prev) {
+      sem->held_prev->held_next = sem->held_next;
+    } else {
+      sem->holder->held = sem->held_next;
+    }
+    if (sem->held_next) {
+      sem->held_next->held_prev = sem->held_prev;
+    }
+  }
+
+  sem->holder = thread;
+  sem->held_prev = NULL;
+  sem->held_next = NULL;
+  if (thread) {
+    sem->held_next = thread->held;
+    if (thread->held) {
+      thread->held->held_prev = sem;
+    }
+    thread->held = sem;
+  }
+}
+
+// priority of thread, including the priority of the highest waiters of the
+// semaphores it holds
+static int prio_effective(struct prio_thread *thread)
+{
+  struct prio_semaphore *sem;
+  int prio = thread->base;
+
+  for (sem = thread->held; sem; sem = sem->held_next) {
+    if (sem->inherit && sem->levels) {
+      int top = 31 - __builtin_clz(sem->levels);
+      if (top > prio) {
+        prio = top;
+      }
+    }
+  }
+
+  return prio;
+}
+
+// forget the holder of sem, which drops any priority it inherited from sem but
+// not from the other semaphores it holds
+static void prio_unhold(struct prio_semaphore *sem)
+{
+  struct prio_thread *holder = sem->holder;
+
+  if (holder) {
+    prio_hold(sem, NULL);
+    holder->effective = prio_effective(holder);
+  }
+}
+
+// raise the priority of the holder of sem to prio, and propagate the boost if
+// the holder is itself blocked on another semaphore
+static void prio_boost(struct prio_semaphore *sem, int prio)
+{
+  int depth;
+
+  for (depth = 0; depth < PRIO_SEM_MAX_CHAIN; depth++) {
+    if (!sem->inherit || sem->holder == NULL) {
+      return;
+    }
+
+    struct prio_thread *holder = sem->holder;
+    if (holder->effective >= prio) {
+      return;
+    }
+
+    holder->effective = prio;
+
+    // the holder is not waiting for anything, boosting it is enough
+    if (holder->blocked_on == NULL) {
+      return;
+    }
+
+    // otherwise move it up in the semaphore it is waiting on, whose holder
+    // might need a boost in turn
+    sem = holder->blocked_on;
+    prio_remove(sem, holder->waiter);
+    holder->waiter->prio = prio;
+    prio_push(sem, holder->waiter);
+  }
+}
+
+// PRIORITY SEMAPHORE FUNCTIONS ------------------------------------------------
+
+prio_sem_t prio_sem_create(size_t count)
+{
+  struct prio_semaphore *sem = malloc(sizeof(struct prio_semaphore));
+  if (!sem) {
+    return NULL;
+  }
+
+  int i;
+  for (i = 0; i < PRIO_SEM_LEVELS; i++) {
+    waitq_init(&sem->waiting[i]);
+  }
+
+  sem->count = count;
+  sem->inherit = 0;
+  sem->levels = 0;
+  sem->length = 0;
+  sem->holder = NULL;
+  sem->held_prev = NULL;
+  sem->held_next = NULL;
+
+  return sem;
+}
+
+int prio_sem_destroy(prio_sem_t sem)
+{
+  if (!sem) {
+    return -1;
+  }
+
+  enter_critical_section();
+
+  // cannot delete a semaphore while other threads are waiting on it
+  if (sem->length > 0) {
+    exit_critical_section();
+    return -1;
+  }
+
+  prio_unhold(sem);
+  exit_critical_section();
+
+  free(sem);
+  return 0;
+}
+
+int prio_sem_down(prio_sem_t sem)
+{
+  struct prio_thread *self = prio_self();
+
+  if (!sem) {
+    return -1;
+  }
+
+  enter_critical_section();
+
+  if (sem->count > 0) {
+    sem->count--;
+    if (sem->inherit) {
+      prio_hold(sem, self);
+    }
+    exit_critical_section();
+    return 0;
+  }
+
+  // nothing available, wait in the list matching our priority
+  struct prio_waiter w;
+  w.waiter.tid = thread_self();
+  w.waiter.granted = 0;
+  w.prio = self->effective;
+  w.thread = self;
+  prio_push(sem, &w);
+
+  self->blocked_on = sem;
+  self->waiter = &w;
+  prio_boost(sem, w.prio);
+
+  // the resource is always handed off to us by prio_sem_up, and our priority
+  // may have been raised while we were waiting
+  while (!w.waiter.granted) {
+    if (thread_block() == -1) {
+      prio_remove(sem, &w);
+      self->blocked_on = NULL;
+      exit_critical_section();
+      return -1;
+    }
+  }
+
+  self->blocked_on = NULL;
+  self->waiter = NULL;
+  exit_critical_section();
+  return 0;
+}
+
+int prio_sem_up(prio_sem_t sem)
+{
+  struct prio_thread *self = prio_self();
+
+  if (!sem) {
+    return -1;
+  }
+
+  enter_critical_section();
+
+  // releasing the semaphore drops any priority we inherited from it
+  if (sem->holder == self) {
+    prio_unhold(sem);
+  }
+
+  struct prio_waiter *w = prio_pop(sem);
+  if (w == NULL) {
+    sem->count++;
+    exit_critical_section();
+    return 0;
+  }
+
+  // hand off the resource, the waiter becomes the new holder
+  w->waiter.granted = 1;
+  if (sem->inherit) {
+    prio_hold(sem, w->thread);
+  }
+  if (thread_unblock(w->waiter.tid) == -1) {
+    exit_critical_section();
+    return -1;
+  }
+
+  // the remaining waiters, if any, now wait on the new holder
+  if (sem->levels) {
+    prio_boost(sem, 31 - __builtin_clz(sem->levels));
+  }
+
+  exit_critical_section();
+  return 0;
+}
+
+int prio_sem_getvalue(prio_sem_t sem, int *sval)
+{
+  if (!sem || !sval) {
+    return -1;
+  }
+
+  enter_critical_section();
+  if (sem->count > 0) {
+    *sval = sem->count;
+  } else {
+    *sval = sem->length * -1;
+  }
+  exit_critical_section();
+
+  return 0;
+}
+
+int prio_sem_setinherit(prio_sem_t sem, int inherit)
+{
+  if (!sem) {
+    return -1;
+  }
+
+  enter_critical_section();
+  sem->inherit = inherit ? 1 : 0;
+  if (!sem->inherit) {
+    prio_unhold(sem);
+  }
+  exit_critical_section();
+  return 0;
+}
+
+int prio_sem_setprio(int prio)
+{
+  struct prio_thread *self = prio_self();
+
+  if (prio < 0 || prio >= PRIO_SEM_LEVELS) {
+    return -1;
+  }
+
+  enter_critical_section();
+
+  // never drop below a priority we currently inherit
+  self->base = prio;
+  self->effective = prio_effective(self);
+
+  exit_critical_section();
+  return 0;
+}
+
+int prio_sem_getprio(void)
+{
+  return prio_self()->effective;
+}
@@ -0,0 +1,118 @@
+#ifndef _PRIO_SEM_H
+#define _PRIO_SEM_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+ * Number of priority levels. Priorities range from 0 (lowest, the default) to
+ * PRIO_SEM_LEVELS - 1 (highest).
+ */
+#define PRIO_SEM_LEVELS 32
+
+/*
+ * prio_sem_t - Priority semaphore type
+ *
+ * A priority semaphore behaves like a regular semaphore (see sem.h), except
+ * that its blocked threads are not woken up in FIFO order: releasing a resource
+ * always hands it off to the oldest of the highest priority waiters. Waiters
+ * are kept in one FIFO list per priority level along with a bitmap of the
+ * non-empty levels, so both blocking and waking up are O(1).
+ *
+ * The priority of a thread is set with prio_sem_setprio() and applies to all
+ * the priority semaphores it waits on.
+ */
+typedef struct prio_semaphore *prio_sem_t;
+
+/*
+ * prio_sem_create - Create priority semaphore
+ * @count: Semaphore count
+ *
+ * Allocate and initialize a priority semaphore of internal count @count.
+ *
+ * Return: Pointer to initialized semaphore. NULL in case of failure when
+ * allocating the new semaphore.
+ */
+prio_sem_t prio_sem_create(size_t count);
+
+/*
+ * prio_sem_destroy - Deallocate a priority semaphore
+ * @sem: Semaphore to deallocate
+ *
+ * Return: -1 if @sem is NULL or if other threads are still being blocked on
+ * @sem. 0 is @sem was successfully destroyed.
+ */
+int prio_sem_destroy(prio_sem_t sem);
+
+/*
+ * prio_sem_down - Take a priority semaphore
+ * @sem: Semaphore to take
+ *
+ * Take a resource from semaphore @sem, blocking the caller thread at its
+ * current priority until the resource becomes available.
+ *
+ * Return: -1 if @sem is NULL. 0 if semaphore was successfully taken.
+ */
+int prio_sem_down(prio_sem_t sem);
+
+/*
+ * prio_sem_up - Release a priority semaphore
+ * @sem: Semaphore to release
+ *
+ * Release a resource to semaphore @sem. If threads are blocked on @sem, the
+ * resource is directly handed off to the oldest thread among those of highest
+ * priority, which is then unblocked.
+ *
+ * Return: -1 if @sem is NULL. 0 if semaphore was successfully released.
+ */
+int prio_sem_up(prio_sem_t sem);
+
+/*
+ * prio_sem_getvalue - Inspect priority semaphore's internal state
+ * @sem: Semaphore to inspect
+ * @sval: Address of data item where value is received
+ *
+ * Same as sem_getvalue().
+ *
+ * Return: -1 if @sem or @sval are NULL. 0 if semaphore was successfully
+ * inspected.
+ */
+int prio_sem_getvalue(prio_sem_t sem, int *sval);
+
+/*
+ * prio_sem_setinherit - Enable priority inheritance hint
+ * @sem: Semaphore to configure
+ * @inherit: 1 to enable priority inheritance, 0 to disable it
+ *
+ * When priority inheritance is enabled, the thread which last took @sem is
+ * considered its holder until it releases it. A thread blocking on @sem raises
+ * the priority of the holder to its own priority if it is higher, so that the
+ * holder doesn't get stuck behind lower priority threads on other priority
+ * semaphores before it can release @sem. When it releases @sem, the holder
+ * goes back to its own priority, or to the priority it still inherits from
+ * the other semaphores it holds.
+ *
+ * This is only meaningful for semaphores used as locks, i.e. with a count of 1,
+ * and which are released by the thread which took them.
+ *
+ * Return: -1 if @sem is NULL. 0 otherwise.
+ */
+int prio_sem_setinherit(prio_sem_t sem, int inherit);
+
+/*
+ * prio_sem_setprio - Set the priority of the current thread
+ * @prio: Priority between 0 and PRIO_SEM_LEVELS - 1
+ *
+ * Return: -1 if @prio is out of range. 0 if the priority was successfully set.
+ */
+int prio_sem_setprio(int prio);
+
+/*
+ * prio_sem_getprio - Get the effective priority of the current thread
+ *
+ * Return: The priority of the current thread, including any priority it
+ * inherited from threads blocked on priority semaphores it holds.
+ */
+int prio_sem_getprio(void);
+
+#endif /* _PRIO_SEM_H */
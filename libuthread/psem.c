@@ -0,0 +1,241 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "psem.h"
+
+// FUTEX HELPERS ---------------------------------------------------------------
+
+// the semaphores are shared between processes, so these must not use
+// FUTEX_PRIVATE_FLAG
+static int futex_wait(uint32_t *addr, uint32_t val,
+                      const struct timespec *deadline)
+{
+  // FUTEX_WAIT_BITSET takes an absolute deadline, unlike FUTEX_WAIT
+  return syscall(SYS_futex, addr, FUTEX_WAIT_BITSET | FUTEX_CLOCK_REALTIME,
+                 val, deadline, NULL, FUTEX_BITSET_MATCH_ANY);
+}
+
+static int futex_wake(uint32_t *addr, int n)
+{
+  return syscall(SYS_futex, addr, FUTEX_WAKE, n, NULL, NULL, 0);
+}
+
+// SEMAPHORE FUNCTIONS ---------------------------------------------------------
+
+int psem_init(psem_t sem, size_t count)
+{
+  if (!sem || count > INT_MAX) {
+    return -1;
+  }
+
+  sem->count = count;
+  sem->waiters = 0;
+  __atomic_store_n(&sem->ready, 1, __ATOMIC_RELEASE);
+
+  return 0;
+}
+
+int psem_fini(psem_t sem)
+{
+  if (!sem) {
+    return -1;
+  }
+
+  // cannot finalize a semaphore while other threads are waiting on it
+  if (__atomic_load_n(&sem->waiters, __ATOMIC_ACQUIRE) > 0) {
+    return -1;
+  }
+
+  return 0;
+}
+
+psem_t psem_open(const char *name, size_t count)
+{
+  if (!name || count > INT_MAX) {
+    return NULL;
+  }
+
+  int created = 1;
+  int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (fd == -1 && errno == EEXIST) {
+    created = 0;
+    fd = shm_open(name, O_RDWR, 0600);
+  }
+  if (fd == -1) {
+    return NULL;
+  }
+
+  if (created) {
+    if (ftruncate(fd, sizeof(struct psem)) == -1) {
+      close(fd);
+      shm_unlink(name);
+      return NULL;
+    }
+  } else {
+    // the creator may not have sized the object yet, and touching the
+    // mapping before it does would raise SIGBUS
+    struct stat st;
+    do {
+      if (fstat(fd, &st) == -1) {
+        close(fd);
+        return NULL;
+      }
+      if (st.st_size < (off_t)sizeof(struct psem)) {
+        sched_yield();
+      }
+    } while (st.st_size < (off_t)sizeof(struct psem));
+  }
+
+  psem_t sem = mmap(NULL, sizeof(struct psem), PROT_READ | PROT_WRITE,
+                    MAP_SHARED, fd, 0);
+  close(fd);
+  if (sem == MAP_FAILED) {
+    if (created) {
+      shm_unlink(name);
+    }
+    return NULL;
+  }
+
+  if (created) {
+    // a new object is zero-filled, so ready is 0 until psem_init sets it
+    psem_init(sem, count);
+    futex_wake(&sem->ready, INT_MAX);
+  } else {
+    while (!__atomic_load_n(&sem->ready, __ATOMIC_ACQUIRE)) {
+      futex_wait(&sem->ready, 0, NULL);
+    }
+  }
+
+  return sem;
+}
+
+int psem_close(psem_t sem)
+{
+  if (!sem) {
+    return -1;
+  }
+
+  return munmap(sem, sizeof(struct psem));
+}
+
+int psem_unlink(const char *name)
+{
+  if (!name) {
+    return -1;
+  }
+
+  return shm_unlink(name);
+}
+
+// take a resource if there is one, without ever blocking
+static int psem_take(psem_t sem)
+{
+  uint32_t count = __atomic_load_n(&sem->count, __ATOMIC_RELAXED);
+
+  while (count > 0) {
+    if (__atomic_compare_exchange_n(&sem->count, &count, count - 1, 1,
+                                    __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+      return 0;
+    }
+  }
+
+  return -1;
+}
+
+static int psem_wait(psem_t sem, const struct timespec *deadline)
+{
+  if (psem_take(sem) == 0) {
+    return 0;
+  }
+
+  // announce ourselves before checking the count one last time: psem_up
+  // increments the count before checking for waiters, so that either we see
+  // its resource or it sees us and wakes us up
+  __atomic_fetch_add(&sem->waiters, 1, __ATOMIC_SEQ_CST);
+
+  while (psem_take(sem) == -1) {
+    // sleeps only if the count is still 0
+    if (futex_wait(&sem->count, 0, deadline) == -1 && errno == ETIMEDOUT) {
+      __atomic_fetch_sub(&sem->waiters, 1, __ATOMIC_RELEASE);
+      errno = ETIMEDOUT;
+      return -1;
+    }
+  }
+
+  __atomic_fetch_sub(&sem->waiters, 1, __ATOMIC_RELEASE);
+  return 0;
+}
+
+int psem_down(psem_t sem)
+{
+  if (!sem) {
+    return -1;
+  }
+
+  return psem_wait(sem, NULL);
+}
+
+int psem_trydown(psem_t sem)
+{
+  if (!sem) {
+    return -1;
+  }
+
+  if (psem_take(sem) == -1) {
+    errno = EAGAIN;
+    return -1;
+  }
+
+  return 0;
+}
+
+int psem_timeddown(psem_t sem, const struct timespec *deadline)
+{
+  if (!sem || !deadline) {
+    return -1;
+  }
+
+  return psem_wait(sem, deadline);
+}
+
+int psem_up(psem_t sem)
+{
+  if (!sem) {
+    return -1;
+  }
+
+  uint32_t count = __atomic_load_n(&sem->count, __ATOMIC_RELAXED);
+  do {
+    if (count == INT_MAX) {
+      return -1;
+    }
+  } while (!__atomic_compare_exchange_n(&sem->count, &count, count + 1, 1,
+                                        __ATOMIC_SEQ_CST, __ATOMIC_RELAXED));
+
+  // no system call at all unless someone is blocked
+  if (__atomic_load_n(&sem->waiters, __ATOMIC_SEQ_CST) > 0) {
+    futex_wake(&sem->count, 1);
+  }
+
+  return 0;
+}
+
+int psem_getvalue(psem_t sem, int *sval)
+{
+  if (!sem || !sval) {
+    return -1;
+  }
+
+  *sval = __atomic_load_n(&sem->count, __ATOMIC_RELAXED);
+  return 0;
+}
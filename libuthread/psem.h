@@ -0,0 +1,141 @@
+#ifndef _PSEM_H
+#define _PSEM_H
+
+#include <stdint.h>
+#include <time.h>
+
+/*
+ * struct psem - Process-shared semaphore
+ *
+ * A process-shared semaphore can be placed in memory shared between several
+ * processes, such as a MAP_SHARED mapping or a shm_open() object, and used by
+ * threads of all of them. Unlike regular semaphores, it contains no pointers
+ * nor thread identifiers: blocked threads sleep in the kernel on the address
+ * of the count itself (a futex), so the semaphore works wherever the region
+ * is mapped in each process.
+ *
+ * Since waiting is done by the kernel, there is no FIFO ordering between
+ * waiters.
+ */
+struct psem {
+  uint32_t count;
+  uint32_t waiters;
+
+  // set once a semaphore created by psem_open() is initialized
+  uint32_t ready;
+};
+
+typedef struct psem *psem_t;
+
+/*
+ * psem_init - Initialize process-shared semaphore in place
+ * @sem: Semaphore to initialize, usually in shared memory
+ * @count: Semaphore count
+ *
+ * Initialize semaphore @sem with internal count @count. Only one process
+ * should initialize a given semaphore, before the others start using it.
+ *
+ * Return: -1 if @sem is NULL or if @count is too large. 0 if @sem was
+ * successfully initialized.
+ */
+int psem_init(psem_t sem, size_t count);
+
+/*
+ * psem_fini - Finalize process-shared semaphore in place
+ * @sem: Semaphore to finalize
+ *
+ * Return: -1 if @sem is NULL or if threads are still being blocked on @sem. 0
+ * if @sem was successfully finalized.
+ */
+int psem_fini(psem_t sem);
+
+/*
+ * psem_open - Open named process-shared semaphore
+ * @name: Name of the shared memory object holding the semaphore, as given to
+ * shm_open()
+ * @count: Semaphore count, if the semaphore gets created
+ *
+ * Map the shared memory object @name, creating and initializing a semaphore
+ * of count @count in it if it doesn't exist yet. Processes opening an existing
+ * semaphore wait until its creator has finished initializing it.
+ *
+ * Return: Pointer to the mapped semaphore. NULL in case of failure when
+ * creating or mapping the shared memory object.
+ */
+psem_t psem_open(const char *name, size_t count);
+
+/*
+ * psem_close - Unmap named process-shared semaphore
+ * @sem: Semaphore returned by psem_open()
+ *
+ * Return: -1 if @sem is NULL or cannot be unmapped. 0 if @sem was
+ * successfully unmapped.
+ */
+int psem_close(psem_t sem);
+
+/*
+ * psem_unlink - Remove named process-shared semaphore
+ * @name: Name given to psem_open()
+ *
+ * Remove the shared memory object @name. Processes which already mapped it can
+ * keep using the semaphore until they close it.
+ *
+ * Return: -1 if @name is NULL or cannot be removed. 0 if @name was
+ * successfully removed.
+ */
+int psem_unlink(const char *name);
+
+/*
+ * psem_down - Take a process-shared semaphore
+ * @sem: Semaphore to take
+ *
+ * Take a resource from semaphore @sem, blocking the caller thread until a
+ * resource becomes available.
+ *
+ * Return: -1 if @sem is NULL. 0 if semaphore was successfully taken.
+ */
+int psem_down(psem_t sem);
+
+/*
+ * psem_trydown - Take a process-shared semaphore without blocking
+ * @sem: Semaphore to take
+ *
+ * Return: -1 if @sem is NULL, or if no resource is available (errno is then
+ * set to EAGAIN). 0 if semaphore was successfully taken.
+ */
+int psem_trydown(psem_t sem);
+
+/*
+ * psem_timeddown - Take a process-shared semaphore with a deadline
+ * @sem: Semaphore to take
+ * @deadline: Absolute time (CLOCK_REALTIME) after which to give up waiting
+ *
+ * Return: -1 if @sem or @deadline are NULL, or if @deadline passed before a
+ * resource became available (errno is then set to ETIMEDOUT). 0 if semaphore
+ * was successfully taken.
+ */
+int psem_timeddown(psem_t sem, const struct timespec *deadline);
+
+/*
+ * psem_up - Release a process-shared semaphore
+ * @sem: Semaphore to release
+ *
+ * Release a resource to semaphore @sem. If threads, from any process, are
+ * blocked on @sem, one of them is woken up.
+ *
+ * Return: -1 if @sem is NULL or if its count would overflow. 0 if semaphore
+ * was successfully released.
+ */
+int psem_up(psem_t sem);
+
+/*
+ * psem_getvalue - Inspect process-shared semaphore's count
+ * @sem: Semaphore to inspect
+ * @sval: Integer whose value is set to the count of @sem
+ *
+ * Return: -1 if @sem or @sval are NULL. 0 if semaphore was successfully
+ * inspected.
+ */
+int psem_getvalue(psem_t sem, int *sval);
+
+#endif /* _PSEM_H */
@@ -0,0 +1,275 @@
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "queue.h"
+
+// number of items per chunk, so that a chunk fills exactly 256 bytes (four
+// cache lines)
+#define QUEUE_CHUNK_ITEMS 28
+#define QUEUE_CHUNK_SIZE 256
+
+// number of empty chunks a queue keeps around instead of freeing them
+#define QUEUE_SPARE_MAX 2
+
+// a chunk holds a slice of the queue's items, in order. Deleted items leave a
+// NULL hole in their slot (enqueued items can never be NULL), so that items
+// never move once enqueued. A chunk stays linked in the queue as long as it
+// holds at least one item
+struct chunk {
+  struct chunk *prev;
+  struct chunk *next;
+
+  // slots in use are [begin, end), of which live are not holes
+  int begin;
+  int end;
+  int live;
+
+  void *items[QUEUE_CHUNK_ITEMS];
+};
+
+// chunks are aligned on their size, so that the chunk holding a slot is found
+// by masking the slot's address. A queue handle is the address of the slot
+_Static_assert(sizeof(struct chunk) == QUEUE_CHUNK_SIZE,
+               "struct chunk must fill QUEUE_CHUNK_SIZE bytes");
+
+#define SLOT_CHUNK(slot) \
+  ((struct chunk*)((uintptr_t)(slot) & ~(uintptr_t)(QUEUE_CHUNK_SIZE - 1)))
+
+struct queue {
+  struct chunk *head;
+  struct chunk *tail;
+  int length;
+
+  // recycled chunks, linked through their next pointer
+  struct chunk *spare;
+  int nspare;
+};
+
+// CHUNK MANAGEMENT ------------------------------------------------------------
+
+static struct chunk *chunk_get(queue_t queue)
+{
+  struct chunk *chunk = queue->spare;
+
+  if (chunk) {
+    queue->spare = chunk->next;
+    queue->nspare--;
+  } else {
+    chunk = aligned_alloc(QUEUE_CHUNK_SIZE, sizeof(struct chunk));
+    if (!chunk) {
+      return NULL;
+    }
+  }
+
+  chunk->prev = NULL;
+  chunk->next = NULL;
+  chunk->begin = 0;
+  chunk->end = 0;
+  chunk->live = 0;
+  return chunk;
+}
+
+// unlink a chunk which no longer holds any item, and recycle it
+static void chunk_release(queue_t queue, struct chunk *chunk)
+{
+  // keep the last chunk linked, so that a queue which keeps going from empty
+  // to one item and back never touches its chunks
+  if (queue->head == chunk && queue->tail == chunk) {
+    chunk->begin = 0;
+    chunk->end = 0;
+    return;
+  }
+
+  if (chunk->prev) {
+    chunk->prev->next = chunk->next;
+  } else {
+    queue->head = chunk->next;
+  }
+  if (chunk->next) {
+    chunk->next->prev = chunk->prev;
+  } else {
+    queue->tail = chunk->prev;
+  }
+
+  if (queue->nspare < QUEUE_SPARE_MAX) {
+    chunk->next = queue->spare;
+    queue->spare = chunk;
+    queue->nspare++;
+  } else {
+    free(chunk);
+  }
+}
+
+// remove the item in slot i of chunk
+static void chunk_remove(queue_t queue, struct chunk *chunk, int i)
+{
+  chunk->items[i] = NULL;
+  chunk->live--;
+  queue->length--;
+
+  if (chunk->live == 0) {
+    chunk_release(queue, chunk);
+    return;
+  }
+
+  // shrink the slots in use past any hole at either end
+  while (!chunk->items[chunk->begin]) {
+    chunk->begin++;
+  }
+  while (!chunk->items[chunk->end - 1]) {
+    chunk->end--;
+  }
+}
+
+// QUEUE FUNCTIONS -------------------------------------------------------------
+
+queue_t queue_create(void)
+{
+  return calloc(1, sizeof(struct queue));
+}
+
+int queue_destroy(queue_t queue)
+{
+  if (!queue || queue->length != 0) {
+    return -1;
+  }
+
+  // an empty queue has at most one chunk left linked
+  free(queue->head);
+  while (queue->spare) {
+    struct chunk *next = queue->spare->next;
+    free(queue->spare);
+    queue->spare = next;
+  }
+
+  free(queue);
+  return 0;
+}
+
+int queue_enqueue(queue_t queue, void *data)
+{
+  return queue_enqueue_handle(queue, data, NULL);
+}
+
+int queue_enqueue_handle(queue_t queue, void *data, queue_handle_t *handle)
+{
+  if (!queue || !data) {
+    return -1;
+  }
+
+  struct chunk *tail = queue->tail;
+  if (!tail || tail->end == QUEUE_CHUNK_ITEMS) {
+    struct chunk *chunk = chunk_get(queue);
+    if (!chunk) {
+      return -1;
+    }
+
+    chunk->prev = tail;
+    if (tail) {
+      tail->next = chunk;
+    } else {
+      queue->head = chunk;
+    }
+    queue->tail = chunk;
+    tail = chunk;
+  }
+
+  if (handle) {
+    *handle = (queue_handle_t)&tail->items[tail->end];
+  }
+
+  tail->items[tail->end++] = data;
+  tail->live++;
+  queue->length++;
+  return 0;
+}
+
+int queue_dequeue(queue_t queue, void **data)
+{
+  if (!queue || !data || queue->length == 0) {
+    return -1;
+  }
+
+  // the head chunk's first slot in use always holds the oldest item
+  struct chunk *head = queue->head;
+  *data = head->items[head->begin];
+  chunk_remove(queue, head, head->begin);
+  return 0;
+}
+
+int queue_delete(queue_t queue, void *data)
+{
+  if (!queue || !data) {
+    return -1;
+  }
+
+  struct chunk *chunk;
+  int i;
+  for (chunk = queue->head; chunk; chunk = chunk->next) {
+    for (i = chunk->begin; i < chunk->end; i++) {
+      if (chunk->items[i] == data) {
+        chunk_remove(queue, chunk, i);
+        return 0;
+      }
+    }
+  }
+
+  return -1;
+}
+
+int queue_remove_handle(queue_t queue, queue_handle_t handle)
+{
+  if (!queue || !handle) {
+    return -1;
+  }
+
+  void **slot = (void**)handle;
+  struct chunk *chunk = SLOT_CHUNK(slot);
+
+  // a handle whose item was removed is undefined behavior, but the common case
+  // of a chunk still holding other items is cheap to catch
+  if (!*slot) {
+    return -1;
+  }
+
+  chunk_remove(queue, chunk, slot - chunk->items);
+  return 0;
+}
+
+int queue_iterate(queue_t queue, queue_func_t func, void *arg, void **data)
+{
+  if (!queue || !func) {
+    return -1;
+  }
+
+  // func may delete other items, which can release the chunk after the
+  // current one but never the current one
+  struct chunk *chunk;
+  int i;
+  for (chunk = queue->head; chunk; chunk = chunk->next) {
+    for (i = chunk->begin; i < chunk->end; i++) {
+      void *item = chunk->items[i];
+      if (!item) {
+        continue;
+      }
+
+      if (func(item, arg) == 1) {
+        if (data) {
+          *data = item;
+        }
+        return 0;
+      }
+    }
+  }
+
+  return 0;
+}
+
+int queue_length(queue_t queue)
+{
+  if (!queue) {
+    return -1;
+  }
+
+  return queue->length;
+}
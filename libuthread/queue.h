@@ -45,6 +45,45 @@ int queue_destroy(queue_t queue);
  */
 int queue_enqueue(queue_t queue, void *data);
 
+/*
+ * queue_handle_t - Queue item handle
+ *
+ * A handle identifies one enqueued item, so that it can be removed without
+ * searching the queue. It remains valid until the item leaves the queue, and
+ * must not be used anymore after that.
+ */
+typedef struct queue_handle* queue_handle_t;
+
+/*
+ * queue_enqueue_handle - Enqueue data item and get its handle
+ * @queue: Queue in which to enqueue item
+ * @data: Address of data item to enqueue
+ * @handle: (Optional) Address of handle where the item's handle is received
+ *
+ * Enqueue the address contained in @data in the queue @queue, like
+ * queue_enqueue(), and if @handle is different than NULL, set @handle with a
+ * handle to the enqueued item.
+ *
+ * Return: -1 if @queue or @data are NULL, or in case of memory allocation error
+ * when enqueing. 0 if @data was successfully enqueued in @queue.
+ */
+int queue_enqueue_handle(queue_t queue, void *data, queue_handle_t *handle);
+
+/*
+ * queue_remove_handle - Remove data item by handle
+ * @queue: Queue in which to remove item
+ * @handle: Handle of item to remove, received from queue_enqueue_handle()
+ *
+ * Remove the item identified by @handle from queue @queue in O(1). Using a
+ * handle whose item already left the queue, be it dequeued, deleted or removed,
+ * results in undefined behavior: the memory it refers to may have been freed,
+ * or reused for another item.
+ *
+ * Return: -1 if @queue or @handle are NULL. 0 if the item was removed from
+ * @queue.
+ */
+int queue_remove_handle(queue_t queue, queue_handle_t handle);
+
 /*
  * queue_dequeue - Dequeue data item
  * @queue: Queue in which to dequeue item
@@ -0,0 +1,313 @@
+#ifndef _QUEUE_HPP
+#define _QUEUE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace uthread {
+
+/*
+ * queue<T> - Type-specialized queue
+ *
+ * Header-only C++ counterpart of queue_t (see queue.h), with the same FIFO
+ * semantics and the same chunked layout, but storing items of type T inline
+ * instead of as void pointers. Callbacks given to iterate() are templates, so
+ * that a lambda gets inlined in the loop instead of being called through a
+ * function pointer.
+ *
+ * As with queue_t, items never move once enqueued: removing an item leaves a
+ * hole in its chunk, and a chunk is recycled once it holds no more items.
+ * Unlike queue_destroy(), destroying a non-empty queue<T> destroys the items
+ * it still holds.
+ */
+template <typename T>
+class queue {
+  // as many items as fit in 256 bytes of storage, between 4 and 64 so that
+  // the slots in use fit in a 64-bit mask
+  static constexpr int chunk_items =
+      256 / sizeof(T) < 4 ? 4 : 256 / sizeof(T) > 64 ? 64 : 256 / sizeof(T);
+
+  // number of empty chunks kept around instead of freeing them
+  static constexpr int spare_max = 2;
+
+  struct chunk {
+    chunk *prev;
+    chunk *next;
+
+    // slots in use are [begin, end), live has a bit set for each slot which
+    // holds an item
+    int begin;
+    int end;
+    uint64_t live;
+
+    alignas(T) unsigned char storage[chunk_items * sizeof(T)];
+
+    T *item(int i) { return reinterpret_cast<T*>(storage) + i; }
+  };
+
+ public:
+  /*
+   * handle - Queue item handle
+   *
+   * A handle identifies one enqueued item, so that it can be removed without
+   * searching the queue. It remains valid until the item leaves the queue, and
+   * must not be used anymore after that.
+   */
+  struct handle {
+    chunk *c;
+    int i;
+  };
+
+  queue() = default;
+  queue(const queue&) = delete;
+  queue &operator=(const queue&) = delete;
+
+  ~queue()
+  {
+    T *item;
+    while (length_ > 0) {
+      chunk *c = head_;
+      item = c->item(c->begin);
+      item->~T();
+      remove_slot(c, c->begin);
+    }
+
+    delete head_;
+    while (spare_) {
+      chunk *next = spare_->next;
+      delete spare_;
+      spare_ = next;
+    }
+  }
+
+  /*
+   * enqueue - Enqueue item
+   * @item: Item to enqueue, copied or moved into the queue
+   * @h: (Optional) Address of handle where the item's handle is received
+   *
+   * Return: -1 in case of memory allocation error when enqueueing. 0 if @item
+   * was successfully enqueued.
+   */
+  template <typename U>
+  int enqueue(U &&item, handle *h = nullptr)
+  {
+    chunk *tail = tail_;
+    if (!tail || tail->end == chunk_items) {
+      chunk *c = get_chunk();
+      if (!c) {
+        return -1;
+      }
+
+      c->prev = tail;
+      if (tail) {
+        tail->next = c;
+      } else {
+        head_ = c;
+      }
+      tail_ = c;
+      tail = c;
+    }
+
+    int i = tail->end;
+    new (tail->item(i)) T(std::forward<U>(item));
+    if (h) {
+      *h = handle{tail, i};
+    }
+
+    tail->live |= uint64_t(1) << i;
+    tail->end++;
+    length_++;
+    return 0;
+  }
+
+  /*
+   * dequeue - Dequeue item
+   * @item: Where the oldest item is moved to
+   *
+   * Return: -1 if the queue is empty. 0 if @item was set with the oldest item.
+   */
+  int dequeue(T &item)
+  {
+    if (length_ == 0) {
+      return -1;
+    }
+
+    // the head chunk's first slot in use always holds the oldest item
+    chunk *c = head_;
+    T *oldest = c->item(c->begin);
+    item = std::move(*oldest);
+    oldest->~T();
+    remove_slot(c, c->begin);
+    return 0;
+  }
+
+  /*
+   * erase - Delete item
+   * @item: Item to delete
+   *
+   * Find the first (ie oldest) item equal to @item and delete it.
+   *
+   * Return: -1 if @item was not found. 0 if @item was found and deleted.
+   */
+  int erase(const T &item)
+  {
+    handle h;
+    if (find([&item](const T &current) { return current == item; }, &h)
+        == nullptr) {
+      return -1;
+    }
+
+    return remove(h);
+  }
+
+  /*
+   * remove - Remove item by handle
+   * @h: Handle of item to remove, received from enqueue()
+   *
+   * Using a handle whose item already left the queue results in undefined
+   * behavior: its chunk may have been freed, or its slot reused for another
+   * item, which would then be removed instead.
+   *
+   * Return: 0 once the item is removed, or -1 when a stale handle happens to
+   * be caught.
+   */
+  int remove(handle h)
+  {
+    // a stale handle is undefined behavior, but the common case of a chunk
+    // still holding other items is cheap to catch
+    if (!(h.c->live & (uint64_t(1) << h.i))) {
+      return -1;
+    }
+
+    h.c->item(h.i)->~T();
+    remove_slot(h.c, h.i);
+    return 0;
+  }
+
+  /*
+   * iterate - Iterate through the queue
+   * @func: Callable taking an item by reference, and returning true to stop
+   * iterating at this particular item
+   *
+   * As with queue_iterate(), @func cannot remove the current item.
+   *
+   * Return: Pointer to the item where the iteration was stopped. nullptr if
+   * @func never stopped it.
+   */
+  template <typename F>
+  T *iterate(F &&func)
+  {
+    return find(std::forward<F>(func), nullptr);
+  }
+
+  /*
+   * length - Queue length
+   *
+   * Return: Number of items in the queue.
+   */
+  int length() const { return length_; }
+
+ private:
+  template <typename F>
+  T *find(F &&func, handle *h)
+  {
+    for (chunk *c = head_; c; c = c->next) {
+      for (int i = c->begin; i < c->end; i++) {
+        if (!(c->live & (uint64_t(1) << i))) {
+          continue;
+        }
+
+        T *item = c->item(i);
+        if (func(*item)) {
+          if (h) {
+            *h = handle{c, i};
+          }
+          return item;
+        }
+      }
+    }
+
+    return nullptr;
+  }
+
+  chunk *get_chunk()
+  {
+    chunk *c = spare_;
+    if (c) {
+      spare_ = c->next;
+      nspare_--;
+    } else {
+      c = new (std::nothrow) chunk;
+      if (!c) {
+        return nullptr;
+      }
+    }
+
+    c->prev = nullptr;
+    c->next = nullptr;
+    c->begin = 0;
+    c->end = 0;
+    c->live = 0;
+    return c;
+  }
+
+  // unlink a chunk which no longer holds any item, and recycle it
+  void release_chunk(chunk *c)
+  {
+    // keep the last chunk linked
+    if (head_ == c && tail_ == c) {
+      c->begin = 0;
+      c->end = 0;
+      return;
+    }
+
+    if (c->prev) {
+      c->prev->next = c->next;
+    } else {
+      head_ = c->next;
+    }
+    if (c->next) {
+      c->next->prev = c->prev;
+    } else {
+      tail_ = c->prev;
+    }
+
+    if (nspare_ < spare_max) {
+      c->next = spare_;
+      spare_ = c;
+      nspare_++;
+    } else {
+      delete c;
+    }
+  }
+
+  // mark slot i of c as a hole, the item having already been destroyed
+  void remove_slot(chunk *c, int i)
+  {
+    c->live &= ~(uint64_t(1) << i);
+    length_--;
+
+    if (!c->live) {
+      release_chunk(c);
+      return;
+    }
+
+    // shrink the slots in use to the first and last items left
+    c->begin = __builtin_ctzll(c->live);
+    c->end = 64 - __builtin_clzll(c->live);
+  }
+
+  chunk *head_ = nullptr;
+  chunk *tail_ = nullptr;
+  int length_ = 0;
+
+  chunk *spare_ = nullptr;
+  int nspare_ = 0;
+};
+
+} // namespace uthread
+
+#endif /* _QUEUE_HPP */
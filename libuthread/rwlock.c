@@ -0,0 +1,226 @@
+#include <stdlib.h>
+
+#include "rwlock.h"
+#include "thread.h"
+#include "waitq.h"
+
+// layout of the state word. As long as RWLOCK_WAITERS is set, the lock can
+// only change hands inside the critical section, except for readers leaving
+#define RWLOCK_WRITER  0x40000000u
+#define RWLOCK_WAITERS 0x80000000u
+#define RWLOCK_READERS 0x3fffffffu
+
+// HELPER FUNCTIONS ------------------------------------------------------------
+
+static int rwlock_cas(rwlock_t rwlock, unsigned int *state, unsigned int new)
+{
+  return __atomic_compare_exchange_n(&rwlock->state, state, new, 0,
+                                     __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+}
+
+// hand the lock over to the waiters once it has been released by everybody.
+// Must be called inside the critical section
+static void rwlock_wake(rwlock_t rwlock)
+{
+  struct waiter *waiter;
+
+  // writers first
+  waiter = waitq_pop(&rwlock->writers);
+  if (waiter) {
+    unsigned int state = RWLOCK_WRITER;
+    if (rwlock->writers.length || rwlock->readers.length) {
+      state |= RWLOCK_WAITERS;
+    }
+
+    __atomic_store_n(&rwlock->state, state, __ATOMIC_RELEASE);
+    waiter->granted = 1;
+    thread_unblock(waiter->tid);
+    return;
+  }
+
+  // then all the readers at once
+  __atomic_store_n(&rwlock->state, rwlock->readers.length, __ATOMIC_RELEASE);
+  while ((waiter = waitq_pop(&rwlock->readers))) {
+    waiter->granted = 1;
+    thread_unblock(waiter->tid);
+  }
+}
+
+// block until the lock is handed over to us. Must be called inside the
+// critical section, after setting RWLOCK_WAITERS
+static int rwlock_wait(struct waitq *waitq)
+{
+  struct waiter waiter;
+  waiter.tid = thread_self();
+  waiter.granted = 0;
+  waiter.set = NULL;
+
+  waitq_push(waitq, &waiter);
+  while (!waiter.granted) {
+    if (thread_block() == -1) {
+      waitq_remove(waitq, &waiter);
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+// READER-WRITER LOCK FUNCTIONS ------------------------------------------------
+
+int rwlock_init(rwlock_t rwlock)
+{
+  if (!rwlock) {
+    return -1;
+  }
+
+  rwlock->state = 0;
+  waitq_init(&rwlock->readers);
+  waitq_init(&rwlock->writers);
+  return 0;
+}
+
+int rwlock_fini(rwlock_t rwlock)
+{
+  if (!rwlock) {
+    return -1;
+  }
+
+  if (__atomic_load_n(&rwlock->state, __ATOMIC_ACQUIRE) != 0) {
+    return -1;
+  }
+
+  return 0;
+}
+
+rwlock_t rwlock_create(void)
+{
+  struct rwlock *rwlock = malloc(sizeof(struct rwlock));
+  if (!rwlock) {
+    return NULL;
+  }
+
+  rwlock_init(rwlock);
+  return rwlock;
+}
+
+int rwlock_destroy(rwlock_t rwlock)
+{
+  if (rwlock_fini(rwlock) == -1) {
+    return -1;
+  }
+
+  free(rwlock);
+  return 0;
+}
+
+int rwlock_rdlock(rwlock_t rwlock)
+{
+  if (!rwlock) {
+    return -1;
+  }
+
+  // fast path: no writer holds the lock or is waiting for it
+  unsigned int state = __atomic_load_n(&rwlock->state, __ATOMIC_RELAXED);
+  while (!(state & (RWLOCK_WRITER | RWLOCK_WAITERS))) {
+    if (rwlock_cas(rwlock, &state, state + 1)) {
+      return 0;
+    }
+  }
+
+  enter_critical_section();
+  state = __atomic_load_n(&rwlock->state, __ATOMIC_RELAXED);
+  while (1) {
+    // we can still join the current readers if no writer is waiting
+    if (!(state & RWLOCK_WRITER) && rwlock->writers.length == 0) {
+      if (rwlock_cas(rwlock, &state, state + 1)) {
+        exit_critical_section();
+        return 0;
+      }
+      continue;
+    }
+
+    // flag ourselves, which forces the holders to go through the critical
+    // section when they release the lock
+    if (rwlock_cas(rwlock, &state, state | RWLOCK_WAITERS)) {
+      break;
+    }
+  }
+
+  int ret = rwlock_wait(&rwlock->readers);
+  exit_critical_section();
+  return ret;
+}
+
+int rwlock_wrlock(rwlock_t rwlock)
+{
+  if (!rwlock) {
+    return -1;
+  }
+
+  // fast path: the lock is free
+  unsigned int state = 0;
+  if (rwlock_cas(rwlock, &state, RWLOCK_WRITER)) {
+    return 0;
+  }
+
+  enter_critical_section();
+  state = __atomic_load_n(&rwlock->state, __ATOMIC_RELAXED);
+  while (1) {
+    // nobody holds the lock
+    if (!(state & (RWLOCK_WRITER | RWLOCK_READERS))) {
+      if (rwlock_cas(rwlock, &state, state | RWLOCK_WRITER)) {
+        exit_critical_section();
+        return 0;
+      }
+      continue;
+    }
+
+    if (rwlock_cas(rwlock, &state, state | RWLOCK_WAITERS)) {
+      break;
+    }
+  }
+
+  int ret = rwlock_wait(&rwlock->writers);
+  exit_critical_section();
+  return ret;
+}
+
+int rwlock_unlock(rwlock_t rwlock)
+{
+  if (!rwlock) {
+    return -1;
+  }
+
+  unsigned int state = __atomic_load_n(&rwlock->state, __ATOMIC_RELAXED);
+
+  if (state & RWLOCK_WRITER) {
+    // fast path: nobody is waiting
+    state = RWLOCK_WRITER;
+    if (rwlock_cas(rwlock, &state, 0)) {
+      return 0;
+    }
+
+    enter_critical_section();
+    rwlock_wake(rwlock);
+    exit_critical_section();
+    return 0;
+  }
+
+  if (!(state & RWLOCK_READERS)) {
+    return -1;
+  }
+
+  // last reader out with threads waiting: hand the lock over, unless a writer
+  // took it in the critical section before we could get there
+  state = __atomic_sub_fetch(&rwlock->state, 1, __ATOMIC_RELEASE);
+  if (state == RWLOCK_WAITERS) {
+    enter_critical_section();
+    if (__atomic_load_n(&rwlock->state, __ATOMIC_RELAXED) == RWLOCK_WAITERS) {
+      rwlock_wake(rwlock);
+    }
+    exit_critical_section();
+  }
+
+  return 0;
+}
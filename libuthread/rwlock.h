@@ -0,0 +1,93 @@
+#ifndef _RWLOCK_H
+#define _RWLOCK_H
+
+#include "waitq.h"
+
+/*
+ * rwlock_t - Reader-writer lock type
+ *
+ * A reader-writer lock can either be held by any number of readers at once, or
+ * by a single writer. Writers have precedence: as soon as a writer is waiting,
+ * new readers wait as well. When a writer releases the lock and no other
+ * writer is waiting, all the waiting readers are let in at once.
+ *
+ * Taking and releasing the lock only takes a single atomic operation as long
+ * as nobody has to wait, which makes it well suited to read-mostly data.
+ */
+typedef struct rwlock *rwlock_t;
+
+/*
+ * struct rwlock - Reader-writer lock object
+ *
+ * The definition is only exposed so that locks can be embedded in other
+ * structures and initialized with rwlock_init(). Its fields must only be
+ * accessed through the functions below.
+ */
+struct rwlock {
+  unsigned int state; // number of readers, writer and waiters flags
+  struct waitq readers;
+  struct waitq writers;
+};
+
+/*
+ * rwlock_init - Initialize a reader-writer lock in place
+ * @rwlock: Address of the lock object to initialize
+ *
+ * Return: -1 if @rwlock is NULL. 0 if @rwlock was successfully initialized.
+ */
+int rwlock_init(rwlock_t rwlock);
+
+/*
+ * rwlock_fini - Finalize a reader-writer lock initialized in place
+ * @rwlock: Lock to finalize
+ *
+ * Return: -1 if @rwlock is NULL, or if @rwlock is held. 0 if @rwlock was
+ * successfully finalized.
+ */
+int rwlock_fini(rwlock_t rwlock);
+
+/*
+ * rwlock_create - Create a reader-writer lock
+ *
+ * Return: Pointer to new lock. NULL in case of failure when allocating the new
+ * lock.
+ */
+rwlock_t rwlock_create(void);
+
+/*
+ * rwlock_destroy - Deallocate a reader-writer lock
+ * @rwlock: Lock to deallocate
+ *
+ * Return: -1 if @rwlock is NULL, or if @rwlock is held. 0 if @rwlock was
+ * successfully destroyed.
+ */
+int rwlock_destroy(rwlock_t rwlock);
+
+/*
+ * rwlock_rdlock - Take a reader-writer lock for reading
+ * @rwlock: Lock to take
+ *
+ * Return: -1 if @rwlock is NULL. 0 if @rwlock was successfully taken.
+ */
+int rwlock_rdlock(rwlock_t rwlock);
+
+/*
+ * rwlock_wrlock - Take a reader-writer lock for writing
+ * @rwlock: Lock to take
+ *
+ * Return: -1 if @rwlock is NULL. 0 if @rwlock was successfully taken.
+ */
+int rwlock_wrlock(rwlock_t rwlock);
+
+/*
+ * rwlock_unlock - Release a reader-writer lock
+ * @rwlock: Lock to release
+ *
+ * Release @rwlock, taken either for reading or for writing by the caller.
+ *
+ * Return: -1 if @rwlock is NULL, or if @rwlock is not held. 0 if @rwlock was
+ * successfully released.
+ */
+int rwlock_unlock(rwlock_t rwlock);
+
+#endif /* _RWLOCK_H */
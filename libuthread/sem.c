@@ -1,17 +1,108 @@
+#include <errno.h>
 #include <stddef.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <time.h>
 
-#include "queue.h"
 #include "sem.h"
 #include "thread.h"
+#include "timer.h"
+#include "trace.h"
+#include "waitq.h"
 
+// sets of up to this many semaphores don't need any memory allocation
+#define SEM_SET_INLINE 8
 
-struct semaphore {
-  int count;
-  queue_t waiting;
+// maximum length of a semaphore name, including the terminating null byte
+#define SEM_NAME_MAX 32
+
+// contention profile of a semaphore. It is only allocated when the semaphore
+// gets a name, which opts it into wait time measurements and sem_report
+struct sem_profile {
+  char name[SEM_NAME_MAX];
+  unsigned long long wait_total_ns;
+  unsigned long long wait_max_ns;
+  unsigned long wait_hist[SEM_STATS_BUCKETS];
 };
 
+// all the named semaphores, so that they can be reported on. Protected by the
+// critical section
+static struct semaphore *registry = NULL;
+
+// a thread waiting on a set of semaphores at once, with one entry in the
+// waiting list of each of them. It either waits for all of them to be available
+// (sem_down_all), or for any one of them (sem_wait_any)
+struct waitset {
+  pthread_t tid;
+  sem_t *sems;
+  size_t n;
+  struct waiter *links;
+  int any;
+  size_t index; // semaphore that was taken, when waiting for any of them
+  int granted;
+};
+
+
+int sem_init(sem_t sem, size_t count)
+{
+  if (!sem) {
+    return -1;
+  }
+
+  //initializes the (empty) list of waiting threads
+  waitq_init(&sem->waiting);
+  sem->count = count;
+  sem->mode = SEM_MODE_BARGING;
+  sem->acquires = 0;
+  sem->wakeups = 0;
+  sem->contended = 0;
+  sem->peak_waiting = 0;
+  sem->profile = NULL;
+  sem->registry_prev = NULL;
+  sem->registry_next = NULL;
+
+  return 0;
+}
+
+int sem_fini(sem_t sem)
+{
+  if (!sem) {
+    return -1;
+  }
+
+  enter_critical_section();
+
+  // cannot finalize a semaphore while other threads are waiting on it
+  if (sem->waiting.length > 0) {
+    exit_critical_section();
+    return -1;
+  }
+
+  // only named semaphores are registered. A semaphore can be finalized again,
+  // e.g. when a failed chan_destroy is retried, so it is only unlinked the
+  // first time
+  if (sem->profile) {
+    if (sem->registry_prev) {
+      sem->registry_prev->registry_next = sem->registry_next;
+    } else {
+      registry = sem->registry_next;
+    }
+    if (sem->registry_next) {
+      sem->registry_next->registry_prev = sem->registry_prev;
+    }
+  }
+  sem->registry_prev = NULL;
+  sem->registry_next = NULL;
+
+  struct sem_profile *profile = sem->profile;
+  sem->profile = NULL;
+
+  exit_critical_section();
+
+  free(profile);
+  return 0;
+}
 
 sem_t sem_create(size_t count)
 {
@@ -20,85 +111,464 @@ sem_t sem_create(size_t count)
   if (!sem) {
     return NULL;
   }
-  //creates queue of waiting threads
-  sem->waiting = queue_create();
-  sem->count = count;
 
+  sem_init(sem, count);
   return sem;
 }
 
 int sem_destroy(sem_t sem)
 {
-  if (!sem) {
+  if (sem_fini(sem) == -1) {
     return -1;
   }
 
-  // cannot delete a semaphore while other threads are waiting on it
-  int threads_waiting = queue_length(sem->waiting);
-  if (threads_waiting > 0) {
-    return -1;
-  }
-
-  queue_destroy(sem->waiting);
   free(sem);
   return 0;
 }
 
-int sem_down(sem_t sem)
+// PROFILING -------------------------------------------------------------------
+
+// add a waiter to the waiting list, keeping track of its peak length
+static void sem_push_waiter(sem_t sem, struct waiter *waiter)
 {
-  if (!sem){
-    return -1;
+  waitq_push(&sem->waiting, waiter);
+  if (sem->waiting.length > sem->peak_waiting) {
+    sem->peak_waiting = sem->waiting.length;
   }
+}
+
+// account for a thread which had to block since @start before taking sem.
+// Wait times are only measured for named semaphores, @start is NULL if sem
+// wasn't named yet when the thread blocked. Must be called inside the critical
+// section
+static void sem_account_wait(sem_t sem, const struct timespec *start)
+{
+  struct sem_profile *profile = sem->profile;
+  struct timespec now;
+  unsigned long long ns;
+
+  sem->contended++;
+  if (!profile || !start) {
+    return;
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  ns = (now.tv_sec - start->tv_sec) * 1000000000ULL + now.tv_nsec -
+    start->tv_nsec;
+
+  profile->wait_total_ns += ns;
+  if (ns > profile->wait_max_ns) {
+    profile->wait_max_ns = ns;
+  }
+
+  // bucket i counts the waits between 2^i and 2^(i+1) nanoseconds
+  int bucket = ns ? 63 - __builtin_clzll(ns) : 0;
+  if (bucket >= SEM_STATS_BUCKETS) {
+    bucket = SEM_STATS_BUCKETS - 1;
+  }
+  profile->wait_hist[bucket]++;
+}
+
+// SEMAPHORE FUNCTIONS ---------------------------------------------------------
+
+// a waiter which may give up waiting once its deadline has passed
+struct sem_timed_waiter {
+  struct waiter waiter;
+  struct timer timer;
+  sem_t sem;
+  int timedout;
+};
+
+// called by the timer thread, inside the critical section, when a timed waiter
+// reaches its deadline. Only this waiter is removed and woken up; if it was
+// already handed the resource, it will simply take it
+static void sem_timeout(struct timer *timer)
+{
+  struct sem_timed_waiter *tw = (struct sem_timed_waiter*)
+    ((char*)timer - offsetof(struct sem_timed_waiter, timer));
+
+  tw->timedout = 1;
+  if (waitq_contains(&tw->sem->waiting, &tw->waiter)) {
+    waitq_remove(&tw->sem->waiting, &tw->waiter);
+    thread_unblock(tw->waiter.tid);
+  }
+}
+
+// take a resource, blocking at most until @deadline if it is not NULL
+static int sem_wait(sem_t sem, const struct timespec *deadline)
+{
+  //our entry in the waiting list lives on our own stack while we are blocked
+  struct sem_timed_waiter tw;
+  tw.waiter.tid = thread_self();
+  tw.waiter.set = NULL;
+  tw.sem = sem;
+  tw.timedout = 0;
+  if (deadline) {
+    timer_init(&tw.timer, deadline, sem_timeout);
+  }
+
+  //time at which we first had to block, for profiling
+  struct timespec start, *startp = NULL;
+  int blocked = 0;
 
   //enter the critical section and check if we can take a resource
   //if it fails for whatever reason, we exit the CS and return -1
   enter_critical_section();
   while(sem->count == 0){
-    //and then add the blocked thread to the waiting threads
-    if (queue_enqueue(sem->waiting, (void*) pthread_self()) == -1){
-      exit_critical_section();
-      return -1;
+    if (deadline) {
+      struct timespec now;
+      clock_gettime(CLOCK_REALTIME, &now);
+      if (tw.timedout || timespec_cmp(deadline, &now) <= 0) {
+        timer_cancel(&tw.timer);
+        if (blocked) {
+          TRACE(TRACE_SEM_WAKE, sem, -1);
+        }
+        exit_critical_section();
+        errno = ETIMEDOUT;
+        return -1;
+      }
+
+      //the timer is armed once and stays armed across barging wakeups
+      if (tw.timer.index == -1 && timer_add(&tw.timer) == -1) {
+        exit_critical_section();
+        return -1;
+      }
     }
 
-    //attempt to enqueue first, then block
+    tw.waiter.granted = 0;
+    if (!blocked) {
+      if (sem->profile) {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        startp = &start;
+      }
+      blocked = 1;
+      TRACE(TRACE_SEM_BLOCK, sem, 0);
+    }
+
+    //add the blocked thread to the waiting threads first, then block
+    sem_push_waiter(sem, &tw.waiter);
+
     if (thread_block() == -1){
+      if (waitq_contains(&sem->waiting, &tw.waiter)) {
+        waitq_remove(&sem->waiting, &tw.waiter);
+      }
+      if (deadline) {
+        timer_cancel(&tw.timer);
+      }
+      TRACE(TRACE_SEM_WAKE, sem, -1);
       exit_critical_section();
       return -1;
     }
+
+    //in handoff mode the resource was passed directly to us by sem_up, so
+    //there is nothing left to take from the count
+    if (tw.waiter.granted) {
+      sem->acquires++;
+      sem_account_wait(sem, startp);
+      TRACE(TRACE_SEM_WAKE, sem, 0);
+      if (deadline) {
+        timer_cancel(&tw.timer);
+      }
+      exit_critical_section();
+      return 0;
+    }
   }
 
   //on success, we decrement the count and leave the crit section
   sem->count--;
+  sem->acquires++;
+  if (blocked) {
+    sem_account_wait(sem, startp);
+    TRACE(TRACE_SEM_WAKE, sem, 0);
+  }
+  if (deadline) {
+    timer_cancel(&tw.timer);
+  }
   exit_critical_section();
   return 0;
 }
 
+int sem_down(sem_t sem)
+{
+  if (!sem){
+    return -1;
+  }
+
+  return sem_wait(sem, NULL);
+}
+
+int sem_trydown(sem_t sem)
+{
+  if (!sem){
+    return -1;
+  }
+
+  enter_critical_section();
+  if (sem->count == 0) {
+    exit_critical_section();
+    errno = EAGAIN;
+    return -1;
+  }
+
+  sem->count--;
+  sem->acquires++;
+  exit_critical_section();
+  return 0;
+}
+
+int sem_timeddown(sem_t sem, const struct timespec *deadline)
+{
+  if (!sem || !deadline){
+    return -1;
+  }
+
+  return sem_wait(sem, deadline);
+}
+
+// take one resource from each semaphore of the set, or none at all if one of
+// them is not available
+static int sem_set_take(struct waitset *set)
+{
+  size_t i;
+
+  for (i = 0; i < set->n; i++) {
+    if (set->sems[i]->count == 0) {
+      // give back what we took so far
+      while (i-- > 0) {
+        set->sems[i]->count++;
+      }
+      return 0;
+    }
+    set->sems[i]->count--;
+  }
+
+  for (i = 0; i < set->n; i++) {
+    set->sems[i]->acquires++;
+  }
+
+  return 1;
+}
+
+// remove the entries of a set from the waiting lists it is still linked in
+static void sem_set_unlink(struct waitset *set)
+{
+  size_t i;
+
+  for (i = 0; i < set->n; i++) {
+    if (waitq_contains(&set->sems[i]->waiting, &set->links[i])) {
+      waitq_remove(&set->sems[i]->waiting, &set->links[i]);
+    }
+  }
+}
+
+// a resource was just released to sem: give it to the first waiter which can
+// use it. Threads waiting for a whole set of semaphores are skipped, without
+// losing their place, as long as the rest of their set is not available
+static int sem_wake(sem_t sem)
+{
+  struct waiter *waiter = sem->waiting.head;
+
+  while (waiter) {
+    struct waiter *next = waiter->next;
+
+    if (waiter->set == NULL) {
+      waitq_remove(&sem->waiting, waiter);
+
+      //in handoff mode the resource never goes through the count, so no other
+      //thread can barge in and take it before the waiter gets to run. In
+      //barging mode, the waiter has to compete for it again once it wakes up
+      if (sem->mode == SEM_MODE_HANDOFF) {
+        sem->count--;
+        waiter->granted = 1;
+      }
+
+      sem->wakeups++;
+      return thread_unblock(waiter->tid);
+    }
+
+    //a thread waiting for any semaphore of its set can always take this one
+    if (waiter->set->any) {
+      sem->count--;
+      sem->acquires++;
+      waiter->set->index = waiter - waiter->set->links;
+      sem_set_unlink(waiter->set);
+      waiter->set->granted = 1;
+      sem->wakeups++;
+      return thread_unblock(waiter->tid);
+    }
+
+    if (sem_set_take(waiter->set)) {
+      sem_set_unlink(waiter->set);
+      waiter->set->granted = 1;
+      sem->wakeups++;
+      return thread_unblock(waiter->tid);
+    }
+
+    waiter = next;
+  }
+
+  return 0;
+}
+
 int sem_up(sem_t sem)
 {
   if (!sem){
     return -1;
   }
 
-  //enter the critical section so we can potentially release a sem
+  //enter the critical section so we can potentially release a sem, and wake up
+  //a waiter which can now take it
   enter_critical_section();
   sem->count++;
+  int ret = sem_wake(sem);
+  TRACE(TRACE_SEM_UP, sem, sem->count);
+  exit_critical_section();
 
-  //initialize a thread tid so we can check the tid of the head thread
-  pthread_t p_tid;
+  return ret;
+}
 
-  //attempt to dequeue first, then block
-  if (queue_dequeue(sem->waiting, (void**)&p_tid) == -1){
-    exit_critical_section();
+// block on a set of semaphores until sem_up hands us either all of them or
+// any of them, depending on set->any. Must be called inside the critical
+// section
+static int sem_set_wait(struct waitset *set)
+{
+  struct timespec start, *startp = NULL;
+  size_t i;
+  for (i = 0; i < set->n; i++) {
+    if (set->sems[i]->profile) {
+      clock_gettime(CLOCK_MONOTONIC, &start);
+      startp = &start;
+      break;
+    }
+  }
+
+  for (i = 0; i < set->n; i++) {
+    set->links[i].tid = set->tid;
+    set->links[i].granted = 0;
+    set->links[i].set = set;
+    sem_push_waiter(set->sems[i], &set->links[i]);
+  }
+
+  while (!set->granted) {
+    if (thread_block() == -1) {
+      sem_set_unlink(set);
+      return -1;
+    }
+  }
+
+  //we waited on the semaphore we got, or on all of them
+  if (set->any) {
+    sem_account_wait(set->sems[set->index], startp);
+  } else {
+    for (i = 0; i < set->n; i++) {
+      sem_account_wait(set->sems[i], startp);
+    }
+  }
+
+  return 0;
+}
+
+// set up a set of semaphores to wait on
+static int sem_set_init(struct waitset *set, sem_t *sems, size_t n, int any,
+                        struct waiter *inline_links)
+{
+  if (!sems || n == 0){
     return -1;
   }
 
-  if (thread_unblock(p_tid) == -1){
-    exit_critical_section();
+  size_t i;
+  for (i = 0; i < n; i++) {
+    if (!sems[i]) {
+      return -1;
+    }
+  }
+
+  set->tid = thread_self();
+  set->sems = sems;
+  set->n = n;
+  set->any = any;
+  set->index = 0;
+  set->granted = 0;
+
+  //we need one entry per semaphore, which only needs to be allocated for
+  //unusually large sets
+  set->links = inline_links;
+  if (n > SEM_SET_INLINE) {
+    set->links = malloc(n * sizeof(struct waiter));
+    if (!set->links) {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+static void sem_set_fini(struct waitset *set, struct waiter *inline_links)
+{
+  if (set->links != inline_links) {
+    free(set->links);
+  }
+}
+
+int sem_down_all(sem_t *sems, size_t n)
+{
+  struct waiter inline_links[SEM_SET_INLINE];
+  struct waitset set;
+  if (sem_set_init(&set, sems, n, 0, inline_links) == -1) {
     return -1;
   }
 
+  enter_critical_section();
+
+  //either everything is available right now, or we wait without holding
+  //anything until sem_up hands us the whole set
+  int ret = 0;
+  if (!sem_set_take(&set)) {
+    ret = sem_set_wait(&set);
+  }
+
   exit_critical_section();
-  return 0;
+
+  sem_set_fini(&set, inline_links);
+  return ret;
+}
+
+int sem_wait_any(sem_t *sems, size_t n, size_t *index)
+{
+  if (!index) {
+    return -1;
+  }
+
+  struct waiter inline_links[SEM_SET_INLINE];
+  struct waitset set;
+  if (sem_set_init(&set, sems, n, 1, inline_links) == -1) {
+    return -1;
+  }
+
+  enter_critical_section();
+
+  //take the first semaphore available right now, if any
+  int ret = 0;
+  size_t i;
+  for (i = 0; i < n; i++) {
+    if (sems[i]->count > 0) {
+      sems[i]->count--;
+      sems[i]->acquires++;
+      set.index = i;
+      break;
+    }
+  }
+
+  //otherwise wait on all of them until sem_up hands us one
+  if (i == n) {
+    ret = sem_set_wait(&set);
+  }
+
+  exit_critical_section();
+
+  *index = set.index;
+  sem_set_fini(&set, inline_links);
+  return ret;
 }
 
 int sem_getvalue(sem_t sem, int *sval)
@@ -113,9 +583,207 @@ int sem_getvalue(sem_t sem, int *sval)
   }
 
   if (sem->count == 0){
-    *sval = queue_length(sem->waiting) * -1;
+    *sval = sem->waiting.length * -1;
     return 0;
   }
 
   return 0;
 }
+
+int sem_setmode(sem_t sem, int mode)
+{
+  if (!sem) {
+    return -1;
+  }
+
+  if (mode != SEM_MODE_BARGING && mode != SEM_MODE_HANDOFF) {
+    return -1;
+  }
+
+  // waiters check whether they were granted the resource when they wake up, so
+  // the mode can safely change while threads are blocked on the semaphore
+  enter_critical_section();
+  sem->mode = mode;
+  exit_critical_section();
+  return 0;
+}
+
+// fill in stats for sem. Must be called inside the critical section
+static void sem_fill_stats(sem_t sem, struct sem_stats *stats)
+{
+  memset(stats, 0, sizeof(struct sem_stats));
+
+  stats->acquires = sem->acquires;
+  stats->wakeups = sem->wakeups;
+  stats->contended = sem->contended;
+  stats->peak_waiting = sem->peak_waiting;
+  if (sem->profile) {
+    stats->wait_total_ns = sem->profile->wait_total_ns;
+    stats->wait_max_ns = sem->profile->wait_max_ns;
+    memcpy(stats->wait_hist, sem->profile->wait_hist,
+           sizeof(stats->wait_hist));
+  }
+
+  if (stats->acquires > 0) {
+    stats->wakeups_per_acquire = (double)stats->wakeups / stats->acquires;
+  }
+}
+
+int sem_getstats(sem_t sem, struct sem_stats *stats)
+{
+  if (!sem || !stats) {
+    return -1;
+  }
+
+  enter_critical_section();
+  sem_fill_stats(sem, stats);
+  exit_critical_section();
+
+  return 0;
+}
+
+int sem_setname(sem_t sem, const char *name)
+{
+  if (!sem || !name) {
+    return -1;
+  }
+
+  // allocated outside of the critical section, in case it is not needed
+  struct sem_profile *profile = calloc(1, sizeof(struct sem_profile));
+  if (!profile) {
+    return -1;
+  }
+
+  enter_critical_section();
+
+  // the first name registers the semaphore for sem_report
+  if (!sem->profile) {
+    sem->profile = profile;
+    profile = NULL;
+    sem->registry_prev = NULL;
+    sem->registry_next = registry;
+    if (registry) {
+      registry->registry_prev = sem;
+    }
+    registry = sem;
+  }
+
+  strncpy(sem->profile->name, name, SEM_NAME_MAX - 1);
+  sem->profile->name[SEM_NAME_MAX - 1] = '\0';
+  exit_critical_section();
+
+  free(profile);
+  return 0;
+}
+
+// snapshot of a semaphore, taken for sem_report
+struct sem_report_entry {
+  sem_t sem;
+  char name[SEM_NAME_MAX];
+  struct sem_stats stats;
+};
+
+// most contended first: longest total wait time, then most contended
+// acquisitions
+static int sem_report_cmp(const void *a, const void *b)
+{
+  const struct sem_stats *sa = &((const struct sem_report_entry*)a)->stats;
+  const struct sem_stats *sb = &((const struct sem_report_entry*)b)->stats;
+
+  if (sa->wait_total_ns != sb->wait_total_ns) {
+    return sa->wait_total_ns < sb->wait_total_ns ? 1 : -1;
+  }
+  if (sa->contended != sb->contended) {
+    return sa->contended < sb->contended ? 1 : -1;
+  }
+  return 0;
+}
+
+// upper bound of the wait time under which @percent % of the waits fall
+static unsigned long long sem_wait_percentile(struct sem_stats *stats,
+                                              double percent)
+{
+  unsigned long total = 0, seen = 0;
+  int i;
+
+  for (i = 0; i < SEM_STATS_BUCKETS; i++) {
+    total += stats->wait_hist[i];
+  }
+
+  for (i = 0; i < SEM_STATS_BUCKETS; i++) {
+    seen += stats->wait_hist[i];
+    if (seen > 0 && seen >= total * percent / 100) {
+      return 2ULL << i;
+    }
+  }
+
+  return 0;
+}
+
+int sem_report(FILE *stream)
+{
+  if (!stream) {
+    return -1;
+  }
+
+  // take a snapshot of every semaphore, so that the critical section isn't
+  // held while printing
+  enter_critical_section();
+
+  size_t n = 0, i = 0;
+  struct semaphore *sem;
+  for (sem = registry; sem; sem = sem->registry_next) {
+    n++;
+  }
+
+  struct sem_report_entry *entries = malloc((n ? n : 1) * sizeof(*entries));
+  if (!entries) {
+    exit_critical_section();
+    return -1;
+  }
+
+  for (sem = registry; sem; sem = sem->registry_next) {
+    // leave out semaphores which were never used
+    if (sem->acquires == 0 && sem->waiting.length == 0) {
+      continue;
+    }
+
+    entries[i].sem = sem;
+    memcpy(entries[i].name, sem->profile->name, SEM_NAME_MAX);
+    sem_fill_stats(sem, &entries[i].stats);
+    i++;
+  }
+  n = i;
+
+  exit_critical_section();
+
+  qsort(entries, n, sizeof(*entries), sem_report_cmp);
+
+  fprintf(stream, "%-24s %10s %10s %6s %10s %7s %12s %10s %10s %10s %6s\n",
+          "semaphore", "acquires", "contended", "%cont", "wakeups", "wk/acq",
+          "wait_ms", "avg_us", "p99_us", "max_us", "peak");
+
+  for (i = 0; i < n; i++) {
+    struct sem_stats *st = &entries[i].stats;
+    char name[SEM_NAME_MAX];
+
+    if (entries[i].name[0]) {
+      memcpy(name, entries[i].name, SEM_NAME_MAX);
+    } else {
+      snprintf(name, sizeof(name), "%p", (void*)entries[i].sem);
+    }
+
+    fprintf(stream,
+            "%-24s %10lu %10lu %6.1f %10lu %7.3f %12.3f %10.1f %10.1f %10.1f "
+            "%6d\n",
+            name, st->acquires, st->contended,
+            st->acquires ? 100.0 * st->contended / st->acquires : 0.0,
+            st->wakeups, st->wakeups_per_acquire, st->wait_total_ns / 1e6,
+            st->contended ? st->wait_total_ns / 1e3 / st->contended : 0.0,
+            sem_wait_percentile(st, 99) / 1e3, st->wait_max_ns / 1e3,
+            st->peak_waiting);
+  }
+
+  free(entries);
+  return 0;
+}
@@ -2,7 +2,11 @@
 #define _SEMAPHORE_H
 
 #include <stdint.h>
+#include <stdio.h>
 #include <sys/types.h>
+#include <time.h>
+
+#include "waitq.h"
 
 /*
  * sem_t - Semaphore type
@@ -15,6 +19,30 @@
  */
 typedef struct semaphore *sem_t;
 
+/*
+ * struct semaphore - Semaphore object
+ *
+ * The definition is only exposed so that semaphores can be embedded in other
+ * structures or arrays and initialized with sem_init(). Its fields must only be
+ * accessed through the functions below.
+ */
+struct semaphore {
+  int count;
+  int mode;
+  struct waitq waiting;
+
+  // statistics, only ever touched inside the critical section
+  unsigned long acquires;
+  unsigned long wakeups;
+  unsigned long contended;
+  int peak_waiting;
+  struct sem_profile *profile;
+
+  // list of the named semaphores, for sem_report()
+  struct semaphore *registry_prev;
+  struct semaphore *registry_next;
+};
+
 /*
  * sem_create - Create semaphore
  * @count: Semaphore count
@@ -26,11 +54,36 @@ typedef struct semaphore *sem_t;
  */
 sem_t sem_create(size_t count);
 
+/*
+ * sem_init - Initialize a semaphore in place
+ * @sem: Address of the semaphore object to initialize
+ * @count: Semaphore count
+ *
+ * Initialize the caller-provided semaphore object @sem with internal count
+ * @count. Unlike sem_create(), no memory is allocated, which allows semaphores
+ * to be embedded in other structures or arrays.
+ *
+ * Return: -1 if @sem is NULL. 0 if @sem was successfully initialized.
+ */
+int sem_init(sem_t sem, size_t count);
+
+/*
+ * sem_fini - Finalize a semaphore initialized in place
+ * @sem: Semaphore to finalize
+ *
+ * Finalize semaphore @sem, previously initialized with sem_init(). The memory
+ * of @sem itself is not released.
+ *
+ * Return: -1 if @sem is NULL or if other threads are still being blocked on
+ * @sem. 0 if @sem was successfully finalized.
+ */
+int sem_fini(sem_t sem);
+
 /*
  * sem_destroy - Deallocate a semaphore
  * @sem: Semaphore to deallocate
  *
- * Deallocate semaphore @sem.
+ * Deallocate semaphore @sem, previously allocated with sem_create().
  *
  * Return: -1 if @sem is NULL or if other threads are still being blocked on
  * @sem. 0 is @sem was successfully destroyed.
@@ -50,6 +103,33 @@ int sem_destroy(sem_t sem);
  */
 int sem_down(sem_t sem);
 
+/*
+ * sem_trydown - Take a semaphore without blocking
+ * @sem: Semaphore to take
+ *
+ * Take a resource from semaphore @sem if one is available right away.
+ *
+ * Return: -1 if @sem is NULL, or if the semaphore is not available (errno is
+ * then set to EAGAIN). 0 if semaphore was successfully taken.
+ */
+int sem_trydown(sem_t sem);
+
+/*
+ * sem_timeddown - Take a semaphore with a timeout
+ * @sem: Semaphore to take
+ * @deadline: Absolute time (as given by CLOCK_REALTIME) at which to give up
+ *
+ * Take a resource from semaphore @sem, blocking the caller thread until the
+ * semaphore becomes available or until @deadline is reached, whichever comes
+ * first. When the deadline is reached, the caller is removed from the waiting
+ * list of @sem without waking any other thread.
+ *
+ * Return: -1 if @sem or @deadline are NULL, or if @deadline was reached before
+ * the semaphore became available (errno is then set to ETIMEDOUT). 0 if
+ * semaphore was successfully taken.
+ */
+int sem_timeddown(sem_t sem, const struct timespec *deadline);
+
 /*
  * sem_up - Release a semaphore
  * @sem: Semaphore to release
@@ -58,12 +138,55 @@ int sem_down(sem_t sem);
  *
  * If the waiting list associated to @sem is not empty, releasing a resource
  * also causes the first thread (i.e. the oldest) in the waiting list to be
- * unblocked.
+ * unblocked. See sem_setmode() for how the resource is given to that thread.
+ * Threads blocked in sem_down_all() are only unblocked once all the other
+ * semaphores they are waiting for are also available. Threads blocked in
+ * sem_wait_any() are always handed the resource directly.
  *
  * Return: -1 if @sem is NULL. 0 if semaphore was successfully released.
  */
 int sem_up(sem_t sem);
 
+/*
+ * sem_down_all - Take several semaphores atomically
+ * @sems: Array of semaphores to take
+ * @n: Number of semaphores in @sems
+ *
+ * Take one resource from each semaphore of @sems, all at once. If any of them
+ * is not available, the caller thread is blocked without holding any of the
+ * other ones, until all of them become available at the same time. This
+ * avoids the deadlocks that can happen when taking them one after the other
+ * in different orders.
+ *
+ * A semaphore appearing several times in @sems is taken as many times.
+ *
+ * While blocked, the caller does not prevent threads waiting on only some of
+ * the semaphores from taking them, so it can be overtaken.
+ *
+ * Return: -1 if @sems is NULL, if @n is 0, if one of the semaphores is NULL, or
+ * in case of failure when allocating memory for large sets. 0 if all the
+ * semaphores were successfully taken.
+ */
+int sem_down_all(sem_t *sems, size_t n);
+
+/*
+ * sem_wait_any - Take any one of several semaphores
+ * @sems: Array of semaphores to wait on
+ * @n: Number of semaphores in @sems
+ * @index: Address of data item receiving the position in @sems of the
+ * semaphore that was taken
+ *
+ * Take one resource from the first available semaphore of @sems. If none of
+ * them is available, the caller thread is blocked on all of them at once until
+ * one of them is released, which hands its resource off to the caller. This
+ * allows a single thread to wait for several producers.
+ *
+ * Return: -1 if @sems or @index are NULL, if @n is 0, if one of the semaphores
+ * is NULL, or in case of failure when allocating memory for large sets. 0 if
+ * a semaphore was successfully taken.
+ */
+int sem_wait_any(sem_t *sems, size_t n, size_t *index);
+
 /*
  * sem_getvalue - Inspect semaphore's internal state
  * @sem: Semaphore to inspect
@@ -81,4 +204,106 @@ int sem_up(sem_t sem);
  */
 int sem_getvalue(sem_t sem, int *sval);
 
+/*
+ * Semaphore wakeup modes
+ *
+ * SEM_MODE_BARGING: sem_up() puts the resource back into the internal count
+ * and wakes up the oldest waiter, which then competes for the resource with
+ * any other thread calling sem_down() in the meantime. This favors throughput
+ * since a running thread never has to wait for a woken thread to be scheduled.
+ *
+ * SEM_MODE_HANDOFF: sem_up() passes the resource directly to the oldest
+ * waiter. The woken thread is guaranteed to own the resource when it runs, so
+ * it never has to block again. This favors fairness and tail latency.
+ */
+#define SEM_MODE_BARGING 0
+#define SEM_MODE_HANDOFF 1
+
+/*
+ * sem_setmode - Select the wakeup mode of a semaphore
+ * @sem: Semaphore to configure
+ * @mode: SEM_MODE_BARGING or SEM_MODE_HANDOFF
+ *
+ * Semaphores are created in SEM_MODE_BARGING mode.
+ *
+ * Return: -1 if @sem is NULL or if @mode is not a valid mode. 0 if the mode of
+ * @sem was successfully changed.
+ */
+int sem_setmode(sem_t sem, int mode);
+
+/*
+ * Number of buckets of the wait time histogram of a semaphore
+ */
+#define SEM_STATS_BUCKETS 32
+
+/*
+ * struct sem_stats - Semaphore statistics
+ * @acquires: Number of times the semaphore was successfully taken
+ * @wakeups: Number of times a blocked thread was woken up by sem_up()
+ * @wakeups_per_acquire: @wakeups divided by @acquires
+ * @contended: Number of times the semaphore was taken after having to block
+ * @wait_total_ns: Total time spent blocked by the @contended acquisitions
+ * @wait_max_ns: Longest time spent blocked by one acquisition
+ * @peak_waiting: Largest number of threads blocked on the semaphore at once
+ * @wait_hist: Histogram of the time spent blocked by the @contended
+ * acquisitions. Bucket i counts waits between 2^i and 2^(i+1) nanoseconds
+ *
+ * @wait_total_ns, @wait_max_ns and @wait_hist are only measured once the
+ * semaphore is named with sem_setname(), and are 0 otherwise.
+ *
+ * In SEM_MODE_BARGING mode, a woken thread can lose the resource to another
+ * thread and go back to sleep, which shows as a @wakeups_per_acquire ratio
+ * higher than the fraction of sem_down() calls that actually had to block.
+ */
+struct sem_stats {
+  unsigned long acquires;
+  unsigned long wakeups;
+  double wakeups_per_acquire;
+  unsigned long contended;
+  unsigned long long wait_total_ns;
+  unsigned long long wait_max_ns;
+  int peak_waiting;
+  unsigned long wait_hist[SEM_STATS_BUCKETS];
+};
+
+/*
+ * sem_getstats - Get semaphore statistics
+ * @sem: Semaphore to inspect
+ * @stats: Address of statistics structure to fill in
+ *
+ * Return: -1 if @sem or @stats are NULL. 0 if @stats was successfully filled
+ * in.
+ */
+int sem_getstats(sem_t sem, struct sem_stats *stats);
+
+/*
+ * sem_setname - Name a semaphore
+ * @sem: Semaphore to name
+ * @name: Name to give to @sem, truncated to 31 characters
+ *
+ * Give semaphore @sem a name under which it appears in sem_report(). Naming a
+ * semaphore also turns on the measurement of its wait times, which are
+ * otherwise left out so that semaphores nobody profiles cost nothing more.
+ *
+ * Return: -1 if @sem or @name are NULL, or in case of failure when allocating
+ * memory for the name. 0 if @sem was successfully named.
+ */
+int sem_setname(sem_t sem, const char *name);
+
+/*
+ * sem_report - Print a contention report
+ * @stream: Stream to print the report to
+ *
+ * Print the statistics of every named semaphore which was used so far, one per
+ * line and most contended first (longest total time spent blocked on it).
+ *
+ * Statistics are gathered inside the critical section that every semaphore
+ * operation already goes through, and wait times are only measured when a
+ * thread actually blocks on a named semaphore.
+ *
+ * Return: -1 if @stream is NULL, or in case of failure when allocating memory
+ * for the report. 0 if the report was successfully printed.
+ */
+int sem_report(FILE *stream);
+
 #endif /* _SEMAPHORE_H */
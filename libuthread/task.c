@@ -0,0 +1,492 @@
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "queue.h"
+#include "task.h"
+#include "thread.h"
+#include "uthread.h"
+#include "waitq.h"
+
+// number of tasks per runner a parallel loop is split into by default, so
+// that runners which finish early can take over some of the work
+#define TASK_FOR_SPLIT 4
+
+enum future_state {
+  FUTURE_PENDING, // continuation of a future which is not done yet
+  FUTURE_QUEUED,
+  FUTURE_RUNNING,
+  FUTURE_DONE,
+};
+
+struct future {
+  // NULL once the pool is destroyed
+  task_pool_t pool;
+  enum future_state state;
+  task_func_t func;
+  void *arg;
+  void *result;
+
+  // position in the pool's queue, while queued
+  queue_handle_t handle;
+
+  // future this one continues, while pending
+  struct future *parent;
+
+  // continuations, linked through their sibling pointer
+  struct future *children;
+  struct future *sibling;
+
+  // threads in future_wait()
+  struct waitq waiting;
+
+  // future_destroy() was called before the future was done
+  int destroyed;
+
+  // links in the pool's list of done futures, while not destroyed
+  struct future *done_prev;
+  struct future *done_next;
+};
+
+// everything is protected by the critical section
+struct task_pool {
+  queue_t tasks;
+  struct waitq idle;
+
+  // futures not done yet, queued or not
+  int unfinished;
+  int stopping;
+
+  // futures done but not destroyed yet, which outlive the pool
+  struct future *done;
+
+  size_t nrunners;
+  uthread_t *runners;
+};
+
+static void task_run(struct future *future);
+
+// wake up every thread in waitq
+static void wake_all(struct waitq *waitq)
+{
+  struct waiter *waiter;
+
+  while ((waiter = waitq_pop(waitq))) {
+    waiter->granted = 1;
+    thread_unblock(waiter->tid);
+  }
+}
+
+// block on waitq until woken up by wake_all(), inside the critical section
+static int wait_on(struct waitq *waitq)
+{
+  struct waiter waiter;
+  waiter.tid = thread_self();
+  waiter.granted = 0;
+  waiter.set = NULL;
+  waitq_push(waitq, &waiter);
+
+  while (!waiter.granted) {
+    if (thread_block() == -1) {
+      waitq_remove(waitq, &waiter);
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+// once being destroyed, a pool accepts new tasks until all of them are done,
+// so that tasks can keep submitting others
+static int pool_stopped(task_pool_t pool)
+{
+  return pool->stopping && pool->unfinished == 0;
+}
+
+static struct future *future_new(task_pool_t pool, task_func_t func, void *arg)
+{
+  struct future *future = calloc(1, sizeof(struct future));
+  if (!future) {
+    return NULL;
+  }
+
+  future->pool = pool;
+  future->func = func;
+  future->arg = arg;
+  waitq_init(&future->waiting);
+  return future;
+}
+
+// queue a task and wake up a runner for it
+static int task_queue(struct future *future)
+{
+  task_pool_t pool = future->pool;
+
+  if (queue_enqueue_handle(pool->tasks, future, &future->handle) == -1) {
+    return -1;
+  }
+  future->state = FUTURE_QUEUED;
+
+  struct waiter *waiter = waitq_pop(&pool->idle);
+  if (waiter) {
+    waiter->granted = 1;
+    thread_unblock(waiter->tid);
+  }
+
+  return 0;
+}
+
+static void future_complete(struct future *future, void *result)
+{
+  task_pool_t pool = future->pool;
+  struct future *child, *next;
+
+  future->result = result;
+  future->state = FUTURE_DONE;
+  wake_all(&future->waiting);
+
+  for (child = future->children; child; child = next) {
+    next = child->sibling;
+    child->parent = NULL;
+    child->arg = result;
+
+    // threads waiting for the continuation can now run it themselves
+    if (task_queue(child) == -1) {
+      task_run(child);
+    } else {
+      wake_all(&child->waiting);
+    }
+  }
+  future->children = NULL;
+
+  if (--pool->unfinished == 0 && pool->stopping) {
+    wake_all(&pool->idle);
+  }
+
+  if (future->destroyed) {
+    free(future);
+    return;
+  }
+
+  future->done_prev = NULL;
+  future->done_next = pool->done;
+  if (pool->done) {
+    pool->done->done_prev = future;
+  }
+  pool->done = future;
+}
+
+// run a task which is not queued anymore. Called and returns inside the
+// critical section
+static void task_run(struct future *future)
+{
+  future->state = FUTURE_RUNNING;
+  exit_critical_section();
+
+  void *result = future->func(future->arg);
+
+  enter_critical_section();
+  future_complete(future, result);
+}
+
+static void *runner(void *arg)
+{
+  task_pool_t pool = arg;
+  void *future;
+
+  enter_critical_section();
+  while (1) {
+    if (queue_dequeue(pool->tasks, &future) == 0) {
+      task_run(future);
+      continue;
+    }
+
+    if (pool_stopped(pool)) {
+      break;
+    }
+
+    wait_on(&pool->idle);
+  }
+  exit_critical_section();
+
+  return NULL;
+}
+
+// TASK POOL FUNCTIONS ---------------------------------------------------------
+
+task_pool_t task_pool_create(size_t nrunners)
+{
+  if (nrunners == 0) {
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    nrunners = online > 0 ? online : 1;
+  }
+
+  struct task_pool *pool = calloc(1, sizeof(struct task_pool));
+  if (!pool) {
+    return NULL;
+  }
+
+  pool->tasks = queue_create();
+  pool->runners = calloc(nrunners, sizeof(uthread_t));
+  if (!pool->tasks || !pool->runners) {
+    queue_destroy(pool->tasks);
+    free(pool->runners);
+    free(pool);
+    return NULL;
+  }
+  waitq_init(&pool->idle);
+
+  // make do with the runners which could be started
+  size_t i;
+  for (i = 0; i < nrunners; i++) {
+    if (uthread_create(&pool->runners[i], runner, pool) == -1) {
+      break;
+    }
+  }
+  if (i == 0) {
+    queue_destroy(pool->tasks);
+    free(pool->runners);
+    free(pool);
+    return NULL;
+  }
+  pool->nrunners = i;
+
+  return pool;
+}
+
+int task_pool_destroy(task_pool_t pool)
+{
+  if (!pool) {
+    return -1;
+  }
+
+  enter_critical_section();
+  pool->stopping = 1;
+  if (pool->unfinished == 0) {
+    wake_all(&pool->idle);
+  }
+  exit_critical_section();
+
+  // runners only leave once every task is done
+  size_t i;
+  for (i = 0; i < pool->nrunners; i++) {
+    uthread_join(pool->runners[i], NULL);
+  }
+
+  // the futures which are left are all done, and must not use the pool anymore
+  enter_critical_section();
+  struct future *future;
+  for (future = pool->done; future; future = future->done_next) {
+    future->pool = NULL;
+  }
+  exit_critical_section();
+
+  queue_destroy(pool->tasks);
+  free(pool->runners);
+  free(pool);
+  return 0;
+}
+
+future_t task_submit(task_pool_t pool, task_func_t func, void *arg)
+{
+  if (!pool || !func) {
+    return NULL;
+  }
+
+  enter_critical_section();
+  if (pool_stopped(pool)) {
+    exit_critical_section();
+    return NULL;
+  }
+
+  struct future *future = future_new(pool, func, arg);
+  if (!future || task_queue(future) == -1) {
+    exit_critical_section();
+    free(future);
+    return NULL;
+  }
+  pool->unfinished++;
+
+  exit_critical_section();
+  return future;
+}
+
+future_t future_then(future_t future, task_func_t func)
+{
+  if (!future || !func) {
+    return NULL;
+  }
+
+  enter_critical_section();
+  task_pool_t pool = future->pool;
+  if (!pool || pool_stopped(pool)) {
+    exit_critical_section();
+    return NULL;
+  }
+
+  struct future *child = future_new(pool, func, future->result);
+  if (!child) {
+    exit_critical_section();
+    return NULL;
+  }
+
+  if (future->state == FUTURE_DONE) {
+    if (task_queue(child) == -1) {
+      exit_critical_section();
+      free(child);
+      return NULL;
+    }
+  } else {
+    child->state = FUTURE_PENDING;
+    child->parent = future;
+    child->sibling = future->children;
+    future->children = child;
+  }
+  pool->unfinished++;
+
+  exit_critical_section();
+  return child;
+}
+
+// FUTURE FUNCTIONS ------------------------------------------------------------
+
+int future_wait(future_t future, void **result)
+{
+  if (!future) {
+    return -1;
+  }
+
+  enter_critical_section();
+  while (future->state != FUTURE_DONE) {
+    // rather than waiting for a runner to get to it, run the task ourselves,
+    // or the first one of the chain of tasks it continues
+    struct future *first = future;
+    while (first->state == FUTURE_PENDING) {
+      first = first->parent;
+    }
+
+    if (first->state == FUTURE_QUEUED) {
+      queue_remove_handle(first->pool->tasks, first->handle);
+      task_run(first);
+      continue;
+    }
+
+    if (wait_on(&future->waiting) == -1) {
+      exit_critical_section();
+      return -1;
+    }
+  }
+
+  if (result) {
+    *result = future->result;
+  }
+  exit_critical_section();
+
+  return 0;
+}
+
+int future_destroy(future_t future)
+{
+  if (!future) {
+    return -1;
+  }
+
+  enter_critical_section();
+  if (future->waiting.length > 0) {
+    exit_critical_section();
+    return -1;
+  }
+
+  if (future->state != FUTURE_DONE) {
+    future->destroyed = 1;
+    exit_critical_section();
+    return 0;
+  }
+
+  if (future->pool) {
+    if (future->done_prev) {
+      future->done_prev->done_next = future->done_next;
+    } else {
+      future->pool->done = future->done_next;
+    }
+    if (future->done_next) {
+      future->done_next->done_prev = future->done_prev;
+    }
+  }
+  exit_critical_section();
+
+  free(future);
+
+  return 0;
+}
+
+// PARALLEL LOOPS --------------------------------------------------------------
+
+struct range {
+  task_range_func_t func;
+  void *arg;
+  size_t begin;
+  size_t end;
+};
+
+static void *range_run(void *arg)
+{
+  struct range *range = arg;
+  range->func(range->begin, range->end, range->arg);
+  return NULL;
+}
+
+int task_parallel_for(task_pool_t pool, size_t begin, size_t end, size_t grain,
+                      task_range_func_t func, void *arg)
+{
+  if (!pool || !func) {
+    return -1;
+  }
+
+  if (begin >= end) {
+    return 0;
+  }
+
+  size_t n = end - begin;
+  if (grain == 0) {
+    grain = n / (pool->nrunners * TASK_FOR_SPLIT);
+    if (grain == 0) {
+      grain = 1;
+    }
+  }
+
+  size_t nranges = (n + grain - 1) / grain, i;
+  struct range *ranges = malloc(nranges * sizeof(struct range));
+  future_t *futures = malloc(nranges * sizeof(future_t));
+  if (!ranges || !futures) {
+    free(ranges);
+    free(futures);
+    func(begin, end, arg);
+    return 0;
+  }
+
+  // the caller takes the first range, and any range which could not be
+  // submitted
+  for (i = 0; i < nranges; i++) {
+    ranges[i].func = func;
+    ranges[i].arg = arg;
+    ranges[i].begin = begin + i * grain;
+    ranges[i].end = i == nranges - 1 ? end : ranges[i].begin + grain;
+    futures[i] = i ? task_submit(pool, range_run, &ranges[i]) : NULL;
+  }
+
+  for (i = 0; i < nranges; i++) {
+    if (!futures[i]) {
+      range_run(&ranges[i]);
+    }
+  }
+  for (i = 1; i < nranges; i++) {
+    if (futures[i]) {
+      future_wait(futures[i], NULL);
+      future_destroy(futures[i]);
+    }
+  }
+
+  free(ranges);
+  free(futures);
+  return 0;
+}
@@ -0,0 +1,136 @@
+#ifndef _TASK_H
+#define _TASK_H
+
+#include <stddef.h>
+
+/*
+ * task_pool_t - Task pool type
+ *
+ * A task pool runs short functions (tasks) on a fixed set of user threads
+ * (runners), so that a unit of work costs a queue operation instead of a
+ * thread creation. Each submitted task gets a future, through which its
+ * result is received once it has run.
+ */
+typedef struct task_pool *task_pool_t;
+
+/*
+ * future_t - Future type
+ *
+ * The eventual result of a task. Waiting on a future blocks the caller like
+ * sem_down() does, except that a task which has not started yet is simply run
+ * by the waiting thread itself. A future must be destroyed exactly once, but
+ * not necessarily after it is done.
+ */
+typedef struct future *future_t;
+
+/*
+ * task_func_t - Task function type
+ * @arg: Argument given to task_submit(), or result of the previous future for
+ * a continuation
+ *
+ * Return: Result of the task, received by future_wait().
+ */
+typedef void *(*task_func_t)(void *arg);
+
+/*
+ * task_range_func_t - Parallel loop body type
+ * @begin: First index of the range to process
+ * @end: Index following the last index of the range to process
+ * @arg: Argument given to task_parallel_for()
+ */
+typedef void (*task_range_func_t)(size_t begin, size_t end, void *arg);
+
+/*
+ * task_pool_create - Create a task pool
+ * @nrunners: Number of runners, or 0 for one per online CPU
+ *
+ * The runners are user threads, started along with the user thread runtime if
+ * necessary (see uthread.h).
+ *
+ * Return: Pointer to new task pool. NULL in case of failure when allocating
+ * the pool or starting its runners.
+ */
+task_pool_t task_pool_create(size_t nrunners);
+
+/*
+ * task_pool_destroy - Deallocate a task pool
+ * @pool: Task pool to deallocate
+ *
+ * Wait for all the tasks submitted to @pool, including continuations, to
+ * have run, then stop its runners. This function must not be called from a
+ * task of @pool. Futures are not destroyed, and remain valid: they can still be
+ * waited for and destroyed, but not continued with future_then().
+ *
+ * Return: -1 if @pool is NULL. 0 if @pool was successfully destroyed.
+ */
+int task_pool_destroy(task_pool_t pool);
+
+/*
+ * task_submit - Submit a task
+ * @pool: Task pool to run the task
+ * @func: Function to run
+ * @arg: Argument to pass to @func
+ *
+ * Return: Future of the task. NULL if @pool or @func are NULL, if @pool is
+ * being destroyed, or in case of failure when allocating the future.
+ */
+future_t task_submit(task_pool_t pool, task_func_t func, void *arg);
+
+/*
+ * future_then - Add a continuation to a future
+ * @future: Future to continue
+ * @func: Function to run with the result of @future as argument
+ *
+ * Submit @func to the pool of @future once @future is done, without anybody
+ * having to wait for it. A future can have any number of continuations.
+ *
+ * Return: Future of the continuation. NULL if @future or @func are NULL, if
+ * the pool of @future is being or was destroyed, or in case of failure when
+ * allocating the future.
+ */
+future_t future_then(future_t future, task_func_t func);
+
+/*
+ * future_wait - Wait for a future
+ * @future: Future to wait for
+ * @result: (Optional) Address of pointer where the result of the task is
+ * received
+ *
+ * Block the caller until the task of @future has run. If the task, or the one
+ * it continues, has not started yet, the caller runs it instead of blocking.
+ *
+ * Return: -1 if @future is NULL. 0 if the result of @future was received.
+ */
+int future_wait(future_t future, void **result);
+
+/*
+ * future_destroy - Deallocate a future
+ * @future: Future to deallocate
+ *
+ * A future which is not done yet is deallocated once its task has run.
+ *
+ * Return: -1 if @future is NULL or if threads are waiting for @future. 0 if
+ * @future was successfully destroyed.
+ */
+int future_destroy(future_t future);
+
+/*
+ * task_parallel_for - Run a loop in parallel
+ * @pool: Task pool to run the loop
+ * @begin: First index of the loop
+ * @end: Index following the last index of the loop
+ * @grain: Number of indexes processed by each task, or 0 to split the loop
+ * into a few tasks per runner
+ * @func: Function to run on each range of indexes
+ * @arg: Argument to pass to @func
+ *
+ * Split [@begin, @end) into ranges of @grain indexes and call @func on each of
+ * them from tasks of @pool, the caller taking the first range as well as any
+ * range which could not be submitted. Return once all of them are processed.
+ *
+ * Return: -1 if @pool or @func are NULL. 0 once the whole loop was processed.
+ */
+int task_parallel_for(task_pool_t pool, size_t begin, size_t end, size_t grain,
+                      task_range_func_t func, void *arg);
+
+#endif /* _TASK_H */
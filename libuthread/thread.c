@@ -0,0 +1,896 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+#include "thread.h"
+#include "trace.h"
+#include "uthread.h"
+
+// size of the stack of a user thread, only touched pages are actually used
+#define UTHREAD_STACK_SIZE (256 * 1024)
+
+// user thread IDs are the address of their struct uthread with the lowest bit
+// set, which tells them apart from pthread IDs (aligned addresses in glibc)
+#define UTHREAD_TAG 1
+
+// how often a worker looks at the global run queue before its own
+#define GLOBAL_RUNQ_PERIOD 61
+
+enum uthread_state {
+  UTHREAD_READY,
+  UTHREAD_RUNNING,
+  UTHREAD_BLOCKED,
+  UTHREAD_EXITED,
+};
+
+struct uthread {
+  ucontext_t context;
+  void *stack;
+  enum uthread_state state;
+
+  uthread_func_t func;
+  void *arg;
+  void *retval;
+
+  // thread waiting in uthread_join(), if any
+  pthread_t joiner;
+  int joined;
+
+  // run queue link
+  struct uthread *next;
+
+  // critical section nesting depth, which also disables preemption. It
+  // belongs to the user thread rather than to its worker since a preempted
+  // thread may resume on another worker
+  int cs_depth;
+  int preempt_pending;
+
+  char private[THREAD_PRIVATE_SIZE];
+};
+
+// what a user thread asks its worker to do once it has switched away from it
+enum worker_action {
+  WORKER_YIELD,
+  WORKER_PREEMPT,
+  WORKER_BLOCK,
+  WORKER_EXIT,
+};
+
+// a list of ready user threads, protected by its lock. Its length can be
+// read without the lock
+struct runq {
+  pthread_mutex_t lock;
+  struct uthread *head;
+  struct uthread *tail;
+  int length;
+};
+
+// a kernel thread running user threads. Its context is the scheduler loop,
+// to which user threads switch back when they stop running. Threads woken up
+// or created by one of its user threads go to its own run queue, where they
+// are likely to find their data still in this CPU's caches, and other workers
+// steal from it when they run out of threads
+struct worker {
+  pthread_t tid;
+  ucontext_t context;
+  struct uthread *current;
+  enum worker_action action;
+
+  struct runq runq;
+  unsigned int seed;
+  unsigned int ticks;
+
+  // CPU-time timer sending SIGVTALRM to this worker, if preemption is on
+  timer_t timer;
+};
+
+// a regular pthread blocked in thread_block()
+struct blocked {
+  pthread_t tid;
+  int woken;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  struct blocked *prev, *next;
+};
+
+// the critical section shared by all of libuthread. Only the outermost
+// enter_critical_section() takes the lock, nested ones just count
+static pthread_mutex_t cs_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// blocked pthreads, protected by the critical section
+static struct blocked *blocked_head = NULL;
+
+// user threads made ready by regular pthreads, which have no run queue of
+// their own
+static struct runq global_runq = { PTHREAD_MUTEX_INITIALIZER, NULL, NULL, 0 };
+
+// all the workers, fixed once the runtime is started
+static struct worker **workers = NULL;
+static int worker_count = 0;
+
+// workers with nothing to run sleep on idle_cond
+static pthread_mutex_t idle_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t idle_cond = PTHREAD_COND_INITIALIZER;
+static int idle = 0;
+
+static pthread_mutex_t init_lock = PTHREAD_MUTEX_INITIALIZER;
+static int started = 0;
+
+// time slice of user threads in microseconds, 0 if they are never preempted
+static long preempt_usec = 0;
+
+static __thread struct worker *self_worker = NULL;
+static __thread struct blocked self_blocked;
+static __thread int self_blocked_init = 0;
+static __thread char self_private[THREAD_PRIVATE_SIZE];
+static __thread int self_cs_depth = 0;
+
+// HELPER FUNCTIONS ------------------------------------------------------------
+
+// A user thread can resume on a different worker than the one it left, and
+// the compiler is free to reuse the address of a __thread variable computed
+// before the switch. Thread-local state is therefore only ever read through
+// these functions, which cannot be inlined nor analyzed by the caller.
+
+__attribute__((noipa))
+static struct worker *get_worker(void)
+{
+  return self_worker;
+}
+
+__attribute__((noipa))
+static struct uthread *get_current(void)
+{
+  struct worker *worker = self_worker;
+  return worker ? worker->current : NULL;
+}
+
+__attribute__((noipa))
+static int *get_cs_depth(void)
+{
+  struct uthread *uthread = get_current();
+  return uthread ? &uthread->cs_depth : &self_cs_depth;
+}
+
+__attribute__((noipa))
+static void set_errno(int value)
+{
+  errno = value;
+}
+
+static pthread_t uthread_id(struct uthread *uthread)
+{
+  return (pthread_t)((uintptr_t)uthread | UTHREAD_TAG);
+}
+
+static struct uthread *uthread_from_id(pthread_t tid)
+{
+  if (!((uintptr_t)tid & UTHREAD_TAG)) {
+    return NULL;
+  }
+
+  return (struct uthread*)((uintptr_t)tid & ~(uintptr_t)UTHREAD_TAG);
+}
+
+// RUN QUEUES ------------------------------------------------------------------
+
+static void runq_init(struct runq *runq)
+{
+  pthread_mutex_init(&runq->lock, NULL);
+  runq->head = NULL;
+  runq->tail = NULL;
+  runq->length = 0;
+}
+
+static void runq_append(struct runq *runq, struct uthread *first,
+                        struct uthread *last, int n)
+{
+  if (runq->tail) {
+    runq->tail->next = first;
+  } else {
+    runq->head = first;
+  }
+  runq->tail = last;
+  __atomic_store_n(&runq->length, runq->length + n, __ATOMIC_SEQ_CST);
+}
+
+// take up to n threads from the head of runq, linked together
+static struct uthread *runq_take(struct runq *runq, int n)
+{
+  struct uthread *first = runq->head, *last = first;
+  int taken = 1;
+
+  if (!first) {
+    return NULL;
+  }
+
+  while (taken < n && last->next) {
+    last = last->next;
+    taken++;
+  }
+
+  runq->head = last->next;
+  if (!runq->head) {
+    runq->tail = NULL;
+  }
+  last->next = NULL;
+  __atomic_store_n(&runq->length, runq->length - taken, __ATOMIC_RELAXED);
+
+  return first;
+}
+
+// wake up an idle worker, if any, to run or steal the thread we just queued
+static void wake_idle(void)
+{
+  // pairs with the check in worker_idle(): either the sleeping worker sees
+  // the thread we queued, or we see the worker
+  if (__atomic_load_n(&idle, __ATOMIC_SEQ_CST) > 0) {
+    pthread_mutex_lock(&idle_lock);
+    pthread_cond_signal(&idle_cond);
+    pthread_mutex_unlock(&idle_lock);
+  }
+}
+
+// make uthread ready, on the run queue of the calling worker if any
+static void runq_push(struct uthread *uthread)
+{
+  struct worker *worker = get_worker();
+  struct runq *runq = worker ? &worker->runq : &global_runq;
+
+  uthread->state = UTHREAD_READY;
+  uthread->next = NULL;
+
+  pthread_mutex_lock(&runq->lock);
+  runq_append(runq, uthread, uthread, 1);
+  pthread_mutex_unlock(&runq->lock);
+
+  wake_idle();
+}
+
+// move half of the threads of a random other worker to our run queue, and
+// return the first one to run it
+static struct uthread *worker_steal(struct worker *worker)
+{
+  int n = __atomic_load_n(&worker_count, __ATOMIC_ACQUIRE);
+  int start = rand_r(&worker->seed) % n, i;
+
+  for (i = 0; i < n; i++) {
+    struct worker *victim = workers[(start + i) % n];
+    if (victim == worker ||
+        __atomic_load_n(&victim->runq.length, __ATOMIC_RELAXED) == 0) {
+      continue;
+    }
+
+    // the oldest threads, which are the least likely to be cache-hot on the
+    // victim, go first
+    pthread_mutex_lock(&victim->runq.lock);
+    int length = victim->runq.length;
+    struct uthread *first = runq_take(&victim->runq, (length + 1) / 2);
+    pthread_mutex_unlock(&victim->runq.lock);
+
+    if (!first) {
+      continue;
+    }
+
+    if (first->next) {
+      struct uthread *last = first->next;
+      int stolen = 1;
+      while (last->next) {
+        last = last->next;
+        stolen++;
+      }
+
+      pthread_mutex_lock(&worker->runq.lock);
+      runq_append(&worker->runq, first->next, last, stolen);
+      pthread_mutex_unlock(&worker->runq.lock);
+      first->next = NULL;
+    }
+
+    return first;
+  }
+
+  return NULL;
+}
+
+// take the first thread of our own run queue, if any
+static struct uthread *runq_pop(struct runq *runq)
+{
+  struct uthread *uthread = NULL;
+
+  if (__atomic_load_n(&runq->length, __ATOMIC_RELAXED) > 0) {
+    pthread_mutex_lock(&runq->lock);
+    uthread = runq_take(runq, 1);
+    pthread_mutex_unlock(&runq->lock);
+  }
+
+  return uthread;
+}
+
+// take our share of the global run queue, and return its first thread after
+// moving the others to our own run queue
+static struct uthread *global_runq_pop(struct worker *worker)
+{
+  struct uthread *first = NULL, *last;
+  int n = __atomic_load_n(&worker_count, __ATOMIC_ACQUIRE), moved = 1;
+
+  if (__atomic_load_n(&global_runq.length, __ATOMIC_RELAXED) == 0) {
+    return NULL;
+  }
+
+  pthread_mutex_lock(&global_runq.lock);
+  first = runq_take(&global_runq, global_runq.length / n + 1);
+  pthread_mutex_unlock(&global_runq.lock);
+
+  if (first && first->next) {
+    for (last = first->next; last->next; last = last->next) {
+      moved++;
+    }
+
+    pthread_mutex_lock(&worker->runq.lock);
+    runq_append(&worker->runq, first->next, last, moved);
+    pthread_mutex_unlock(&worker->runq.lock);
+    first->next = NULL;
+  }
+
+  return first;
+}
+
+// find a thread to run: our own run queue first, then the threads made ready
+// by pthreads, then the other workers' queues. Since preempted threads go
+// back to our own queue, the global queue is also looked at first after a
+// preemption and now and then, or it could wait forever behind a few threads
+// which never block
+static struct uthread *worker_next(struct worker *worker, int preempted)
+{
+  struct uthread *uthread = NULL;
+
+  if (preempted || ++worker->ticks % GLOBAL_RUNQ_PERIOD == 0) {
+    uthread = global_runq_pop(worker);
+  }
+  if (!uthread) {
+    uthread = runq_pop(&worker->runq);
+  }
+  if (!uthread) {
+    uthread = global_runq_pop(worker);
+  }
+  if (!uthread) {
+    uthread = worker_steal(worker);
+  }
+
+  return uthread;
+}
+
+// whether any run queue holds a thread
+static int runq_any(void)
+{
+  int n = __atomic_load_n(&worker_count, __ATOMIC_ACQUIRE), i;
+
+  if (__atomic_load_n(&global_runq.length, __ATOMIC_SEQ_CST) > 0) {
+    return 1;
+  }
+  for (i = 0; i < n; i++) {
+    if (__atomic_load_n(&workers[i]->runq.length, __ATOMIC_SEQ_CST) > 0) {
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+// sleep until there may be a thread to run
+static void worker_idle(void)
+{
+  pthread_mutex_lock(&idle_lock);
+  __atomic_fetch_add(&idle, 1, __ATOMIC_SEQ_CST);
+  if (!runq_any()) {
+    pthread_cond_wait(&idle_cond, &idle_lock);
+  }
+  __atomic_fetch_sub(&idle, 1, __ATOMIC_SEQ_CST);
+  pthread_mutex_unlock(&idle_lock);
+}
+
+// switch from the current user thread back to its worker, which then carries
+// out action
+static void uthread_switch(struct uthread *uthread, enum worker_action action)
+{
+  struct worker *worker = get_worker();
+  worker->action = action;
+  swapcontext(&uthread->context, &worker->context);
+}
+
+// release the critical section on behalf of a user thread which switched away
+// from inside it
+static void cs_release(struct uthread *uthread)
+{
+  uthread->cs_depth = 0;
+  pthread_mutex_unlock(&cs_lock);
+}
+
+// PREEMPTION ------------------------------------------------------------------
+
+#if defined(__x86_64__)
+
+// bounds of the program's own code, which libuthread is linked into
+extern char __executable_start[], etext[];
+
+// SIGVTALRM handler, run on a worker whose timer expired
+static void preempt_handler(int sig, siginfo_t *info, void *context)
+{
+  struct uthread *uthread = get_current();
+  ucontext_t *uc = context;
+  uintptr_t sp = uc->uc_mcontext.gregs[REG_RSP];
+  uintptr_t pc = uc->uc_mcontext.gregs[REG_RIP];
+  (void)sig;
+  (void)info;
+
+  // the scheduler runs on the worker's own stack, including around the
+  // switches to and from user threads
+  if (!uthread || sp < (uintptr_t)uthread->stack ||
+      sp >= (uintptr_t)uthread->stack + UTHREAD_STACK_SIZE) {
+    return;
+  }
+
+  // never switch away while holding a lock: ours, which the critical section
+  // depth tells, or one of libc's, which we can only rule out outside of it.
+  // The thread then yields when it leaves the critical section, or at a
+  // later tick
+  if (uthread->cs_depth > 0 || pc < (uintptr_t)__executable_start ||
+      pc >= (uintptr_t)etext) {
+    uthread->preempt_pending = 1;
+    return;
+  }
+
+  // errno belongs to the worker, and we may resume on another one
+  int saved_errno = errno;
+  uthread->preempt_pending = 0;
+  uthread_switch(uthread, WORKER_PREEMPT);
+  set_errno(saved_errno);
+}
+
+static int preempt_install(void)
+{
+  struct sigaction sa;
+
+  memset(&sa, 0, sizeof(sa));
+  sigemptyset(&sa.sa_mask);
+  sa.sa_flags = SA_SIGINFO | SA_RESTART;
+  sa.sa_sigaction = preempt_handler;
+  return sigaction(SIGVTALRM, &sa, NULL);
+}
+
+// arm the calling worker's timer, which only counts the CPU time of this
+// worker so that an idle worker is never interrupted
+static void preempt_start(struct worker *worker)
+{
+  struct sigevent sev;
+  struct itimerspec its;
+
+  memset(&sev, 0, sizeof(sev));
+  sev.sigev_notify = SIGEV_THREAD_ID;
+  sev.sigev_signo = SIGVTALRM;
+  sev._sigev_un._tid = gettid();
+  if (timer_create(CLOCK_THREAD_CPUTIME_ID, &sev, &worker->timer)) {
+    return;
+  }
+
+  its.it_interval.tv_sec = preempt_usec / 1000000;
+  its.it_interval.tv_nsec = preempt_usec % 1000000 * 1000;
+  its.it_value = its.it_interval;
+  timer_settime(worker->timer, 0, &its, NULL);
+}
+
+#else
+
+static int preempt_install(void)
+{
+  errno = ENOSYS;
+  return -1;
+}
+
+static void preempt_start(struct worker *worker)
+{
+  (void)worker;
+}
+
+#endif
+
+// WORKERS ---------------------------------------------------------------------
+
+static void *worker_main(void *arg)
+{
+  struct worker *worker = arg;
+  int preempted = 0;
+  self_worker = worker;
+
+  if (preempt_usec > 0) {
+    preempt_start(worker);
+  }
+
+  while (1) {
+    struct uthread *uthread = worker_next(worker, preempted);
+    if (!uthread) {
+      worker_idle();
+      continue;
+    }
+
+    uthread->state = UTHREAD_RUNNING;
+    worker->current = uthread;
+    swapcontext(&worker->context, &uthread->context);
+    worker->current = NULL;
+    preempted = worker->action == WORKER_PREEMPT;
+
+    // the user thread's context is now saved, so it is safe to let it be
+    // resumed by another worker
+    switch (worker->action) {
+      case WORKER_YIELD:
+        cs_release(uthread);
+        runq_push(uthread);
+        break;
+      case WORKER_PREEMPT:
+        runq_push(uthread);
+        break;
+      case WORKER_BLOCK:
+      case WORKER_EXIT:
+        // the user thread switched away from inside the critical section,
+        // which we release on its behalf: from now on it can be woken up or
+        // joined
+        cs_release(uthread);
+        break;
+    }
+  }
+
+  return NULL;
+}
+
+// entry point of every user thread
+static void uthread_start(void)
+{
+  struct uthread *uthread = get_current();
+  uthread_exit(uthread->func(uthread->arg));
+}
+
+// USER THREAD FUNCTIONS -------------------------------------------------------
+
+int uthread_init(int nworkers)
+{
+  if (nworkers < 0) {
+    return -1;
+  }
+
+  pthread_mutex_lock(&init_lock);
+  if (started) {
+    pthread_mutex_unlock(&init_lock);
+    return -1;
+  }
+
+  if (preempt_usec > 0 && preempt_install() == -1) {
+    pthread_mutex_unlock(&init_lock);
+    return -1;
+  }
+
+  if (nworkers == 0) {
+    nworkers = sysconf(_SC_NPROCESSORS_ONLN);
+    if (nworkers < 1) {
+      nworkers = 1;
+    }
+  }
+
+  workers = calloc(nworkers, sizeof(struct worker*));
+  if (!workers) {
+    pthread_mutex_unlock(&init_lock);
+    return -1;
+  }
+
+  // all the workers must exist before any of them starts stealing
+  int i;
+  for (i = 0; i < nworkers; i++) {
+    workers[i] = calloc(1, sizeof(struct worker));
+    if (!workers[i]) {
+      break;
+    }
+    runq_init(&workers[i]->runq);
+    workers[i]->seed = i + 1;
+  }
+  __atomic_store_n(&worker_count, i, __ATOMIC_RELEASE);
+
+  // workers are never stopped, they are detached and live as long as the
+  // process
+  for (i = 0; i < worker_count; i++) {
+    if (pthread_create(&workers[i]->tid, NULL, worker_main, workers[i])) {
+      break;
+    }
+    pthread_detach(workers[i]->tid);
+  }
+
+  // as long as one worker started, user threads can run. The ones which
+  // didn't start keep an empty run queue
+  __atomic_store_n(&started, i > 0, __ATOMIC_RELEASE);
+  pthread_mutex_unlock(&init_lock);
+
+  return i > 0 ? 0 : -1;
+}
+
+int uthread_create(uthread_t *tid, uthread_func_t func, void *arg)
+{
+  if (!tid || !func) {
+    return -1;
+  }
+
+  if (!__atomic_load_n(&started, __ATOMIC_ACQUIRE)) {
+    // somebody else may have started the runtime in the meantime
+    if (uthread_init(0) == -1 &&
+        !__atomic_load_n(&started, __ATOMIC_ACQUIRE)) {
+      return -1;
+    }
+  }
+
+  struct uthread *uthread = calloc(1, sizeof(struct uthread));
+  if (!uthread) {
+    return -1;
+  }
+
+  // the lowest page of the stack is left inaccessible to catch overflows
+  uthread->stack = mmap(NULL, UTHREAD_STACK_SIZE, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+  if (uthread->stack == MAP_FAILED) {
+    free(uthread);
+    return -1;
+  }
+  mprotect(uthread->stack, getpagesize(), PROT_NONE);
+
+  getcontext(&uthread->context);
+  uthread->context.uc_stack.ss_sp = uthread->stack;
+  uthread->context.uc_stack.ss_size = UTHREAD_STACK_SIZE;
+  uthread->context.uc_link = NULL;
+  makecontext(&uthread->context, uthread_start, 0);
+
+  uthread->func = func;
+  uthread->arg = arg;
+
+  // a user thread must not be preempted while holding a run queue lock
+  *tid = uthread_id(uthread);
+  enter_critical_section();
+  runq_push(uthread);
+  exit_critical_section();
+  return 0;
+}
+
+int uthread_join(uthread_t tid, void **retval)
+{
+  struct uthread *uthread = uthread_from_id(tid);
+  if (!uthread) {
+    return -1;
+  }
+
+  enter_critical_section();
+  if (uthread->joined) {
+    exit_critical_section();
+    return -1;
+  }
+  uthread->joined = 1;
+
+  while (uthread->state != UTHREAD_EXITED) {
+    uthread->joiner = thread_self();
+    thread_block();
+  }
+  exit_critical_section();
+
+  // the thread's worker released the critical section after switching away
+  // from it for the last time, so nothing runs on its stack anymore
+  if (retval) {
+    *retval = uthread->retval;
+  }
+  munmap(uthread->stack, UTHREAD_STACK_SIZE);
+  free(uthread);
+
+  return 0;
+}
+
+void uthread_yield(void)
+{
+  struct uthread *uthread = get_current();
+  if (!uthread) {
+    sched_yield();
+    return;
+  }
+
+  // the switch must not be preempted, our worker releases the critical
+  // section once it is done
+  enter_critical_section();
+  uthread_switch(uthread, WORKER_YIELD);
+}
+
+int uthread_setpreempt(long usec)
+{
+  if (usec < 0) {
+    return -1;
+  }
+
+  pthread_mutex_lock(&init_lock);
+  if (started) {
+    pthread_mutex_unlock(&init_lock);
+    return -1;
+  }
+  preempt_usec = usec;
+  pthread_mutex_unlock(&init_lock);
+
+  return 0;
+}
+
+void uthread_exit(void *retval)
+{
+  struct uthread *uthread = get_current();
+  if (!uthread) {
+    pthread_exit(retval);
+  }
+
+  enter_critical_section();
+  uthread->retval = retval;
+  uthread->state = UTHREAD_EXITED;
+  if (uthread->joiner) {
+    thread_unblock(uthread->joiner);
+  }
+
+  // never resumed
+  uthread_switch(uthread, WORKER_EXIT);
+  abort();
+}
+
+// THREAD FUNCTIONS ------------------------------------------------------------
+
+pthread_t thread_self(void)
+{
+  struct uthread *uthread = get_current();
+  if (uthread) {
+    return uthread_id(uthread);
+  }
+
+  return pthread_self();
+}
+
+void thread_yield(void)
+{
+  uthread_yield();
+}
+
+void *thread_private(void)
+{
+  struct uthread *uthread = get_current();
+  if (uthread) {
+    return uthread->private;
+  }
+
+  return self_private;
+}
+
+int thread_block(void)
+{
+  struct uthread *uthread = get_current();
+  TRACE(TRACE_THREAD_BLOCK, NULL, 0);
+
+  if (uthread) {
+    // keep the critical section across the switch: our worker releases it
+    // once our context is saved, before anybody can unblock us
+    uthread->state = UTHREAD_BLOCKED;
+    uthread_switch(uthread, WORKER_BLOCK);
+
+    // we may be running on another worker now
+    enter_critical_section();
+    TRACE(TRACE_THREAD_RESUME, NULL, 0);
+    return 0;
+  }
+
+  // regular pthread: sleep on our own condition variable
+  struct blocked *node = &self_blocked;
+  if (!self_blocked_init) {
+    pthread_mutex_init(&node->lock, NULL);
+    pthread_cond_init(&node->cond, NULL);
+    self_blocked_init = 1;
+  }
+
+  node->tid = pthread_self();
+  node->woken = 0;
+  node->prev = NULL;
+  node->next = blocked_head;
+  if (blocked_head) {
+    blocked_head->prev = node;
+  }
+  blocked_head = node;
+
+  // holding our lock while leaving the critical section means that whoever
+  // unblocks us waits until we are actually waiting
+  pthread_mutex_lock(&node->lock);
+  exit_critical_section();
+  while (!node->woken) {
+    pthread_cond_wait(&node->cond, &node->lock);
+  }
+  pthread_mutex_unlock(&node->lock);
+
+  enter_critical_section();
+  TRACE(TRACE_THREAD_RESUME, NULL, 0);
+  return 0;
+}
+
+int thread_unblock(pthread_t tid)
+{
+  struct uthread *uthread = uthread_from_id(tid);
+
+  if (uthread) {
+    if (uthread->state != UTHREAD_BLOCKED) {
+      return -1;
+    }
+
+    runq_push(uthread);
+    TRACE(TRACE_THREAD_UNBLOCK, NULL, tid);
+    return 0;
+  }
+
+  struct blocked *node;
+  for (node = blocked_head; node; node = node->next) {
+    if (pthread_equal(node->tid, tid)) {
+      break;
+    }
+  }
+  if (!node) {
+    return -1;
+  }
+
+  if (node->prev) {
+    node->prev->next = node->next;
+  } else {
+    blocked_head = node->next;
+  }
+  if (node->next) {
+    node->next->prev = node->prev;
+  }
+
+  pthread_mutex_lock(&node->lock);
+  node->woken = 1;
+  pthread_cond_signal(&node->cond);
+  pthread_mutex_unlock(&node->lock);
+
+  TRACE(TRACE_THREAD_UNBLOCK, NULL, tid);
+  return 0;
+}
+
+void enter_critical_section(void)
+{
+  int *depth = get_cs_depth();
+
+  // counted before taking the lock, so that a user thread is never preempted
+  // while holding it
+  (*depth)++;
+  __atomic_signal_fence(__ATOMIC_SEQ_CST);
+  if (*depth == 1) {
+    pthread_mutex_lock(&cs_lock);
+  }
+}
+
+void exit_critical_section(void)
+{
+  int *depth = get_cs_depth();
+
+  if (*depth == 1) {
+    pthread_mutex_unlock(&cs_lock);
+  }
+  __atomic_signal_fence(__ATOMIC_SEQ_CST);
+  (*depth)--;
+
+  // carry out the preemption deferred while we were in the critical section
+  if (*depth == 0) {
+    struct uthread *uthread = get_current();
+    if (uthread && uthread->preempt_pending) {
+      uthread->preempt_pending = 0;
+      uthread_yield();
+    }
+  }
+}
@@ -9,10 +9,11 @@
  * By calling this function the current thread becomes blocked. It can only be
  * unblocked by another thread calling `thread_unblock()`.
  *
- * If this function is called in a critical section (i.e. within a block of code
- * located after a call to 'enter_critical_section()'), it will exit the
- * critical section before going to sleep and re-enter the critical section upon
- * wake-up.
+ * This function must be called in a critical section (i.e. within a block of
+ * code located after a call to 'enter_critical_section()'), entered once. It
+ * will exit the critical section before going to sleep and re-enter the
+ * critical section upon wake-up. A blocked thread may also be woken up
+ * spuriously, so callers must check the condition they wait for again.
  *
  * Return: -1 in case of failure, 0 otherwise
  */
@@ -29,6 +30,41 @@ int thread_block(void);
  */
 int thread_unblock(pthread_t tid);
 
+/*
+ * thread_self - Get ID of calling thread
+ *
+ * Return: ID of the calling user thread (see uthread.h) if called from one,
+ * pthread_self() otherwise. This is the ID to pass to thread_unblock() in order
+ * to wake the calling thread up.
+ */
+pthread_t thread_self(void);
+
+/*
+ * thread_yield - Yield the CPU
+ *
+ * Let other threads run: other user threads if called from a user thread, any
+ * other kernel thread otherwise.
+ */
+void thread_yield(void);
+
+/*
+ * Size of the area returned by thread_private()
+ */
+#define THREAD_PRIVATE_SIZE 64
+
+/*
+ * thread_private - Get calling thread's private area
+ *
+ * Return a zero-initialized area of THREAD_PRIVATE_SIZE bytes which belongs to
+ * the calling thread, user thread or pthread, for the internal use of
+ * libuthread (priority semaphores keep their per-thread state there). Unlike
+ * a __thread variable, the area of a user thread follows it when it moves
+ * from one worker to another.
+ *
+ * Return: Address of the private area of the calling thread.
+ */
+void *thread_private(void);
+
 /*
  * enter_critical_section - Enter critical section
  *
@@ -0,0 +1,219 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "thread.h"
+#include "timer.h"
+
+// min-heap of armed timers, ordered by deadline. Only accessed from inside a
+// critical section
+static struct timer **heap = NULL;
+static int heap_size = 0;
+static int heap_capacity = 0;
+
+// the timer thread sleeps on its own lock so that it doesn't hold the critical
+// section while waiting. Arming a timer which becomes the earliest one sets
+// kick so that the timer thread recomputes how long to sleep
+static pthread_mutex_t timer_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t timer_cond = PTHREAD_COND_INITIALIZER;
+static int timer_kick = 0;
+static int timer_thread_started = 0;
+
+// HELPER FUNCTIONS ------------------------------------------------------------
+
+int timespec_cmp(const struct timespec *a, const struct timespec *b)
+{
+  if (a->tv_sec != b->tv_sec) {
+    return a->tv_sec < b->tv_sec ? -1 : 1;
+  }
+
+  if (a->tv_nsec != b->tv_nsec) {
+    return a->tv_nsec < b->tv_nsec ? -1 : 1;
+  }
+
+  return 0;
+}
+
+static void heap_set(int index, struct timer *timer)
+{
+  heap[index] = timer;
+  timer->index = index;
+}
+
+static void heap_sift_up(int index)
+{
+  struct timer *timer = heap[index];
+
+  while (index > 0) {
+    int parent = (index - 1) / 2;
+    if (timespec_cmp(&heap[parent]->deadline, &timer->deadline) <= 0) {
+      break;
+    }
+
+    heap_set(index, heap[parent]);
+    index = parent;
+  }
+
+  heap_set(index, timer);
+}
+
+static void heap_sift_down(int index)
+{
+  struct timer *timer = heap[index];
+
+  while (1) {
+    int child = 2 * index + 1;
+    if (child >= heap_size) {
+      break;
+    }
+
+    // pick the earliest of the two children
+    if (child + 1 < heap_size &&
+        timespec_cmp(&heap[child + 1]->deadline, &heap[child]->deadline) < 0) {
+      child++;
+    }
+
+    if (timespec_cmp(&timer->deadline, &heap[child]->deadline) <= 0) {
+      break;
+    }
+
+    heap_set(index, heap[child]);
+    index = child;
+  }
+
+  heap_set(index, timer);
+}
+
+// remove the timer at position index in the heap
+static void heap_remove(int index)
+{
+  struct timer *timer = heap[index];
+  struct timer *last = heap[--heap_size];
+
+  timer->index = -1;
+  if (index == heap_size) {
+    return;
+  }
+
+  // move the last timer into the hole and restore the heap property
+  heap_set(index, last);
+  heap_sift_up(index);
+  heap_sift_down(last->index);
+}
+
+// TIMER THREAD ----------------------------------------------------------------
+
+static void *timer_thread(void *arg)
+{
+  while (1) {
+    struct timespec now, next;
+    int armed = 0;
+
+    // fire all the expired timers
+    enter_critical_section();
+    clock_gettime(CLOCK_REALTIME, &now);
+    while (heap_size > 0 && timespec_cmp(&heap[0]->deadline, &now) <= 0) {
+      struct timer *timer = heap[0];
+      heap_remove(0);
+      timer->func(timer);
+    }
+
+    if (heap_size > 0) {
+      next = heap[0]->deadline;
+      armed = 1;
+    }
+    exit_critical_section();
+
+    // sleep until the next deadline, or until a timer expiring earlier is
+    // armed in the meantime
+    pthread_mutex_lock(&timer_lock);
+    if (!timer_kick) {
+      if (armed) {
+        pthread_cond_timedwait(&timer_cond, &timer_lock, &next);
+      } else {
+        pthread_cond_wait(&timer_cond, &timer_lock);
+      }
+    }
+    timer_kick = 0;
+    pthread_mutex_unlock(&timer_lock);
+  }
+
+  return NULL;
+}
+
+static int timer_thread_start(void)
+{
+  pthread_t tid;
+  pthread_attr_t attr;
+
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  int ret = pthread_create(&tid, &attr, timer_thread, NULL);
+  pthread_attr_destroy(&attr);
+  if (ret != 0) {
+    return -1;
+  }
+
+  timer_thread_started = 1;
+  return 0;
+}
+
+// TIMER FUNCTIONS -------------------------------------------------------------
+
+void timer_init(struct timer *timer, const struct timespec *deadline,
+                void (*func)(struct timer *timer))
+{
+  timer->deadline = *deadline;
+  timer->func = func;
+  timer->index = -1;
+}
+
+int timer_add(struct timer *timer)
+{
+  if (timer == NULL || timer->index != -1) {
+    return -1;
+  }
+
+  // the timer thread is only started the first time somebody needs it
+  if (!timer_thread_started && timer_thread_start() == -1) {
+    return -1;
+  }
+
+  // grow the heap if necessary
+  if (heap_size == heap_capacity) {
+    int capacity = heap_capacity ? heap_capacity * 2 : 64;
+    struct timer **new_heap = realloc(heap, capacity * sizeof(*heap));
+    if (new_heap == NULL) {
+      return -1;
+    }
+
+    heap = new_heap;
+    heap_capacity = capacity;
+  }
+
+  heap_set(heap_size++, timer);
+  heap_sift_up(timer->index);
+
+  // only wake up the timer thread if it now has to wake up earlier
+  if (timer->index == 0) {
+    pthread_mutex_lock(&timer_lock);
+    timer_kick = 1;
+    pthread_cond_signal(&timer_cond);
+    pthread_mutex_unlock(&timer_lock);
+  }
+
+  return 0;
+}
+
+int timer_cancel(struct timer *timer)
+{
+  if (timer == NULL) {
+    return -1;
+  }
+
+  if (timer->index != -1) {
+    heap_remove(timer->index);
+  }
+
+  return 0;
+}
@@ -0,0 +1,66 @@
+#ifndef _TIMER_H
+#define _TIMER_H
+
+#include <time.h>
+
+/*
+ * struct timer - One-shot timer
+ * @deadline: Absolute expiration time (CLOCK_REALTIME)
+ * @func: Function called when the timer expires
+ * @index: Position of the timer in the timer heap, -1 when not armed
+ *
+ * Timers are typically embedded in a larger structure living on the stack of
+ * a blocked thread. They are all served by a single timer thread which keeps
+ * them in a binary min-heap ordered by deadline, so arming and cancelling a
+ * timer are O(log n) no matter how many timers are armed.
+ *
+ * @func is called from the timer thread, inside a critical section (see
+ * enter_critical_section()). The timer is already disarmed at that point.
+ */
+struct timer {
+  struct timespec deadline;
+  void (*func)(struct timer *timer);
+  int index;
+};
+
+/*
+ * timer_init - Initialize a timer
+ * @timer: Timer to initialize
+ * @deadline: Absolute expiration time
+ * @func: Function to call upon expiration
+ */
+void timer_init(struct timer *timer, const struct timespec *deadline,
+                void (*func)(struct timer *timer));
+
+/*
+ * timer_add - Arm a timer
+ * @timer: Timer to arm
+ *
+ * Must be called from inside a critical section.
+ *
+ * Return: -1 if @timer is NULL or already armed, or in case of failure when
+ * allocating memory for the timer heap or starting the timer thread. 0 if
+ * @timer was successfully armed.
+ */
+int timer_add(struct timer *timer);
+
+/*
+ * timer_cancel - Disarm a timer
+ * @timer: Timer to disarm
+ *
+ * Must be called from inside a critical section. Cancelling a timer which
+ * already expired is allowed and does nothing.
+ *
+ * Return: -1 if @timer is NULL. 0 otherwise.
+ */
+int timer_cancel(struct timer *timer);
+
+/*
+ * timespec_cmp - Compare two timespecs
+ *
+ * Return: negative, zero or positive if @a is respectively before, equal to or
+ * after @b.
+ */
+int timespec_cmp(const struct timespec *a, const struct timespec *b);
+
+#endif /* _TIMER_H */
@@ -1,4 +1,6 @@
+#define _GNU_SOURCE
 #include <assert.h>
+#include <fcntl.h>
 #include <pthread.h>
 #include <signal.h>
 #include <stdint.h>
@@ -6,23 +8,72 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
 #include <math.h>
 
+#include "page.h"
 #include "queue.h"
 #include "thread.h"
 #include "tps.h"
+#include "trace.h"
 
 struct tps
 {
   pthread_t owner_tid;
   void* data;
   int is_reference; // whether this tps is referencing another thread's tps data
+  int is_remote; // whether that thread is in another process
+  ssize_t slot; // slot of data in the shared memory object, -1 if none
+  queue_handle_t handle; // to remove the tps from tps_list without searching
 };
 
 // overload the usage of a queue for storing our tps list
 queue_t tps_list = NULL;
 
+// in shared mode, the areas of our threads are slots of a shared memory object
+// named after our process ID, which other processes can map
+#define TPS_SHM_NAME "/uthread-tps.%d"
+#define TPS_SHM_NAME_MAX 32
+
+static int shm_fd = -1;
+
+// free slots, used as a stack. Protected by the critical section
+static size_t* free_slots;
+static size_t nfree_slots;
+
+#define TPS_CACHE_LINE 64
+
+// a version of the broadcast region. Its area is a tps owned by no thread,
+// which is never in tps_list
+struct tps_version
+{
+  struct tps tps;
+  size_t length;
+  uint64_t retired; // epoch at which this version was replaced
+  struct tps_version* next; // in the list of replaced versions
+};
+
+// readers are on their own cache line, since each of them is written by its
+// thread every time it starts and stops reading
+struct tps_reader
+{
+  uint64_t epoch; // epoch when the reader started reading, 0 if not reading
+  unsigned int depth; // nested tps_broadcast_enter calls
+  struct tps_reader* prev;
+  struct tps_reader* next;
+} __attribute__((aligned(TPS_CACHE_LINE)));
+
+// current version of the broadcast region, and current epoch, which is
+// incremented every time a version is replaced
+static struct tps_version* broadcast = NULL;
+static uint64_t broadcast_epoch = 1;
+
+// all the readers, and the versions replaced but not reclaimed yet. Protected
+// by the critical section
+static struct tps_reader* readers = NULL;
+static struct tps_version* retired = NULL;
+
 // HELPER FUNCTIONS ------------------------------------------------------------
 
 // callback function that finds a certain item according to its owner thread id
@@ -96,6 +147,74 @@ static int tps_io_check(size_t offset, size_t length, char* buffer)
   return 1;
 }
 
+static void tps_shm_name(char* name, pid_t pid)
+{
+  snprintf(name, TPS_SHM_NAME_MAX, TPS_SHM_NAME, (int)pid);
+}
+
+static void tps_shm_unlink(void)
+{
+  char name[TPS_SHM_NAME_MAX];
+  tps_shm_name(name, getpid());
+  shm_unlink(name);
+}
+
+// map a new zero-filled area with protection prot: a slot of the shared memory
+// object in shared mode, anonymous memory otherwise. Returns MAP_FAILED on
+// failure
+static void* tps_map_area(int prot, ssize_t* slot)
+{
+  *slot = -1;
+
+  // MAP_ANONYMOUS: This flag tells the system to create an anonymous mapping,
+  // not connected to a file. filedes and offset are ignored, and the region is
+  // initialized with zeros.
+  //
+  // MAP_PRIVATE: a copy is made for th eprocess and no other process will see
+  // the changes.
+  //
+  // mmap already fills the data region with zeros so no need to do that.
+  if (shm_fd == -1) {
+    return mmap(NULL, TPS_SIZE, prot, MAP_PRIVATE|MAP_ANONYMOUS, 0, 0);
+  }
+
+  enter_critical_section();
+  if (nfree_slots > 0) {
+    *slot = free_slots[--nfree_slots];
+  }
+  exit_critical_section();
+  if (*slot == -1) {
+    return MAP_FAILED;
+  }
+
+  // slots are zero-filled until written, and punched back to zeros when freed
+  void* data = mmap(NULL, TPS_SIZE, prot, MAP_SHARED, shm_fd,
+                    (off_t)*slot * TPS_SIZE);
+  if (data == MAP_FAILED) {
+    enter_critical_section();
+    free_slots[nfree_slots++] = *slot;
+    exit_critical_section();
+    *slot = -1;
+  }
+
+  return data;
+}
+
+// give the slot of an area back, zeroing it and freeing its memory
+static void tps_free_slot(ssize_t slot)
+{
+  if (slot == -1) {
+    return;
+  }
+
+  fallocate(shm_fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+            (off_t)slot * TPS_SIZE, TPS_SIZE);
+
+  enter_critical_section();
+  free_slots[nfree_slots++] = slot;
+  exit_critical_section();
+}
+
 // change protection on a particular tps. Returns 1 on success, 0 otherwise.
 static int tps_mmap_set_prot(struct tps* tps, int prot)
 {
@@ -126,6 +245,33 @@ static int tps_disable_read_write(struct tps* tps)
   return tps_mmap_set_prot(tps, PROT_NONE);
 }
 
+// unmap the replaced versions which readers can't be using anymore: a reader
+// which started reading at an epoch gets a version which was current then, or
+// a later one. Must be called inside the critical section
+static void broadcast_reclaim(void)
+{
+  uint64_t oldest = UINT64_MAX;
+  struct tps_reader* reader;
+  for (reader = readers; reader; reader = reader->next) {
+    uint64_t epoch = __atomic_load_n(&reader->epoch, __ATOMIC_SEQ_CST);
+    if (epoch != 0 && epoch < oldest) {
+      oldest = epoch;
+    }
+  }
+
+  struct tps_version** link = &retired;
+  while (*link) {
+    struct tps_version* version = *link;
+    if (version->retired <= oldest) {
+      *link = version->next;
+      munmap(version->tps.data, TPS_SIZE);
+      free(version);
+    } else {
+      link = &version->next;
+    }
+  }
+}
+
 // TPS LIBRARY FUNCTIONS -------------------------------------------------------
 
 static void segv_handler(int sig, siginfo_t *si, void *context)
@@ -139,9 +285,17 @@ static void segv_handler(int sig, siginfo_t *si, void *context)
   struct tps* tps = NULL;
   queue_iterate(tps_list, addr_in_tps, &p_fault, (void**)&tps);
 
+  // the broadcast region is read-only for everybody
+  struct tps_version* version = broadcast;
+  if (tps == NULL && version != NULL && p_fault == version->tps.data) {
+    tps = &version->tps;
+  }
+
   // found a tps that has p_fault in its data range
   if (tps != NULL) {
     fprintf(stderr, "TPS protection error!\n");
+    TRACE(TRACE_TPS_FAULT, p_fault, 0);
+    trace_crash();
   }
 
   // in any case, restore the default signal handlers
@@ -177,48 +331,90 @@ int tps_init(int segv)
   return 0;
 }
 
+int tps_init_shared(int segv, size_t nslots)
+{
+  if (tps_list != NULL || nslots == 0) {
+    return -1;
+  }
+
+  free_slots = malloc(nslots * sizeof(size_t));
+  if (free_slots == NULL) {
+    return -1;
+  }
+
+  // lowest slots first
+  for (nfree_slots = 0; nfree_slots < nslots; nfree_slots++) {
+    free_slots[nfree_slots] = nslots - 1 - nfree_slots;
+  }
+
+  // a leftover object of a previous process with our ID is replaced
+  char name[TPS_SHM_NAME_MAX];
+  tps_shm_name(name, getpid());
+  shm_unlink(name);
+
+  shm_fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (shm_fd == -1) {
+    free(free_slots);
+    return -1;
+  }
+
+  if (ftruncate(shm_fd, (off_t)nslots * TPS_SIZE) == -1) {
+    close(shm_fd);
+    shm_unlink(name);
+    shm_fd = -1;
+    free(free_slots);
+    return -1;
+  }
+
+  atexit(tps_shm_unlink);
+  return tps_init(segv);
+}
+
 int tps_create(void)
 {
-  pthread_t tid = pthread_self();
+  pthread_t tid = thread_self();
 
   // can't create a tps for a thread that already has one
   if (has_tps(tid)) {
     return -1;
   }
 
-  // MAP_ANONYMOUS: This flag tells the system to create an anonymous mapping,
-  // not connected to a file. filedes and offset are ignored, and the region is
-  // initialized with zeros.
-  //
-  // MAP_PRIVATE: a copy is made for th eprocess and no other process will see
-  // the changes.
-  //
-  // mmap already fills the data region with zeros so no need to do that.
-  void* data = mmap(NULL, TPS_SIZE, PROT_NONE, MAP_PRIVATE|MAP_ANONYMOUS, 0, 0);
+  ssize_t slot;
+  void* data = tps_map_area(PROT_NONE, &slot);
   if (data == MAP_FAILED) {
     return -1;
   }
 
   // create storage for the tps
   struct tps* tps = malloc(sizeof(struct tps));
+  if (tps == NULL) {
+    munmap(data, TPS_SIZE);
+    tps_free_slot(slot);
+    return -1;
+  }
   memset(tps, 0, sizeof(struct tps));
 
   tps->owner_tid = tid;
   tps->data = data;
   tps->is_reference = 0;
+  tps->slot = slot;
 
   // add the tps to the tps list
-  int ret = queue_enqueue(tps_list, tps);
+  int ret = queue_enqueue_handle(tps_list, tps, &tps->handle);
   if (ret == -1) {
+    munmap(data, TPS_SIZE);
+    tps_free_slot(slot);
+    free(tps);
     return -1;
   }
 
+  TRACE(TRACE_TPS_CREATE, data, 0);
   return 0;
 }
 
 int tps_destroy(void)
 {
-  pthread_t tid = pthread_self();
+  pthread_t tid = thread_self();
   struct tps* tps = get_tps(tid);
 
   // can't destroy a tps that doesn't exist
@@ -226,16 +422,23 @@ int tps_destroy(void)
     return -1;
   }
 
-  int ret = queue_delete(tps_list, tps);
+  int ret = queue_remove_handle(tps_list, tps->handle);
   if (ret == -1) {
     return -1;
   }
 
-  // munmap is the mmap equivalent of free
-  ret = munmap(tps->data, TPS_SIZE);
-  if (ret == -1) {
-    return -1;
+  TRACE(TRACE_TPS_DESTROY, tps->data, 0);
+
+  // a reference to another thread's data of this process isn't ours to unmap,
+  // while a reference to another process's data is our own mapping of it
+  if (!tps->is_reference || tps->is_remote) {
+    // munmap is the mmap equivalent of free
+    ret = munmap(tps->data, TPS_SIZE);
+    if (ret == -1) {
+      return -1;
+    }
   }
+  tps_free_slot(tps->slot);
 
   free(tps);
   return 0;
@@ -243,7 +446,7 @@ int tps_destroy(void)
 
 int tps_read(size_t offset, size_t length, char *buffer)
 {
-  pthread_t tid = pthread_self();
+  pthread_t tid = thread_self();
 
   // do basic sanity checks that input is valid
   int ret = tps_io_check(offset, length, buffer);
@@ -272,7 +475,7 @@ int tps_read(size_t offset, size_t length, char *buffer)
 
 int tps_write(size_t offset, size_t length, char *buffer)
 {
-  pthread_t tid = pthread_self();
+  pthread_t tid = thread_self();
 
   // do basic sanity checks that input is valid
   int ret = tps_io_check(offset, length, buffer);
@@ -293,25 +496,38 @@ int tps_write(size_t offset, size_t length, char *buffer)
       return -1;
     }
 
-    // create new memory now that we are trying to write
-    void* data = mmap(NULL, TPS_SIZE, PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, 0, 0);
+    // create new memory now that we are trying to write. Running out of slots
+    // in shared memory is routine, and must not leave the referenced data
+    // readable
+    ssize_t slot;
+    void* data = tps_map_area(PROT_WRITE, &slot);
     if (data == MAP_FAILED) {
+      tps_disable_read_write(tps);
       return -1;
     }
 
     // copy the data over
-    memcpy(data, tps->data, TPS_SIZE);
+    page_copy(data, tps->data);
 
-    // disable reads from the referenced tps data
+    // disable reads from the referenced tps data, or drop our mapping of it if
+    // it belongs to another process
     if (!tps_disable_read_write(tps)) {
+      munmap(data, TPS_SIZE);
+      tps_free_slot(slot);
       return -1;
     }
+    if (tps->is_remote) {
+      munmap(tps->data, TPS_SIZE);
+    }
 
     // update current tps with the new data region
+    TRACE(TRACE_TPS_COW, data, (uintptr_t)tps->data);
     tps->data = data;
+    tps->slot = slot;
 
     // we no longer have a reference
     tps->is_reference = 0;
+    tps->is_remote = 0;
 
     // new data region we just made purposely has write permissions left enabled
     // so that the following code can write into it
@@ -341,7 +557,7 @@ int tps_clone(pthread_t tid)
     return -1;
   }
 
-  pthread_t self = pthread_self();
+  pthread_t self = thread_self();
 
   // cannot overwrite our tps if we already have one
   if (has_tps(self)) {
@@ -356,12 +572,298 @@ int tps_clone(pthread_t tid)
   self_tps->owner_tid = self;
   self_tps->data = target_tps->data; // reference it for now, do memcpy on write
   self_tps->is_reference = 1;
+  self_tps->slot = -1;
 
   // add the tps to the tps list
-  int ret = queue_enqueue(tps_list, self_tps);
+  int ret = queue_enqueue_handle(tps_list, self_tps, &self_tps->handle);
+  if (ret == -1) {
+    return -1;
+  }
+
+  TRACE(TRACE_TPS_CLONE, self_tps->data, tid);
+  return 0;
+}
+
+int tps_compare(pthread_t tid1, pthread_t tid2)
+{
+  struct tps* tps1 = get_tps(tid1);
+  struct tps* tps2 = get_tps(tid2);
+  if (tps1 == NULL || tps2 == NULL) {
+    return -1;
+  }
+
+  // a clone which was never written to shares its page
+  if (tps1->data == tps2->data) {
+    return 0;
+  }
+
+  // nothing stops the owners from touching their pages meanwhile: tps.h asks
+  // them not to
+  if (!tps_enable_read(tps1) || !tps_enable_read(tps2)) {
+    tps_disable_read_write(tps1);
+    return -1;
+  }
+
+  int equal = page_equal(tps1->data, tps2->data);
+
+  if (!tps_disable_read_write(tps1) || !tps_disable_read_write(tps2)) {
+    return -1;
+  }
+
+  return !equal;
+}
+
+int tps_snapshot(char *snapshot)
+{
+  struct tps* tps = get_tps(thread_self());
+  if (tps == NULL || snapshot == NULL) {
+    return -1;
+  }
+
+  if (!tps_enable_read(tps)) {
+    return -1;
+  }
+
+  page_copy(snapshot, tps->data);
+
+  if (!tps_disable_read_write(tps)) {
+    return -1;
+  }
+
+  return 0;
+}
+
+ssize_t tps_diff(const char *snapshot, struct tps_range *ranges, size_t max)
+{
+  struct tps* tps = get_tps(thread_self());
+  if (tps == NULL || snapshot == NULL || (ranges == NULL && max > 0)) {
+    return -1;
+  }
+
+  if (!tps_enable_read(tps)) {
+    return -1;
+  }
+
+  size_t count = page_diff(snapshot, tps->data, ranges, max);
+
+  if (!tps_disable_read_write(tps)) {
+    return -1;
+  }
+
+  return count;
+}
+
+ssize_t tps_slot(void)
+{
+  struct tps* tps = get_tps(thread_self());
+  if (tps == NULL) {
+    return -1;
+  }
+
+  return tps->slot;
+}
+
+// map the area in slot of the shared memory object of process pid, read-only
+static void* tps_map_remote(pid_t pid, size_t slot, int prot)
+{
+  char name[TPS_SHM_NAME_MAX];
+  tps_shm_name(name, pid);
+
+  int fd = shm_open(name, O_RDONLY, 0);
+  if (fd == -1) {
+    return MAP_FAILED;
+  }
+
+  // the slot must exist, or accessing the mapping would raise SIGBUS
+  struct stat st;
+  void* data = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && (off_t)(slot + 1) * TPS_SIZE <= st.st_size) {
+    data = mmap(NULL, TPS_SIZE, prot, MAP_SHARED, fd, (off_t)slot * TPS_SIZE);
+  }
+
+  // the mapping stays valid once the descriptor is closed
+  close(fd);
+  return data;
+}
+
+const char *tps_map(pid_t pid, size_t slot)
+{
+  void* data = tps_map_remote(pid, slot, PROT_READ);
+  if (data == MAP_FAILED) {
+    return NULL;
+  }
+
+  return data;
+}
+
+int tps_unmap(const char *data)
+{
+  if (data == NULL) {
+    return -1;
+  }
+
+  return munmap((void*)data, TPS_SIZE);
+}
+
+int tps_clone_remote(pid_t pid, size_t slot)
+{
+  pthread_t self = thread_self();
+
+  // cannot overwrite our tps if we already have one
+  if (has_tps(self)) {
+    return -1;
+  }
+
+  // reference the area of the other process, copied into our own on write
+  void* data = tps_map_remote(pid, slot, PROT_NONE);
+  if (data == MAP_FAILED) {
+    return -1;
+  }
+
+  struct tps* self_tps = malloc(sizeof(struct tps));
+  if (self_tps == NULL) {
+    munmap(data, TPS_SIZE);
+    return -1;
+  }
+  memset(self_tps, 0, sizeof(struct tps));
+
+  self_tps->owner_tid = self;
+  self_tps->data = data;
+  self_tps->is_reference = 1;
+  self_tps->is_remote = 1;
+  self_tps->slot = -1;
+
+  int ret = queue_enqueue_handle(tps_list, self_tps, &self_tps->handle);
   if (ret == -1) {
+    munmap(data, TPS_SIZE);
+    free(self_tps);
     return -1;
   }
 
+  TRACE(TRACE_TPS_CLONE, data, pid);
+  return 0;
+}
+
+tps_reader_t tps_reader_create(void)
+{
+  struct tps_reader* reader;
+  if (posix_memalign((void**)&reader, TPS_CACHE_LINE,
+                     sizeof(struct tps_reader))) {
+    return NULL;
+  }
+  memset(reader, 0, sizeof(struct tps_reader));
+
+  enter_critical_section();
+  reader->next = readers;
+  if (readers) {
+    readers->prev = reader;
+  }
+  readers = reader;
+  exit_critical_section();
+
+  return reader;
+}
+
+int tps_reader_destroy(tps_reader_t reader)
+{
+  if (reader == NULL || reader->depth > 0) {
+    return -1;
+  }
+
+  enter_critical_section();
+  if (reader->prev) {
+    reader->prev->next = reader->next;
+  } else {
+    readers = reader->next;
+  }
+  if (reader->next) {
+    reader->next->prev = reader->prev;
+  }
+  exit_critical_section();
+
+  free(reader);
+  return 0;
+}
+
+const char *tps_broadcast_enter(tps_reader_t reader, size_t *length)
+{
+  if (reader == NULL) {
+    return NULL;
+  }
+
+  // announce the epoch we start reading at before getting the current
+  // version: a version replaced after we read the epoch is kept for us
+  if (reader->depth++ == 0) {
+    uint64_t epoch = __atomic_load_n(&broadcast_epoch, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&reader->epoch, epoch, __ATOMIC_SEQ_CST);
+  }
+
+  struct tps_version* version = __atomic_load_n(&broadcast, __ATOMIC_SEQ_CST);
+  if (version == NULL) {
+    tps_broadcast_exit(reader);
+    return NULL;
+  }
+
+  if (length) {
+    *length = version->length;
+  }
+  return version->tps.data;
+}
+
+int tps_broadcast_exit(tps_reader_t reader)
+{
+  if (reader == NULL || reader->depth == 0) {
+    return -1;
+  }
+
+  if (--reader->depth == 0) {
+    __atomic_store_n(&reader->epoch, 0, __ATOMIC_RELEASE);
+  }
+  return 0;
+}
+
+int tps_broadcast_publish(size_t length, char *buffer)
+{
+  if (length > TPS_SIZE || buffer == NULL) {
+    return -1;
+  }
+
+  struct tps_version* version = malloc(sizeof(struct tps_version));
+  if (version == NULL) {
+    return -1;
+  }
+  memset(version, 0, sizeof(struct tps_version));
+
+  // fill in the new version, then leave it read-only
+  void* data = mmap(NULL, TPS_SIZE, PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, 0, 0);
+  if (data == MAP_FAILED) {
+    free(version);
+    return -1;
+  }
+  version->tps.data = data;
+  version->length = length;
+  memcpy(data, buffer, length);
+
+  if (!tps_enable_read(&version->tps)) {
+    munmap(data, TPS_SIZE);
+    free(version);
+    return -1;
+  }
+
+  // switch readers to the new version, then start a new epoch: readers which
+  // started reading before it may still be using the previous version
+  enter_critical_section();
+  struct tps_version* previous = broadcast;
+  __atomic_store_n(&broadcast, version, __ATOMIC_SEQ_CST);
+  if (previous) {
+    previous->retired = __atomic_add_fetch(&broadcast_epoch, 1,
+                                           __ATOMIC_SEQ_CST);
+    previous->next = retired;
+    retired = previous;
+  }
+  broadcast_reclaim();
+  exit_critical_section();
+
+  TRACE(TRACE_TPS_PUBLISH, data, length);
   return 0;
 }
@@ -24,6 +24,33 @@
  */
 int tps_init(int segv);
 
+/*
+ * struct tps_range - Range of bytes of a TPS
+ * @offset: Offset of the first byte of the range
+ * @length: Number of bytes of the range
+ */
+struct tps_range {
+  size_t offset;
+  size_t length;
+};
+
+/*
+ * tps_init_shared - Initialize TPS in shared memory
+ * @segv - Activate segfault handler
+ * @nslots - Maximum number of TPS areas
+ *
+ * Initialize TPS API like tps_init(), but keep the TPS areas of this process
+ * in @nslots slots of a POSIX shared memory object named after the process ID
+ * ("/uthread-tps.<pid>"), so that other processes can map them with tps_map()
+ * or clone them with tps_clone_remote(). The shared memory object is removed
+ * when the process exits.
+ *
+ * Return: -1 if TPS API has already been initialized, if @nslots is 0, or in
+ * case of failure when creating the shared memory object. 0 if the TPS API was
+ * successfully initialized.
+ */
+int tps_init_shared(int segv, size_t nslots);
+
 /*
  * tps_create - Create TPS
  *
@@ -91,4 +118,170 @@ int tps_write(size_t offset, size_t length, char *buffer);
  */
 int tps_clone(pthread_t tid);
 
+/*
+ * tps_compare - Compare TPS of two threads
+ * @tid1, @tid2: TIDs of the threads whose TPS to compare
+ *
+ * Both TPS are made readable during the comparison and protected again after,
+ * without any synchronization with their owners. Neither TPS may be accessed
+ * by another thread while the call is in progress, or that access may fault.
+ *
+ * Return: -1 if thread @tid1 or thread @tid2 doesn't have a TPS, or in case of
+ * failure. 0 if both TPS hold the same data, 1 if they differ.
+ */
+int tps_compare(pthread_t tid1, pthread_t tid2);
+
+/*
+ * tps_snapshot - Take a snapshot of TPS
+ * @snapshot: Buffer of TPS_SIZE bytes receiving the snapshot
+ *
+ * Copy the whole TPS of the current thread into @snapshot, for tps_diff() to
+ * later find what changed since then.
+ *
+ * Return: -1 if current thread doesn't have a TPS, if @snapshot is NULL, or in
+ * case of failure. 0 if the snapshot was successfully taken.
+ */
+int tps_snapshot(char *snapshot);
+
+/*
+ * tps_diff - Find changes to TPS
+ * @snapshot: Buffer of TPS_SIZE bytes to compare the TPS with, usually taken
+ * by tps_snapshot()
+ * @ranges: Array receiving the ranges of bytes which changed, in order
+ * @max: Number of entries of @ranges
+ *
+ * Compare the TPS of the current thread with @snapshot, and report the bytes
+ * which differ as a list of ranges, adjacent bytes forming one range. Applying
+ * the bytes of the ranges to @snapshot turns it into a copy of the TPS.
+ *
+ * Return: -1 if current thread doesn't have a TPS, if @snapshot is NULL, if
+ * @ranges is NULL while @max isn't 0, or in case of failure. Otherwise, number
+ * of ranges of bytes which changed, which are only all stored into @ranges if
+ * they are no more than @max.
+ */
+ssize_t tps_diff(const char *snapshot, struct tps_range *ranges, size_t max);
+
+/*
+ * tps_slot - Get slot of TPS
+ *
+ * Get the slot holding the current thread's TPS area in the shared memory
+ * object of the process, to be passed to tps_map() or tps_clone_remote() by
+ * other processes.
+ *
+ * Return: -1 if the TPS API wasn't initialized with tps_init_shared(), if
+ * current thread doesn't have a TPS, or if its TPS is a clone which still
+ * shares the memory page of the cloned TPS. Slot of the TPS otherwise.
+ */
+ssize_t tps_slot(void);
+
+/*
+ * tps_map - Map TPS of another process
+ * @pid: ID of the process, which initialized the TPS API with tps_init_shared()
+ * @slot: Slot of the TPS in process @pid
+ *
+ * Map the TPS area in slot @slot of process @pid, read-only. The mapping shows
+ * the writes of the other process as they happen, and is released with
+ * tps_unmap().
+ *
+ * Return: NULL if process @pid has no TPS shared memory object or no slot
+ * @slot, or in case of failure. Address of the mapped area otherwise.
+ */
+const char *tps_map(pid_t pid, size_t slot);
+
+/*
+ * tps_unmap - Unmap TPS of another process
+ * @data: Address returned by tps_map()
+ *
+ * Return: -1 if @data is NULL, or in case of failure. 0 if the area was
+ * successfully unmapped.
+ */
+int tps_unmap(const char *data);
+
+/*
+ * tps_clone_remote - Clone TPS of another process
+ * @pid: ID of the process, which initialized the TPS API with tps_init_shared()
+ * @slot: Slot of the TPS to clone in process @pid
+ *
+ * Clone the TPS area in slot @slot of process @pid, like tps_clone(): the new
+ * TPS maps the memory page of the other process, and gets its own copy on the
+ * first write.
+ *
+ * Return: -1 if process @pid has no TPS shared memory object or no slot @slot,
+ * if current thread already has a TPS, or in case of failure. 0 if TPS was
+ * successfully cloned.
+ */
+int tps_clone_remote(pid_t pid, size_t slot);
+
+/*
+ * Broadcast region
+ *
+ * A TPS area shared by all threads, for read-mostly data which every thread
+ * needs (e.g. configuration). Readers get a direct pointer to the current
+ * version, and reading costs neither a syscall nor a copy. A writer replaces
+ * the whole region at once by publishing a new version, and the versions
+ * replaced are unmapped once no reader can still be using them: each reader
+ * records the epoch at which it started reading, and a version replaced at a
+ * given epoch is reclaimed once all readers are past it.
+ */
+typedef struct tps_reader* tps_reader_t;
+
+/*
+ * tps_reader_create - Create a reader of the broadcast region
+ *
+ * Create a reader, through which a thread reads the broadcast region. A
+ * reader may only be used by one thread at a time.
+ *
+ * Return: Pointer to the reader. NULL in case of failure when allocating it.
+ */
+tps_reader_t tps_reader_create(void);
+
+/*
+ * tps_reader_destroy - Destroy a reader of the broadcast region
+ * @reader: Reader to destroy
+ *
+ * Return: -1 if @reader is NULL or is still reading. 0 if @reader was
+ * successfully destroyed.
+ */
+int tps_reader_destroy(tps_reader_t reader);
+
+/*
+ * tps_broadcast_enter - Start reading the broadcast region
+ * @reader: Reader
+ * @length: (Optional) Receives the length of the current version
+ *
+ * Get the current version of the broadcast region. The version stays mapped,
+ * and does not change, until the matching tps_broadcast_exit() even if a new
+ * version is published meanwhile. It is mapped read-only: writing to it is a
+ * TPS protection error. Calls can be nested.
+ *
+ * Return: NULL if @reader is NULL, or if no version was ever published.
+ * Address of the current version otherwise, to be released with
+ * tps_broadcast_exit().
+ */
+const char *tps_broadcast_enter(tps_reader_t reader, size_t *length);
+
+/*
+ * tps_broadcast_exit - Stop reading the broadcast region
+ * @reader: Reader
+ *
+ * Return: -1 if @reader is NULL or isn't reading. 0 if @reader successfully
+ * stopped reading.
+ */
+int tps_broadcast_exit(tps_reader_t reader);
+
+/*
+ * tps_broadcast_publish - Publish a new version of the broadcast region
+ * @length: Length of the data to publish
+ * @buffer: Data buffer holding the data to publish
+ *
+ * Copy @length bytes located in data buffer @buffer into a new version of the
+ * broadcast region, and make it the current version at once: readers see
+ * either the previous version or this one, never a mix of both. Versions
+ * which no reader can be using anymore are reclaimed.
+ *
+ * Return: -1 if @length is larger than TPS_SIZE, or if @buffer is NULL, or in
+ * case of failure. 0 if the new version was successfully published.
+ */
+int tps_broadcast_publish(size_t length, char *buffer);
+
 #endif /* _TPS_H */
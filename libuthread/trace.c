@@ -0,0 +1,465 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "thread.h"
+#include "trace.h"
+
+#ifndef UTHREAD_NO_TRACE
+
+// number of events kept per thread, a power of two. Older events are
+// overwritten
+#define TRACE_RING_SIZE (64 * 1024)
+
+struct trace_entry {
+  uint64_t time;
+  pthread_t tid;
+  const void *object;
+  uint64_t arg;
+  // written last, so that an entry being written reads as TRACE_NONE
+  uint32_t event;
+};
+
+// the events recorded on one kernel thread. A user thread records into the
+// ring of the worker it runs on, and its events are told apart by their
+// thread ID. The ring is written by its kernel thread only, but a user thread
+// preempted while recording can finish on another worker, so slots are
+// claimed atomically
+struct trace_ring {
+  uint64_t head;
+  struct trace_ring *next;
+  struct trace_entry entries[TRACE_RING_SIZE];
+};
+
+// how an event is shown in the Chrome trace: 'B' and 'E' begin and end a
+// slice of time on the thread's timeline, 'i' is an instant event
+struct trace_format {
+  const char *name;
+  const char *cat;
+  char phase;
+  const char *object;
+  const char *arg;
+  int arg_is_address;
+};
+
+static const struct trace_format formats[TRACE_EVENTS] = {
+  [TRACE_SEM_BLOCK] = { "sem_down", "sem", 'B', "sem", NULL },
+  [TRACE_SEM_WAKE] = { "sem_down", "sem", 'E', "sem", "status" },
+  [TRACE_SEM_UP] = { "sem_up", "sem", 'i', "sem", "count" },
+  [TRACE_THREAD_BLOCK] = { "blocked", "thread", 'B', NULL, NULL },
+  [TRACE_THREAD_RESUME] = { "blocked", "thread", 'E', NULL, NULL },
+  [TRACE_THREAD_UNBLOCK] = { "thread_unblock", "thread", 'i', NULL, "tid" },
+  [TRACE_TPS_CREATE] = { "tps_create", "tps", 'i', "area", NULL },
+  [TRACE_TPS_CLONE] = { "tps_clone", "tps", 'i', "area", "tid" },
+  [TRACE_TPS_DESTROY] = { "tps_destroy", "tps", 'i', "area", NULL },
+  [TRACE_TPS_COW] = { "tps_cow", "tps", 'i', "area", "shared", 1 },
+  [TRACE_TPS_FAULT] = { "tps_fault", "tps", 'i', "page", NULL },
+  [TRACE_TPS_PUBLISH] = { "tps_publish", "tps", 'i', "area", "length" },
+};
+
+int trace_enabled = 0;
+
+// all the rings ever allocated, which live as long as the process
+static struct trace_ring *rings = NULL;
+
+static int started = 0;
+static const char *exit_path = NULL;
+
+// timestamps are in clock ticks, converted to time with two reference points
+// taken when starting and when dumping
+static uint64_t start_ticks, start_ns;
+
+static __thread struct trace_ring *self_ring = NULL;
+
+// a trace being written, with write() through a fixed buffer rather than
+// stdio, so that it can also be written from a signal handler
+struct trace_out {
+  int fd;
+  int error;
+  size_t length;
+  char buffer[4096];
+};
+
+// the trace written on a crash, which is not on the stack of the faulting
+// thread
+static struct trace_out crash_out;
+
+// HELPER FUNCTIONS ------------------------------------------------------------
+
+static uint64_t now_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static inline uint64_t ticks(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  return __builtin_ia32_rdtsc();
+#else
+  return now_ns();
+#endif
+}
+
+// rings are mmap'ed rather than malloc'ed, since a TPS fault is recorded from
+// a signal handler
+static struct trace_ring *ring_get(void)
+{
+  struct trace_ring *ring = self_ring;
+  if (ring) {
+    return ring;
+  }
+
+  ring = mmap(NULL, sizeof(struct trace_ring), PROT_READ | PROT_WRITE,
+              MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (ring == MAP_FAILED) {
+    return NULL;
+  }
+
+  ring->next = __atomic_load_n(&rings, __ATOMIC_RELAXED);
+  while (!__atomic_compare_exchange_n(&rings, &ring->next, ring, 1,
+                                      __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+  }
+
+  self_ring = ring;
+  return ring;
+}
+
+static void trace_exit(void)
+{
+  if (exit_path) {
+    trace_dump(exit_path);
+  }
+}
+
+// UTHREAD_TRACE=path traces a whole program without changing it
+__attribute__((constructor))
+static void trace_env(void)
+{
+  const char *path = getenv("UTHREAD_TRACE");
+  if (path && *path) {
+    trace_start(path);
+  }
+}
+
+// OUTPUT ----------------------------------------------------------------------
+
+static void out_flush(struct trace_out *out)
+{
+  size_t done = 0;
+
+  while (done < out->length && !out->error) {
+    ssize_t ret = write(out->fd, out->buffer + done, out->length - done);
+    if (ret == -1 && errno != EINTR) {
+      out->error = 1;
+    } else if (ret > 0) {
+      done += ret;
+    }
+  }
+  out->length = 0;
+}
+
+static void out_char(struct trace_out *out, char c)
+{
+  if (out->length == sizeof(out->buffer)) {
+    out_flush(out);
+  }
+  out->buffer[out->length++] = c;
+}
+
+static void out_str(struct trace_out *out, const char *str)
+{
+  while (*str) {
+    out_char(out, *str++);
+  }
+}
+
+// value in base 10 or 16, with at least @digits digits
+static void out_num(struct trace_out *out, uint64_t value, unsigned int base,
+                    int digits)
+{
+  char digit[20];
+  int n = 0;
+
+  do {
+    digit[n++] = "0123456789abcdef"[value % base];
+    value /= base;
+  } while (value || n < digits);
+
+  while (n > 0) {
+    out_char(out, digit[--n]);
+  }
+}
+
+static void out_int(struct trace_out *out, int64_t value)
+{
+  if (value < 0) {
+    out_char(out, '-');
+    out_num(out, -(uint64_t)value, 10, 1);
+  } else {
+    out_num(out, value, 10, 1);
+  }
+}
+
+static void out_hex(struct trace_out *out, uint64_t value)
+{
+  out_str(out, "0x");
+  out_num(out, value, 16, 1);
+}
+
+// nanoseconds per clock tick, measured since tracing was first started
+static double ns_per_tick(void)
+{
+  uint64_t end_ns = now_ns(), end_ticks = ticks();
+
+  return end_ticks > start_ticks ?
+    (double)(end_ns - start_ns) / (end_ticks - start_ticks) : 1;
+}
+
+static void out_entry(struct trace_out *out, const struct trace_entry *entry,
+                      double tick_ns, int first)
+{
+  const struct trace_format *format = &formats[entry->event];
+
+  // timestamps are in microseconds, with nanosecond precision
+  int64_t ns = (double)(int64_t)(entry->time - start_ticks) * tick_ns;
+  uint64_t abs_ns = ns < 0 ? -(uint64_t)ns : (uint64_t)ns;
+
+  out_str(out, first ? "\n" : ",\n");
+  out_str(out, "{\"name\": \"");
+  out_str(out, format->name);
+  out_str(out, "\", \"cat\": \"");
+  out_str(out, format->cat);
+  out_str(out, "\", \"ph\": \"");
+  out_char(out, format->phase);
+  out_str(out, "\", \"ts\": ");
+  if (ns < 0) {
+    out_char(out, '-');
+  }
+  out_num(out, abs_ns / 1000, 10, 1);
+  out_char(out, '.');
+  out_num(out, abs_ns % 1000, 10, 3);
+  out_str(out, ", \"pid\": ");
+  out_int(out, getpid());
+  out_str(out, ", \"tid\": ");
+  out_num(out, (unsigned long)entry->tid, 10, 1);
+  if (format->phase == 'i') {
+    out_str(out, ", \"s\": \"t\"");
+  }
+
+  out_str(out, ", \"args\": {");
+  if (format->object) {
+    out_char(out, '"');
+    out_str(out, format->object);
+    out_str(out, "\": \"");
+    out_hex(out, (uintptr_t)entry->object);
+    out_char(out, '"');
+  }
+  if (format->arg) {
+    out_str(out, format->object ? ", \"" : "\"");
+    out_str(out, format->arg);
+    out_str(out, "\": ");
+    if (format->arg_is_address) {
+      out_char(out, '"');
+      out_hex(out, entry->arg);
+      out_char(out, '"');
+    } else {
+      out_int(out, (int64_t)entry->arg);
+    }
+  }
+  out_str(out, "}}");
+}
+
+static int out_open(struct trace_out *out, const char *path)
+{
+  out->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  out->error = 0;
+  out->length = 0;
+  if (out->fd == -1) {
+    return -1;
+  }
+
+  out_str(out, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [");
+  return 0;
+}
+
+static int out_close(struct trace_out *out)
+{
+  out_str(out, "\n]}\n");
+  out_flush(out);
+  if (close(out->fd) == -1) {
+    out->error = 1;
+  }
+  return out->error ? -1 : 0;
+}
+
+static int entry_cmp(const void *a, const void *b)
+{
+  const struct trace_entry *x = *(struct trace_entry* const*)a;
+  const struct trace_entry *y = *(struct trace_entry* const*)b;
+
+  return (x->time > y->time) - (x->time < y->time);
+}
+
+// TRACE FUNCTIONS -------------------------------------------------------------
+
+void trace_record(enum trace_event event, const void *object, uint64_t arg)
+{
+  struct trace_ring *ring = ring_get();
+  if (!ring) {
+    return;
+  }
+
+  uint64_t head = __atomic_fetch_add(&ring->head, 1, __ATOMIC_RELAXED);
+  struct trace_entry *entry = &ring->entries[head & (TRACE_RING_SIZE - 1)];
+
+  __atomic_store_n(&entry->event, TRACE_NONE, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  entry->time = ticks();
+  entry->tid = thread_self();
+  entry->object = object;
+  entry->arg = arg;
+  __atomic_store_n(&entry->event, event, __ATOMIC_RELEASE);
+}
+
+// called from the segv handler, where only async-signal-safe functions can be
+// used: the rings are written one after the other as they are, without
+// sorting them, which Chrome traces don't require
+void trace_crash(void)
+{
+  struct trace_out *out = &crash_out;
+  struct trace_ring *ring;
+  int first = 1;
+
+  __atomic_store_n(&trace_enabled, 0, __ATOMIC_RELEASE);
+  if (!exit_path || out_open(out, exit_path) == -1) {
+    return;
+  }
+
+  double tick_ns = ns_per_tick();
+  for (ring = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); ring;
+       ring = ring->next) {
+    uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    uint64_t j = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0;
+    for (; j < head; j++) {
+      struct trace_entry *entry = &ring->entries[j & (TRACE_RING_SIZE - 1)];
+      if (__atomic_load_n(&entry->event, __ATOMIC_ACQUIRE) != TRACE_NONE) {
+        out_entry(out, entry, tick_ns, first);
+        first = 0;
+      }
+    }
+  }
+
+  out_close(out);
+}
+
+int trace_start(const char *path)
+{
+  // tracing can be started again after being stopped, and keeps its first
+  // time reference and exit handler
+  if (!__atomic_exchange_n(&started, 1, __ATOMIC_ACQ_REL)) {
+    start_ns = now_ns();
+    start_ticks = ticks();
+    atexit(trace_exit);
+  }
+
+  int disabled = 0;
+  if (!__atomic_compare_exchange_n(&trace_enabled, &disabled, 1, 0,
+                                   __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+    return -1;
+  }
+
+  if (path) {
+    exit_path = path;
+  }
+  return 0;
+}
+
+int trace_stop(void)
+{
+  if (!__atomic_load_n(&trace_enabled, __ATOMIC_ACQUIRE)) {
+    return -1;
+  }
+
+  __atomic_store_n(&trace_enabled, 0, __ATOMIC_RELEASE);
+  return 0;
+}
+
+int trace_dump(const char *path)
+{
+  struct trace_out out;
+
+  if (!__atomic_load_n(&started, __ATOMIC_ACQUIRE)) {
+    return -1;
+  }
+
+  double tick_ns = ns_per_tick();
+
+  // gather the events of all the rings, and sort them by time
+  struct trace_ring *ring;
+  size_t n = 0, i;
+  for (ring = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); ring;
+       ring = ring->next) {
+    uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    n += head < TRACE_RING_SIZE ? head : TRACE_RING_SIZE;
+  }
+
+  struct trace_entry **entries = malloc((n ? n : 1) * sizeof(*entries));
+  if (!entries) {
+    return -1;
+  }
+
+  size_t count = 0;
+  for (ring = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); ring && count < n;
+       ring = ring->next) {
+    uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    uint64_t first = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0, j;
+    for (j = first; j < head && count < n; j++) {
+      struct trace_entry *entry = &ring->entries[j & (TRACE_RING_SIZE - 1)];
+      if (__atomic_load_n(&entry->event, __ATOMIC_ACQUIRE) != TRACE_NONE) {
+        entries[count++] = entry;
+      }
+    }
+  }
+  qsort(entries, count, sizeof(*entries), entry_cmp);
+
+  if (out_open(&out, path) == -1) {
+    free(entries);
+    return -1;
+  }
+  for (i = 0; i < count; i++) {
+    out_entry(&out, entries[i], tick_ns, i == 0);
+  }
+
+  free(entries);
+  return out_close(&out);
+}
+
+#else
+
+// tracing compiled out: only the functions of the public API remain
+
+int trace_start(const char *path)
+{
+  errno = ENOSYS;
+  return -1;
+}
+
+int trace_stop(void)
+{
+  return -1;
+}
+
+int trace_dump(const char *path)
+{
+  return -1;
+}
+
+#endif
@@ -0,0 +1,117 @@
+#ifndef _TRACE_H
+#define _TRACE_H
+
+#include <stdint.h>
+
+/*
+ * Event tracer
+ *
+ * When tracing, libuthread records what its threads do (blocking on and
+ * waking from semaphores, blocking and unblocking threads, TPS operations and
+ * faults) in per-thread ring buffers, without taking any lock. The most recent
+ * events of each thread can then be dumped as a Chrome trace (the JSON trace
+ * event format), to be opened in chrome://tracing or ui.perfetto.dev.
+ *
+ * Tracing is compiled in unless libuthread is built with `make T=0`, and is
+ * only enabled at runtime, by trace_start() or by setting the UTHREAD_TRACE
+ * environment variable to the path of the trace to write at exit. While
+ * tracing is disabled, each trace point costs a single branch.
+ */
+
+/*
+ * trace_start - Start tracing
+ * @path: (Optional) Path of the file where the trace is dumped when the
+ * process exits, or when it crashes on a TPS protection fault
+ *
+ * Tracing can be started again after trace_stop(), adding to the events
+ * recorded so far. A new @path replaces the previous one, if any.
+ *
+ * Return: -1 if tracing is already started, or if it was compiled out. 0 if
+ * tracing was successfully started.
+ */
+int trace_start(const char *path);
+
+/*
+ * trace_stop - Stop tracing
+ *
+ * Stop recording events. The events recorded so far are kept, and can still
+ * be dumped.
+ *
+ * Return: -1 if tracing was not started. 0 if tracing was successfully
+ * stopped.
+ */
+int trace_stop(void);
+
+/*
+ * trace_dump - Write the trace
+ * @path: Path of the file to write
+ *
+ * Write the events recorded by all threads, oldest first, in the Chrome trace
+ * event format. Events being recorded while dumping may be left out.
+ *
+ * Return: -1 if tracing was never started, or in case of failure when writing
+ * @path. 0 if the trace was successfully written.
+ */
+int trace_dump(const char *path);
+
+/*
+ * Events, along with their object and argument
+ */
+enum trace_event {
+  TRACE_NONE,
+  TRACE_SEM_BLOCK,      /* semaphore, 0 */
+  TRACE_SEM_WAKE,       /* semaphore, 0 if taken, -1 otherwise */
+  TRACE_SEM_UP,         /* semaphore, count after sem_up */
+  TRACE_THREAD_BLOCK,   /* NULL, 0 */
+  TRACE_THREAD_RESUME,  /* NULL, 0 */
+  TRACE_THREAD_UNBLOCK, /* NULL, thread unblocked */
+  TRACE_TPS_CREATE,     /* area, 0 */
+  TRACE_TPS_CLONE,      /* area, thread cloned */
+  TRACE_TPS_DESTROY,    /* area, 0 */
+  TRACE_TPS_COW,        /* new area, previously shared area */
+  TRACE_TPS_FAULT,      /* faulting page, 0 */
+  TRACE_TPS_PUBLISH,    /* broadcast region, length */
+  TRACE_EVENTS,
+};
+
+#ifndef UTHREAD_NO_TRACE
+
+extern int trace_enabled;
+
+/*
+ * trace_record - Record an event for the calling thread
+ * @event: Event
+ * @object: Object the event is about
+ * @arg: Argument of the event
+ *
+ * Only called through TRACE(), once tracing is known to be enabled.
+ */
+void trace_record(enum trace_event event, const void *object, uint64_t arg);
+
+/*
+ * trace_crash - Dump the trace before the process crashes
+ *
+ * Dump the trace to the path given to trace_start(), if any. Only
+ * async-signal-safe functions are used, so that it can be called from a signal
+ * handler. The events are written thread by thread rather than sorted by time.
+ */
+void trace_crash(void);
+
+#define TRACE(event, object, arg)                                       \
+  do {                                                                  \
+    if (__builtin_expect(trace_enabled, 0)) {                           \
+      trace_record((event), (object), (uint64_t)(arg));                 \
+    }                                                                   \
+  } while (0)
+
+#else
+
+#define TRACE(event, object, arg) do { } while (0)
+
+static inline void trace_crash(void)
+{
+}
+
+#endif
+
+#endif /* _TRACE_H */
@@ -0,0 +1,109 @@
+#ifndef _UTHREAD_H
+#define _UTHREAD_H
+
+#include <pthread.h>
+
+/*
+ * uthread_t - User thread ID type
+ *
+ * User threads are lightweight threads with their own stacks, multiplexed on a
+ * fixed pool of kernel threads (workers) and switched between in user space.
+ * When a user thread blocks in libuthread (on a semaphore, a channel, a
+ * mutex...), its worker simply switches to another runnable user thread
+ * instead of going to sleep in the kernel.
+ *
+ * A user thread ID lives in the same space as pthread IDs, so that it can be
+ * given to thread_unblock() and is what thread_self() returns from a user
+ * thread. Blocking in the kernel from a user thread (sleep(), pthread_join(),
+ * psem_down()...) blocks its whole worker.
+ */
+typedef pthread_t uthread_t;
+
+/*
+ * uthread_func_t - User thread function type
+ * @arg: Argument given to uthread_create()
+ *
+ * Return: Value received by uthread_join().
+ */
+typedef void *(*uthread_func_t)(void *arg);
+
+/*
+ * uthread_init - Start the user thread runtime
+ * @nworkers: Number of workers, or 0 for one per online CPU
+ *
+ * Start the workers which run user threads. Calling this function is
+ * optional: the runtime is otherwise started with one worker per online CPU
+ * by the first call to uthread_create().
+ *
+ * Return: -1 if @nworkers is negative, if the runtime was already started, or
+ * in case of failure when starting the workers. 0 if the runtime was
+ * successfully started.
+ */
+int uthread_init(int nworkers);
+
+/*
+ * uthread_setpreempt - Set the time slice of user threads
+ * @usec: Time slice in microseconds, or 0 for no preemption (the default)
+ *
+ * By default, a user thread runs until it blocks, yields or exits. With a
+ * time slice, each worker is interrupted (by SIGVTALRM) every @usec
+ * microseconds of CPU time, and moves the user thread it is running to the
+ * end of its run queue. A user thread is never preempted inside a critical
+ * section nor inside a libc function: the preemption is then deferred until it
+ * leaves the critical section, or to a later time slice. Code which keeps a
+ * libc lock held while running its own code (e.g. flockfile()) must do so
+ * inside a critical section.
+ *
+ * Preemption is only supported on x86-64, in programs dynamically linked
+ * against libc. This function must be called before the runtime is started.
+ *
+ * Return: -1 if @usec is negative or if the runtime was already started. 0 if
+ * the time slice was successfully set.
+ */
+int uthread_setpreempt(long usec);
+
+/*
+ * uthread_create - Create a new user thread
+ * @tid: Address of user thread ID where the new thread's ID is received
+ * @func: Function to run in the new thread
+ * @arg: Argument to pass to @func
+ *
+ * Return: -1 if @tid or @func are NULL, or in case of failure when allocating
+ * the new thread. 0 if the new thread was successfully created and made ready
+ * to run.
+ */
+int uthread_create(uthread_t *tid, uthread_func_t func, void *arg);
+
+/*
+ * uthread_join - Wait for a user thread to finish
+ * @tid: ID of thread to wait for
+ * @retval: (Optional) Address of pointer where the value returned by the
+ * thread is received
+ *
+ * Block the caller, which can be a user thread or a regular pthread, until
+ * thread @tid finishes, then release its resources. Each user thread must be
+ * joined exactly once.
+ *
+ * Return: -1 if @tid is not a user thread, or if another thread is already
+ * joining it. 0 if thread @tid was successfully joined.
+ */
+int uthread_join(uthread_t tid, void **retval);
+
+/*
+ * uthread_yield - Yield to other user threads
+ *
+ * Put the calling user thread back at the end of the run queue and run
+ * another one. Called from a regular pthread, yield the CPU to the kernel.
+ */
+void uthread_yield(void);
+
+/*
+ * uthread_exit - Exit from the calling user thread
+ * @retval: Value received by uthread_join()
+ *
+ * Finish the calling user thread as if its function had returned @retval.
+ * Called from a regular pthread, it is the same as pthread_exit().
+ */
+void uthread_exit(void *retval);
+
+#endif /* _UTHREAD_H */
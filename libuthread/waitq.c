@@ -0,0 +1,62 @@
+#include <stddef.h>
+
+#include "waitq.h"
+
+void waitq_init(struct waitq *waitq)
+{
+  waitq->head = NULL;
+  waitq->tail = NULL;
+  waitq->length = 0;
+}
+
+void waitq_push(struct waitq *waitq, struct waiter *waiter)
+{
+  waiter->next = NULL;
+  waiter->prev = waitq->tail;
+
+  if (waitq->tail) {
+    waitq->tail->next = waiter;
+  } else {
+    waitq->head = waiter;
+  }
+
+  waitq->tail = waiter;
+  waitq->length++;
+}
+
+struct waiter *waitq_pop(struct waitq *waitq)
+{
+  struct waiter *waiter = waitq->head;
+  if (waiter == NULL) {
+    return NULL;
+  }
+
+  waitq_remove(waitq, waiter);
+  return waiter;
+}
+
+void waitq_remove(struct waitq *waitq, struct waiter *waiter)
+{
+  if (waiter->prev) {
+    waiter->prev->next = waiter->next;
+  } else {
+    waitq->head = waiter->next;
+  }
+
+  if (waiter->next) {
+    waiter->next->prev = waiter->prev;
+  } else {
+    waitq->tail = waiter->prev;
+  }
+
+  waiter->prev = NULL;
+  waiter->next = NULL;
+  waitq->length--;
+}
+
+int waitq_contains(struct waitq *waitq, struct waiter *waiter)
+{
+  // a waiter which is not linked to any other one can only be in the queue as
+  // its only element
+  return waiter->prev != NULL || waitq->head == waiter;
+}
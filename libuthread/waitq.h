@@ -0,0 +1,76 @@
+#ifndef _WAITQ_H
+#define _WAITQ_H
+
+#include <pthread.h>
+
+struct waitset;
+
+/*
+ * struct waiter - Blocked thread entry
+ * @tid: Thread ID of the blocked thread
+ * @granted: Set by the waker when the resource was handed off to the thread
+ * @prev, @next: Links in the wait queue
+ * @set: When the thread waits on several objects at once, the description of
+ * what it is waiting for, shared by all of its entries. NULL otherwise
+ *
+ * A waiter lives on the stack of the blocked thread for as long as the thread
+ * is blocked, which means that queueing a thread never allocates memory. It
+ * must only be manipulated from inside a critical section.
+ */
+struct waiter {
+  pthread_t tid;
+  int granted;
+  struct waiter *prev;
+  struct waiter *next;
+  struct waitset *set;
+};
+
+/*
+ * struct waitq - Wait queue
+ *
+ * An intrusive FIFO list of waiters. All operations are O(1).
+ */
+struct waitq {
+  struct waiter *head;
+  struct waiter *tail;
+  int length;
+};
+
+/*
+ * waitq_init - Initialize an empty wait queue
+ * @waitq: Wait queue to initialize
+ */
+void waitq_init(struct waitq *waitq);
+
+/*
+ * waitq_push - Add a waiter at the end of a wait queue
+ * @waitq: Wait queue
+ * @waiter: Waiter to add, which must not already be in a wait queue
+ */
+void waitq_push(struct waitq *waitq, struct waiter *waiter);
+
+/*
+ * waitq_pop - Remove the oldest waiter of a wait queue
+ * @waitq: Wait queue
+ *
+ * Return: The oldest waiter of @waitq, NULL if @waitq is empty.
+ */
+struct waiter *waitq_pop(struct waitq *waitq);
+
+/*
+ * waitq_remove - Remove a waiter from a wait queue
+ * @waitq: Wait queue
+ * @waiter: Waiter to remove, which must currently be in @waitq
+ */
+void waitq_remove(struct waitq *waitq, struct waiter *waiter);
+
+/*
+ * waitq_contains - Check whether a waiter is in a wait queue
+ * @waitq: Wait queue
+ * @waiter: Waiter, which must either be in @waitq or in no wait queue at all
+ *
+ * Return: 1 if @waiter is in @waitq, 0 otherwise. This is O(1).
+ */
+int waitq_contains(struct waitq *waitq, struct waiter *waiter);
+
+#endif /* _WAITQ_H */
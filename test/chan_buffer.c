@@ -0,0 +1,212 @@
+/*
+ * Producer/consumer benchmark
+ *
+ * Same workload as sem_buffer.c, without the printing: a producer produces
+ * values into a bounded buffer of BUFFER_SIZE items and a consumer consumes
+ * them. It is run once with the buffer built out of three semaphores as in
+ * sem_buffer.c, and once with a channel, one item at a time and then in
+ * batches, and last through a channel of capacity 1. The consumer checks that
+ * it receives all the values in order.
+ */
+
+#include <assert.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <chan.h>
+#include <sem.h>
+
+#define BUFFER_SIZE 16
+#define MAXCOUNT    1000000
+#define BATCH       8
+
+struct sem_buffer {
+  sem_t empty;
+  sem_t full;
+  sem_t mutex;
+  size_t size, head, tail;
+  unsigned int buffer[BUFFER_SIZE];
+};
+
+static size_t maxcount = MAXCOUNT;
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Semaphore-based buffer, as in sem_buffer.c */
+
+static void *sem_consumer(void *arg)
+{
+  struct sem_buffer *t = (struct sem_buffer*)arg;
+  size_t i;
+
+  for (i = 0; i < maxcount; i++) {
+    sem_down(t->empty);
+    assert(t->buffer[t->tail] == (unsigned int)i);
+    t->tail = (t->tail + 1) % BUFFER_SIZE;
+    sem_down(t->mutex);
+    t->size--;
+    sem_up(t->mutex);
+    sem_up(t->full);
+  }
+
+  return NULL;
+}
+
+static void *sem_producer(void *arg)
+{
+  struct sem_buffer *t = (struct sem_buffer*)arg;
+  size_t i;
+
+  for (i = 0; i < maxcount; i++) {
+    sem_down(t->full);
+    t->buffer[t->head] = i;
+    t->head = (t->head + 1) % BUFFER_SIZE;
+    sem_down(t->mutex);
+    t->size++;
+    sem_up(t->mutex);
+    sem_up(t->empty);
+  }
+
+  return NULL;
+}
+
+/* Channel-based buffer, values are sent as pointer-sized integers */
+
+static void *chan_consumer(void *arg)
+{
+  chan_t c = arg;
+  void *value;
+  size_t i;
+
+  for (i = 0; i < maxcount; i++) {
+    chan_recv(c, &value);
+    assert((uintptr_t)value == i);
+  }
+
+  return NULL;
+}
+
+static void *chan_producer(void *arg)
+{
+  chan_t c = arg;
+  size_t i;
+
+  for (i = 0; i < maxcount; i++)
+    chan_send(c, (void*)(uintptr_t)i);
+
+  return NULL;
+}
+
+static void *chan_batch_consumer(void *arg)
+{
+  chan_t c = arg;
+  void *values[BATCH];
+  size_t i = 0;
+
+  while (i < maxcount) {
+    ssize_t j, n = chan_recv_batch(c, values, BATCH);
+    for (j = 0; j < n; j++, i++)
+      assert((uintptr_t)values[j] == i);
+  }
+
+  return NULL;
+}
+
+static void *chan_batch_producer(void *arg)
+{
+  chan_t c = arg;
+  void *values[BATCH];
+  size_t i = 0, j;
+
+  while (i < maxcount) {
+    size_t n = maxcount - i < BATCH ? maxcount - i : BATCH;
+    for (j = 0; j < n; j++)
+      values[j] = (void*)(uintptr_t)(i + j);
+    chan_send_batch(c, values, n);
+    i += n;
+  }
+
+  return NULL;
+}
+
+static void run(const char *name, void *(*producer)(void*),
+                void *(*consumer)(void*), void *arg)
+{
+  pthread_t tid[2];
+  double start = now();
+
+  pthread_create(&tid[0], NULL, producer, arg);
+  pthread_create(&tid[1], NULL, consumer, arg);
+  pthread_join(tid[0], NULL);
+  pthread_join(tid[1], NULL);
+
+  double elapsed = now() - start;
+  printf("%-10s %zu items in %.3f s (%.1f ns/item)\n", name, maxcount,
+         elapsed, elapsed * 1e9 / maxcount);
+}
+
+static void check_small(void)
+{
+  chan_t c = chan_create(1);
+  void *data;
+  uintptr_t i;
+
+  /* a channel of capacity 1 holds 2 items, and does not lose any */
+  for (i = 0; i < 2; i++)
+    assert(chan_trysend(c, (void*)i) == 0);
+  assert(chan_trysend(c, (void*)i) == -1);
+  for (i = 0; i < 2; i++) {
+    assert(chan_tryrecv(c, &data) == 0);
+    assert(data == (void*)i);
+  }
+  assert(chan_tryrecv(c, &data) == -1);
+
+  run("small", chan_producer, chan_consumer, c);
+  assert(chan_destroy(c) == 0);
+}
+
+static unsigned int get_argv(char *argv)
+{
+  long int ret = strtol(argv, NULL, 0);
+  if (ret == LONG_MIN || ret == LONG_MAX) {
+    perror("strtol");
+    exit(1);
+  }
+  return ret;
+}
+
+int main(int argc, char **argv)
+{
+  struct sem_buffer t;
+  chan_t c;
+
+  if (argc > 1)
+    maxcount = get_argv(argv[1]);
+
+  t.size = t.head = t.tail = 0;
+  t.mutex = sem_create(1);
+  t.empty = sem_create(0);
+  t.full = sem_create(BUFFER_SIZE);
+  run("semaphores", sem_producer, sem_consumer, &t);
+  sem_destroy(t.mutex);
+  sem_destroy(t.empty);
+  sem_destroy(t.full);
+
+  c = chan_create(BUFFER_SIZE);
+  run("channel", chan_producer, chan_consumer, c);
+  run("batch", chan_batch_producer, chan_batch_consumer, c);
+  assert(chan_destroy(c) == 0);
+
+  check_small();
+
+  return 0;
+}
@@ -0,0 +1,203 @@
+/*
+ * Sieve benchmark for finding prime numbers
+ *
+ * Same pipeline as sem_prime.c, without the printing: a source thread feeds
+ * numbers to a chain of filter threads, one per prime found so far, and a sink
+ * thread collects the primes. It is run once with the channels between threads
+ * built out of two semaphores as in sem_prime.c, and once with channels. Both
+ * runs must find the same number of primes.
+ */
+
+#include <assert.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <chan.h>
+#include <sem.h>
+
+#define MAXPRIME 5000
+#define CHAN_SIZE 16
+
+/* Abstract channel, so that the same pipeline runs over both versions */
+struct pipe {
+  /* semaphore version */
+  int value;
+  sem_t produce;
+  sem_t consume;
+
+  /* channel version */
+  chan_t chan;
+};
+
+struct filter {
+  struct pipe *left;
+  struct pipe *right;
+  int prime;
+  pthread_t tid;
+  struct filter *next;
+};
+
+static unsigned int max = MAXPRIME;
+static int use_chan;
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static struct pipe *pipe_create(void)
+{
+  struct pipe *p = malloc(sizeof(*p));
+
+  if (use_chan) {
+    p->chan = chan_create(CHAN_SIZE);
+  } else {
+    p->produce = sem_create(0);
+    p->consume = sem_create(0);
+  }
+  return p;
+}
+
+static void pipe_destroy(struct pipe *p)
+{
+  if (use_chan) {
+    chan_destroy(p->chan);
+  } else {
+    sem_destroy(p->produce);
+    sem_destroy(p->consume);
+  }
+  free(p);
+}
+
+static void pipe_put(struct pipe *p, int value)
+{
+  if (use_chan) {
+    chan_send(p->chan, (void*)(intptr_t)value);
+  } else {
+    p->value = value;
+    sem_up(p->consume);
+    sem_down(p->produce);
+  }
+}
+
+static int pipe_get(struct pipe *p)
+{
+  int value;
+
+  if (use_chan) {
+    void *data;
+    chan_recv(p->chan, &data);
+    value = (intptr_t)data;
+  } else {
+    sem_down(p->consume);
+    value = p->value;
+    sem_up(p->produce);
+  }
+  return value;
+}
+
+static void *source(void *arg)
+{
+  struct pipe *p = arg;
+  size_t i;
+
+  for (i = 2; i <= max; i++)
+    pipe_put(p, i);
+
+  /* mark completion */
+  pipe_put(p, -1);
+  return NULL;
+}
+
+static void *filter(void *arg)
+{
+  struct filter *f = arg;
+  int value;
+
+  do {
+    value = pipe_get(f->left);
+    if ((value == -1) || (value % f->prime != 0))
+      pipe_put(f->right, value);
+  } while (value != -1);
+
+  return NULL;
+}
+
+static int sieve(void)
+{
+  struct pipe *init_p, *p;
+  struct filter *f_head = NULL, *f;
+  pthread_t tid;
+  int value, primes = 0;
+
+  init_p = p = pipe_create();
+  pthread_create(&tid, NULL, source, p);
+
+  while ((value = pipe_get(p)) != -1) {
+    f = malloc(sizeof(*f));
+
+    primes++;
+    f->left = p;
+    f->prime = value;
+    f->right = p = pipe_create();
+    f->next = f_head;
+    f_head = f;
+    pthread_create(&f->tid, NULL, filter, f);
+  }
+
+  /* a pipe can only go once the filter reading from it is done with it */
+  pthread_join(tid, NULL);
+  for (f = f_head; f; f = f->next)
+    pthread_join(f->tid, NULL);
+
+  pipe_destroy(init_p);
+  while (f_head) {
+    struct filter *old = f_head;
+
+    pipe_destroy(f_head->right);
+    f_head = f_head->next;
+    free(old);
+  }
+
+  return primes;
+}
+
+static int run(const char *name, int chan)
+{
+  use_chan = chan;
+
+  double start = now();
+  int primes = sieve();
+  double elapsed = now() - start;
+
+  printf("%-10s %d primes up to %u in %.3f s\n", name, primes, max, elapsed);
+  return primes;
+}
+
+static unsigned int get_argv(char *argv)
+{
+  long int ret = strtol(argv, NULL, 0);
+
+  if (ret == LONG_MIN || ret == LONG_MAX) {
+    perror("strtol");
+    exit(1);
+  }
+  return ret;
+}
+
+int main(int argc, char **argv)
+{
+  if (argc > 1)
+    max = get_argv(argv[1]);
+
+  int expected = run("semaphores", 0);
+  assert(run("channel", 1) == expected);
+
+  return 0;
+}
@@ -0,0 +1,92 @@
+/*
+ * Distributed semaphore test
+ *
+ * Many threads hammer a distributed semaphore guarding a pool of resources.
+ * There must never be more threads holding a resource than the pool size, and
+ * no resource must be lost once everybody is done. Then check that a thread
+ * blocked on an empty semaphore gets woken up by a release from another CPU.
+ */
+
+#include <assert.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <dsem.h>
+
+#define NTHREADS 8
+#define POOLSIZE 4
+#define MAXCOUNT 100000
+
+static dsem_t sem;
+static int in_use;
+static size_t maxcount = MAXCOUNT;
+
+static void *worker(void *arg)
+{
+  size_t i;
+
+  for (i = 0; i < maxcount; i++) {
+    dsem_down(sem);
+    assert(__sync_add_and_fetch(&in_use, 1) <= POOLSIZE);
+    __sync_sub_and_fetch(&in_use, 1);
+    dsem_up(sem);
+  }
+
+  return NULL;
+}
+
+static void *blocker(void *arg)
+{
+  dsem_down(sem);
+  return NULL;
+}
+
+static unsigned int get_argv(char *argv)
+{
+  long int ret = strtol(argv, NULL, 0);
+  if (ret == LONG_MIN || ret == LONG_MAX) {
+    perror("strtol");
+    exit(1);
+  }
+  return ret;
+}
+
+int main(int argc, char **argv)
+{
+  pthread_t tid[NTHREADS];
+  int i, sval;
+
+  if (argc > 1)
+    maxcount = get_argv(argv[1]);
+
+  /* contended pool */
+  sem = dsem_create(POOLSIZE, NTHREADS);
+  for (i = 0; i < NTHREADS; i++)
+    pthread_create(&tid[i], NULL, worker, NULL);
+  for (i = 0; i < NTHREADS; i++)
+    pthread_join(tid[i], NULL);
+
+  dsem_getvalue(sem, &sval, DSEM_APPROX);
+  assert(sval == POOLSIZE);
+  dsem_getvalue(sem, &sval, DSEM_EXACT);
+  assert(sval == POOLSIZE);
+  printf("pool of %d OK!\n", POOLSIZE);
+  assert(dsem_destroy(sem) == 0);
+
+  /* blocking and wakeup */
+  sem = dsem_create(0, 0);
+  pthread_create(&tid[0], NULL, blocker, NULL);
+  do {
+    dsem_getvalue(sem, &sval, DSEM_EXACT);
+  } while (sval != -1);
+  dsem_up(sem);
+  pthread_join(tid[0], NULL);
+  dsem_getvalue(sem, &sval, DSEM_EXACT);
+  assert(sval == 0);
+  printf("blocking OK!\n");
+  assert(dsem_destroy(sem) == 0);
+
+  return 0;
+}
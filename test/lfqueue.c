@@ -0,0 +1,228 @@
+/*
+ * Lock-free queue stress test
+ *
+ * Producer threads enqueue items tagged with their index and a sequence
+ * number while consumer threads dequeue them, all running concurrently as
+ * plain pthreads without any lock. Every item must be received exactly once,
+ * and each consumer must see the items of a given producer in increasing
+ * order. The MPMC queue is stressed with one consumer per producer and a small
+ * capacity so that it keeps filling up, and the MPSC queue with a single
+ * consumer.
+ */
+
+#include <assert.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <lfqueue.h>
+
+#define MAXTHREADS 16
+#define MAXCOUNT 200000
+#define CAPACITY 64
+
+#define ITEM(producer, seq) ((void*)(((uintptr_t)(producer) << 32) | (seq)))
+#define ITEM_PRODUCER(item) ((uintptr_t)(item) >> 32)
+#define ITEM_SEQ(item) ((uintptr_t)(item) & 0xffffffff)
+
+struct test {
+  int mpsc;
+  mpmc_queue_t mpmc_queue;
+  mpsc_queue_t mpsc_queue;
+  int nproducers;
+  size_t maxcount;
+  size_t remaining;
+  unsigned char *seen;
+};
+
+struct worker {
+  struct test *t;
+  int id;
+  pthread_t tid;
+};
+
+static int enqueue(struct test *t, void *data)
+{
+  if (t->mpsc)
+    return mpsc_queue_enqueue(t->mpsc_queue, data);
+  return mpmc_queue_enqueue(t->mpmc_queue, data);
+}
+
+static int dequeue(struct test *t, void **data)
+{
+  if (t->mpsc)
+    return mpsc_queue_dequeue(t->mpsc_queue, data);
+  return mpmc_queue_dequeue(t->mpmc_queue, data);
+}
+
+static void *producer(void *arg)
+{
+  struct worker *w = arg;
+  size_t i;
+
+  for (i = 0; i < w->t->maxcount; i++) {
+    while (enqueue(w->t, ITEM(w->id, i)) == -1)
+      sched_yield();
+  }
+
+  return NULL;
+}
+
+static void *consumer(void *arg)
+{
+  struct worker *w = arg;
+  struct test *t = w->t;
+  long last[MAXTHREADS];
+  void *data;
+  int i;
+
+  for (i = 0; i < MAXTHREADS; i++)
+    last[i] = -1;
+
+  while (__atomic_load_n(&t->remaining, __ATOMIC_RELAXED) > 0) {
+    if (dequeue(t, &data) == -1) {
+      sched_yield();
+      continue;
+    }
+
+    size_t p = ITEM_PRODUCER(data), seq = ITEM_SEQ(data);
+    assert(p < (size_t)t->nproducers && seq < t->maxcount);
+    assert((long)seq > last[p]);
+    last[p] = seq;
+
+    /* each slot is only written by the single consumer that got the item */
+    assert(t->seen[p * t->maxcount + seq]++ == 0);
+    __atomic_fetch_sub(&t->remaining, 1, __ATOMIC_RELAXED);
+  }
+
+  return NULL;
+}
+
+static void run(int mpsc, int nproducers, size_t maxcount)
+{
+  struct test t;
+  struct worker producers[MAXTHREADS], consumers[MAXTHREADS];
+  int nconsumers = mpsc ? 1 : nproducers;
+  struct timespec start, end;
+  size_t i;
+
+  t.mpsc = mpsc;
+  t.nproducers = nproducers;
+  t.maxcount = maxcount;
+  t.remaining = nproducers * maxcount;
+  t.seen = calloc(nproducers * maxcount, 1);
+  if (mpsc)
+    t.mpsc_queue = mpsc_queue_create();
+  else
+    t.mpmc_queue = mpmc_queue_create(CAPACITY);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (i = 0; i < (size_t)nconsumers; i++) {
+    consumers[i].t = &t;
+    consumers[i].id = i;
+    pthread_create(&consumers[i].tid, NULL, consumer, &consumers[i]);
+  }
+  for (i = 0; i < (size_t)nproducers; i++) {
+    producers[i].t = &t;
+    producers[i].id = i;
+    pthread_create(&producers[i].tid, NULL, producer, &producers[i]);
+  }
+  for (i = 0; i < (size_t)nproducers; i++)
+    pthread_join(producers[i].tid, NULL);
+  for (i = 0; i < (size_t)nconsumers; i++)
+    pthread_join(consumers[i].tid, NULL);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  for (i = 0; i < nproducers * maxcount; i++)
+    assert(t.seen[i] == 1);
+
+  printf("%s: %d producers, %d consumers, %zu items in %.3f s\n",
+         mpsc ? "mpsc" : "mpmc", nproducers, nconsumers, nproducers * maxcount,
+         (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9);
+
+  if (mpsc)
+    assert(mpsc_queue_destroy(t.mpsc_queue) == 0);
+  else
+    assert(mpmc_queue_destroy(t.mpmc_queue) == 0);
+  free(t.seen);
+}
+
+static void check_basic(void)
+{
+  mpmc_queue_t mpmc = mpmc_queue_create(3);
+  mpsc_queue_t mpsc = mpsc_queue_create();
+  void *data;
+  uintptr_t i;
+
+  /* capacity is rounded up to 4 */
+  for (i = 0; i < 4; i++)
+    assert(mpmc_queue_enqueue(mpmc, (void*)i) == 0);
+  assert(mpmc_queue_enqueue(mpmc, (void*)i) == -1);
+  assert(mpmc_queue_length(mpmc) == 4);
+  assert(mpmc_queue_destroy(mpmc) == -1);
+  for (i = 0; i < 4; i++) {
+    assert(mpmc_queue_dequeue(mpmc, &data) == 0);
+    assert(data == (void*)i);
+  }
+  assert(mpmc_queue_dequeue(mpmc, &data) == -1);
+  assert(mpmc_queue_destroy(mpmc) == 0);
+
+  /* a single slot would be overwritten before being read, so it is 2 */
+  mpmc = mpmc_queue_create(1);
+  for (i = 0; i < 2; i++)
+    assert(mpmc_queue_enqueue(mpmc, (void*)i) == 0);
+  assert(mpmc_queue_enqueue(mpmc, (void*)i) == -1);
+  for (i = 0; i < 2; i++) {
+    assert(mpmc_queue_dequeue(mpmc, &data) == 0);
+    assert(data == (void*)i);
+  }
+  assert(mpmc_queue_dequeue(mpmc, &data) == -1);
+  assert(mpmc_queue_destroy(mpmc) == 0);
+
+  for (i = 0; i < 100; i++)
+    assert(mpsc_queue_enqueue(mpsc, (void*)i) == 0);
+  assert(mpsc_queue_destroy(mpsc) == -1);
+  for (i = 0; i < 100; i++) {
+    assert(mpsc_queue_dequeue(mpsc, &data) == 0);
+    assert(data == (void*)i);
+  }
+  assert(mpsc_queue_dequeue(mpsc, &data) == -1);
+  assert(mpsc_queue_destroy(mpsc) == 0);
+}
+
+static unsigned int get_argv(char *argv)
+{
+  long int ret = strtol(argv, NULL, 0);
+  if (ret == LONG_MIN || ret == LONG_MAX) {
+    perror("strtol");
+    exit(1);
+  }
+  return ret;
+}
+
+int main(int argc, char **argv)
+{
+  size_t maxcount = MAXCOUNT;
+  long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+  int nthreads;
+
+  if (argc > 1)
+    maxcount = get_argv(argv[1]);
+
+  /* use all the cores, but always at least 4 threads to get some contention */
+  nthreads = ncpus < 4 ? 4 : ncpus;
+  if (nthreads > MAXTHREADS)
+    nthreads = MAXTHREADS;
+
+  check_basic();
+  run(0, nthreads / 2, maxcount);
+  run(1, nthreads - 1, maxcount);
+
+  return 0;
+}
@@ -0,0 +1,150 @@
+/*
+ * Priority semaphore test
+ *
+ * Low priority threads start waiting on a semaphore before high priority ones,
+ * but the high priority threads must all get the resource first. Then check
+ * that a thread holding a semaphore inherits the priority of a thread blocked
+ * on it, and drops it when releasing the semaphore, but keeps the priority it
+ * inherits from another semaphore it still holds, or when inheritance is
+ * turned off.
+ */
+
+#include <assert.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <prio_sem.h>
+
+#define NTHREADS 8
+#define LOW      1
+#define MID      10
+#define HIGH     20
+
+static prio_sem_t sem, other;
+static int order[NTHREADS];
+static volatile int next;
+
+static void *waiter(void *arg)
+{
+  int prio = (long)arg;
+
+  prio_sem_setprio(prio);
+  prio_sem_down(sem);
+  order[next++] = prio;
+  return NULL;
+}
+
+struct lock_args {
+  prio_sem_t sem;
+  int prio;
+};
+
+/* take and release a semaphore used as a lock */
+static void *locker(void *arg)
+{
+  struct lock_args *args = arg;
+
+  prio_sem_setprio(args->prio);
+  prio_sem_down(args->sem);
+  prio_sem_up(args->sem);
+  return NULL;
+}
+
+static void wait_for_waiters(prio_sem_t s, int n)
+{
+  int sval;
+
+  do {
+    sched_yield();
+    prio_sem_getvalue(s, &sval);
+  } while (sval != -n);
+}
+
+int main(int argc, char **argv)
+{
+  pthread_t tid[NTHREADS];
+  struct lock_args high, mid;
+  int i;
+
+  /* priority ordering: low priority threads are queued first */
+  sem = prio_sem_create(0);
+  for (i = 0; i < NTHREADS; i++) {
+    pthread_create(&tid[i], NULL, waiter,
+                   (void*)(long)(i < NTHREADS / 2 ? LOW : HIGH));
+    wait_for_waiters(sem, i + 1);
+  }
+
+  /* release one resource at a time so that the order is the wakeup order */
+  for (i = 0; i < NTHREADS; i++) {
+    prio_sem_up(sem);
+    while (next != i + 1)
+      sched_yield();
+  }
+  for (i = 0; i < NTHREADS; i++)
+    pthread_join(tid[i], NULL);
+
+  for (i = 0; i < NTHREADS; i++)
+    assert(order[i] == (i < NTHREADS / 2 ? HIGH : LOW));
+  printf("priority order OK!\n");
+  assert(prio_sem_destroy(sem) == 0);
+
+  /* priority inheritance: we hold the semaphore at low priority */
+  sem = prio_sem_create(1);
+  prio_sem_setinherit(sem, 1);
+  prio_sem_setprio(LOW);
+  prio_sem_down(sem);
+  assert(prio_sem_getprio() == LOW);
+
+  high.sem = sem;
+  high.prio = HIGH;
+  pthread_create(&tid[0], NULL, locker, &high);
+  wait_for_waiters(sem, 1);
+  assert(prio_sem_getprio() == HIGH);
+
+  prio_sem_up(sem);
+  assert(prio_sem_getprio() == LOW);
+  pthread_join(tid[0], NULL);
+  printf("priority inheritance OK!\n");
+
+  /* holding two semaphores, releasing one keeps the other's boost */
+  other = prio_sem_create(1);
+  prio_sem_setinherit(other, 1);
+  prio_sem_down(other);
+  prio_sem_down(sem);
+
+  mid.sem = other;
+  mid.prio = MID;
+  pthread_create(&tid[0], NULL, locker, &mid);
+  wait_for_waiters(other, 1);
+  pthread_create(&tid[1], NULL, locker, &high);
+  wait_for_waiters(sem, 1);
+  assert(prio_sem_getprio() == HIGH);
+
+  prio_sem_up(sem);
+  assert(prio_sem_getprio() == MID);
+  prio_sem_setprio(LOW + 1);
+  assert(prio_sem_getprio() == MID);
+  prio_sem_up(other);
+  assert(prio_sem_getprio() == LOW + 1);
+  pthread_join(tid[0], NULL);
+  pthread_join(tid[1], NULL);
+  printf("nested priority inheritance OK!\n");
+
+  /* turning inheritance off drops the boost at once */
+  prio_sem_down(sem);
+  pthread_create(&tid[0], NULL, locker, &high);
+  wait_for_waiters(sem, 1);
+  assert(prio_sem_getprio() == HIGH);
+  prio_sem_setinherit(sem, 0);
+  assert(prio_sem_getprio() == LOW + 1);
+  prio_sem_up(sem);
+  pthread_join(tid[0], NULL);
+  printf("inheritance off OK!\n");
+
+  assert(prio_sem_destroy(other) == 0);
+  assert(prio_sem_destroy(sem) == 0);
+
+  return 0;
+}
@@ -0,0 +1,177 @@
+/*
+ * Process-shared semaphore test
+ *
+ * Two producer processes and one consumer process exchange items through a
+ * bounded buffer placed in an anonymous shared mapping, synchronized by
+ * process-shared semaphores living in the same mapping. The consumer checks
+ * that it received every item exactly once. A named semaphore is then opened
+ * by a child process to hand a token back to its parent, and a timed down on
+ * an empty semaphore must give up.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <psem.h>
+
+#define NPRODUCERS 2
+#define BUFFER_SIZE 16
+#define MAXCOUNT 100000
+
+struct shared {
+  struct psem empty;
+  struct psem full;
+  struct psem lock;
+  size_t head;
+  size_t tail;
+  size_t buffer[BUFFER_SIZE];
+};
+
+static void producer(struct shared *s, size_t first, size_t count)
+{
+  size_t i;
+
+  for (i = first; i < first + count; i++) {
+    psem_down(&s->empty);
+    psem_down(&s->lock);
+    s->buffer[s->head++ % BUFFER_SIZE] = i;
+    psem_up(&s->lock);
+    psem_up(&s->full);
+  }
+}
+
+static void test_buffer(size_t maxcount)
+{
+  struct shared *s = mmap(NULL, sizeof(*s), PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  char *seen = calloc(NPRODUCERS * maxcount, 1);
+  pid_t pid[NPRODUCERS];
+  struct timespec start, end;
+  size_t i;
+  int status;
+
+  assert(s != MAP_FAILED && seen);
+  assert(psem_init(&s->empty, BUFFER_SIZE) == 0);
+  assert(psem_init(&s->full, 0) == 0);
+  assert(psem_init(&s->lock, 1) == 0);
+  s->head = s->tail = 0;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (i = 0; i < NPRODUCERS; i++) {
+    pid[i] = fork();
+    assert(pid[i] != -1);
+    if (pid[i] == 0) {
+      producer(s, i * maxcount, maxcount);
+      _exit(0);
+    }
+  }
+
+  for (i = 0; i < NPRODUCERS * maxcount; i++) {
+    size_t item;
+
+    psem_down(&s->full);
+    item = s->buffer[s->tail++ % BUFFER_SIZE];
+    psem_up(&s->empty);
+
+    assert(item < NPRODUCERS * maxcount && !seen[item]);
+    seen[item] = 1;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  for (i = 0; i < NPRODUCERS; i++) {
+    assert(waitpid(pid[i], &status, 0) == pid[i]);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+  }
+
+  printf("%zu items across processes in %.3f s\n", NPRODUCERS * maxcount,
+         (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9);
+
+  assert(psem_fini(&s->empty) == 0);
+  assert(psem_fini(&s->full) == 0);
+  assert(psem_fini(&s->lock) == 0);
+  free(seen);
+  munmap(s, sizeof(*s));
+}
+
+static void test_named(void)
+{
+  char name[64];
+  psem_t sem;
+  pid_t pid;
+  int status, sval;
+
+  snprintf(name, sizeof(name), "/psem_test.%d", (int)getpid());
+  sem = psem_open(name, 0);
+  assert(sem);
+
+  pid = fork();
+  assert(pid != -1);
+  if (pid == 0) {
+    psem_t child = psem_open(name, 0);
+    if (!child || psem_up(child) == -1)
+      _exit(1);
+    psem_close(child);
+    _exit(0);
+  }
+
+  assert(psem_down(sem) == 0);
+  assert(waitpid(pid, &status, 0) == pid);
+  assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+  assert(psem_trydown(sem) == -1 && errno == EAGAIN);
+  psem_getvalue(sem, &sval);
+  assert(sval == 0);
+
+  assert(psem_close(sem) == 0);
+  assert(psem_unlink(name) == 0);
+}
+
+static void test_timed(void)
+{
+  struct psem sem;
+  struct timespec deadline;
+
+  psem_init(&sem, 0);
+  clock_gettime(CLOCK_REALTIME, &deadline);
+  deadline.tv_nsec += 10000000;
+  if (deadline.tv_nsec >= 1000000000) {
+    deadline.tv_sec++;
+    deadline.tv_nsec -= 1000000000;
+  }
+
+  assert(psem_timeddown(&sem, &deadline) == -1 && errno == ETIMEDOUT);
+  psem_up(&sem);
+  assert(psem_timeddown(&sem, &deadline) == 0);
+  assert(psem_fini(&sem) == 0);
+}
+
+static unsigned int get_argv(char *argv)
+{
+  long int ret = strtol(argv, NULL, 0);
+  if (ret == LONG_MIN || ret == LONG_MAX) {
+    perror("strtol");
+    exit(1);
+  }
+  return ret;
+}
+
+int main(int argc, char **argv)
+{
+  size_t maxcount = MAXCOUNT;
+
+  if (argc > 1)
+    maxcount = get_argv(argv[1]);
+
+  test_buffer(maxcount);
+  test_named();
+  test_timed();
+
+  return 0;
+}
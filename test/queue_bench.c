@@ -0,0 +1,249 @@
+/*
+ * Queue microbenchmark
+ *
+ * Compare the chunked ring queue of libuthread against the original queue,
+ * which allocates one node per item (its functions are named node_queue_* in
+ * queue_node.c). Both queues are first driven through the
+ * same random sequence of operations and must agree on every result, then
+ * each is timed on a steady FIFO, on filling and draining, on iterating and on
+ * deleting items. Deleting through handles, which only the chunked queue
+ * supports, is timed as well.
+ */
+
+#include <assert.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <queue.h>
+
+#define MAXCOUNT 1000000
+#define RESIDENT 64
+#define ITER_LENGTH 1000
+
+/* original node-per-item implementation, in queue_node.c */
+queue_t node_queue_create(void);
+int node_queue_destroy(queue_t queue);
+int node_queue_enqueue(queue_t queue, void *data);
+int node_queue_dequeue(queue_t queue, void **data);
+int node_queue_delete(queue_t queue, void *data);
+int node_queue_iterate(queue_t queue, queue_func_t func, void *arg,
+                       void **data);
+int node_queue_length(queue_t queue);
+
+struct impl {
+  const char *name;
+  queue_t (*create)(void);
+  int (*destroy)(queue_t);
+  int (*enqueue)(queue_t, void*);
+  int (*dequeue)(queue_t, void**);
+  int (*delete)(queue_t, void*);
+  int (*iterate)(queue_t, queue_func_t, void*, void**);
+  int (*length)(queue_t);
+};
+
+static struct impl impls[] = {
+  { "node", node_queue_create, node_queue_destroy, node_queue_enqueue,
+    node_queue_dequeue, node_queue_delete, node_queue_iterate,
+    node_queue_length },
+  { "chunked", queue_create, queue_destroy, queue_enqueue, queue_dequeue,
+    queue_delete, queue_iterate, queue_length },
+};
+
+static double now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int sum_items(void *data, void *arg)
+{
+  *(uintptr_t*)arg += (uintptr_t)data;
+  return 0;
+}
+
+static int find_item(void *data, void *arg)
+{
+  return data == arg;
+}
+
+#define ITEM(i) ((void*)(uintptr_t)((i) + 1))
+
+static void check(size_t maxcount)
+{
+  struct impl *a = &impls[0], *b = &impls[1];
+  queue_t qa = a->create(), qb = b->create();
+  size_t i, next = 0;
+  unsigned int seed = 1;
+
+  for (i = 0; i < maxcount; i++) {
+    void *da = NULL, *db = NULL;
+    uintptr_t sa = 0, sb = 0;
+    int op = rand_r(&seed) % 8;
+
+    if (op < 4) {
+      assert(a->enqueue(qa, ITEM(next)) == b->enqueue(qb, ITEM(next)));
+      next++;
+    } else if (op < 6) {
+      assert(a->dequeue(qa, &da) == b->dequeue(qb, &db));
+      assert(da == db);
+    } else if (op < 7) {
+      void *item = ITEM(next - rand_r(&seed) % 128);
+      assert(a->delete(qa, item) == b->delete(qb, item));
+    } else {
+      void *item = ITEM(next - rand_r(&seed) % 128);
+      a->iterate(qa, find_item, item, &da);
+      b->iterate(qb, find_item, item, &db);
+      assert(da == db);
+      a->iterate(qa, sum_items, &sa, NULL);
+      b->iterate(qb, sum_items, &sb, NULL);
+      assert(sa == sb);
+    }
+    assert(a->length(qa) == b->length(qb));
+  }
+
+  /* non-empty queues cannot be destroyed */
+  if (a->length(qa) > 0)
+    assert(a->destroy(qa) == -1 && b->destroy(qb) == -1);
+  while (a->dequeue(qa, (void**)&i) == 0)
+    b->dequeue(qb, (void**)&i);
+  assert(b->length(qb) == 0);
+  assert(a->destroy(qa) == 0 && b->destroy(qb) == 0);
+}
+
+static void check_handles(void)
+{
+  queue_t q = queue_create();
+  queue_handle_t handles[ITER_LENGTH];
+  uintptr_t sum = 0, expected = 0;
+  void *data;
+  size_t i;
+
+  for (i = 0; i < ITER_LENGTH; i++)
+    assert(queue_enqueue_handle(q, ITEM(i), &handles[i]) == 0);
+
+  /* remove every odd item */
+  for (i = 1; i < ITER_LENGTH; i += 2)
+    assert(queue_remove_handle(q, handles[i]) == 0);
+  assert(queue_length(q) == ITER_LENGTH / 2);
+
+  for (i = 0; i < ITER_LENGTH; i += 2)
+    expected += (uintptr_t)ITEM(i);
+  queue_iterate(q, sum_items, &sum, NULL);
+  assert(sum == expected);
+
+  for (i = 0; i < ITER_LENGTH; i += 2) {
+    assert(queue_dequeue(q, &data) == 0);
+    assert(data == ITEM(i));
+  }
+  assert(queue_destroy(q) == 0);
+}
+
+static void bench_handles(size_t maxcount)
+{
+  queue_t q = queue_create();
+  queue_handle_t handles[ITER_LENGTH];
+  double start, del = 0;
+  size_t i, round;
+
+  for (round = 0; round < maxcount / ITER_LENGTH; round++) {
+    for (i = 0; i < ITER_LENGTH; i++)
+      queue_enqueue_handle(q, ITEM(i), &handles[i]);
+
+    start = now();
+    for (i = 0; i < ITER_LENGTH / 2; i++) {
+      queue_remove_handle(q, handles[ITER_LENGTH / 2 + i]);
+      queue_remove_handle(q, handles[ITER_LENGTH / 2 - i - 1]);
+    }
+    del += now() - start;
+  }
+  assert(queue_length(q) == 0);
+  queue_destroy(q);
+
+  printf("%-8s remove by handle %7.1f ns/item\n", "chunked",
+         del * 1e9 / (maxcount / ITER_LENGTH * ITER_LENGTH));
+}
+
+static void bench(struct impl *impl, size_t maxcount)
+{
+  queue_t q = impl->create();
+  double start, fifo, fill, iter, del;
+  uintptr_t sum = 0;
+  void *data;
+  size_t i;
+
+  /* steady FIFO with a few items resident */
+  for (i = 0; i < RESIDENT; i++)
+    impl->enqueue(q, ITEM(i));
+  start = now();
+  for (i = 0; i < maxcount; i++) {
+    impl->dequeue(q, &data);
+    impl->enqueue(q, data);
+  }
+  fifo = now() - start;
+  while (impl->dequeue(q, &data) == 0)
+    ;
+
+  /* fill up, then drain */
+  start = now();
+  for (i = 0; i < maxcount; i++)
+    impl->enqueue(q, ITEM(i));
+  for (i = 0; i < maxcount; i++)
+    impl->dequeue(q, &data);
+  fill = now() - start;
+
+  /* iterate over a queue of a thousand items */
+  for (i = 0; i < ITER_LENGTH; i++)
+    impl->enqueue(q, ITEM(i));
+  start = now();
+  for (i = 0; i < maxcount / ITER_LENGTH; i++)
+    impl->iterate(q, sum_items, &sum, NULL);
+  iter = now() - start;
+
+  /* delete every item, from the middle outwards */
+  start = now();
+  for (i = 0; i < ITER_LENGTH / 2; i++) {
+    impl->delete(q, ITEM(ITER_LENGTH / 2 + i));
+    impl->delete(q, ITEM(ITER_LENGTH / 2 - i - 1));
+  }
+  del = now() - start;
+  assert(impl->length(q) == 0);
+  impl->destroy(q);
+
+  printf("%-8s fifo %6.1f ns/op, fill+drain %6.1f ns/item, "
+         "iterate %6.2f ns/item, delete %7.1f ns/item\n", impl->name,
+         fifo * 1e9 / maxcount, fill * 1e9 / maxcount,
+         iter * 1e9 / (maxcount / ITER_LENGTH * ITER_LENGTH),
+         del * 1e9 / ITER_LENGTH);
+}
+
+static unsigned int get_argv(char *argv)
+{
+  long int ret = strtol(argv, NULL, 0);
+  if (ret == LONG_MIN || ret == LONG_MAX) {
+    perror("strtol");
+    exit(1);
+  }
+  return ret;
+}
+
+int main(int argc, char **argv)
+{
+  size_t maxcount = MAXCOUNT;
+  size_t i;
+
+  if (argc > 1)
+    maxcount = get_argv(argv[1]);
+
+  check(maxcount / 10);
+  check_handles();
+  for (i = 0; i < sizeof(impls) / sizeof(impls[0]); i++)
+    bench(&impls[i], maxcount);
+  bench_handles(maxcount);
+
+  return 0;
+}
@@ -0,0 +1,169 @@
+/*
+ * Type-specialized queue test
+ *
+ * Check that queue<T> behaves like queue_t on items stored inline, including
+ * non-trivial ones whose constructors and destructors must be balanced, then
+ * time a find_item-like search through queue<T>::iterate() and a lambda
+ * against queue_iterate() and a callback on the same items.
+ */
+
+#include <cassert>
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <string>
+
+extern "C" {
+#include <queue.h>
+}
+#include <queue.hpp>
+
+#define MAXCOUNT 1000000
+#define LENGTH 1000
+
+struct entry {
+  unsigned long owner;
+  void *data;
+};
+
+static int live_strings;
+
+struct counted {
+  std::string value;
+
+  counted(const char *v) : value(v) { live_strings++; }
+  counted(const counted &other) : value(other.value) { live_strings++; }
+  counted(counted &&other) : value(std::move(other.value)) { live_strings++; }
+  counted &operator=(counted &&other)
+  {
+    value = std::move(other.value);
+    return *this;
+  }
+  ~counted() { live_strings--; }
+  bool operator==(const counted &other) const { return value == other.value; }
+};
+
+static double now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void check(void)
+{
+  uthread::queue<int> q;
+  uthread::queue<int>::handle handles[LENGTH];
+  int i, value;
+
+  for (i = 0; i < LENGTH; i++)
+    assert(q.enqueue(i, &handles[i]) == 0);
+  assert(q.length() == LENGTH);
+
+  /* remove every odd item by handle, and a few even ones by value */
+  for (i = 1; i < LENGTH; i += 2)
+    assert(q.remove(handles[i]) == 0);
+  assert(q.erase(10) == 0 && q.erase(10) == -1 && q.erase(11) == -1);
+  assert(q.length() == LENGTH / 2 - 1);
+
+  int *found = q.iterate([](int &item) { return item > 500; });
+  assert(found && *found == 502);
+  assert(q.iterate([](int &item) { return item < 0; }) == nullptr);
+
+  for (i = 0; i < LENGTH; i += 2) {
+    if (i == 10)
+      continue;
+    assert(q.dequeue(value) == 0 && value == i);
+  }
+  assert(q.dequeue(value) == -1 && q.length() == 0);
+
+  /* items left over are destroyed along with the queue */
+  {
+    uthread::queue<counted> strings;
+    counted out("");
+
+    strings.enqueue(counted("a"));
+    strings.enqueue("b");
+    strings.enqueue(counted("c"));
+    assert(strings.erase(counted("b")) == 0);
+    assert(strings.dequeue(out) == 0 && out.value == "a");
+    assert(strings.length() == 1);
+  }
+  assert(live_strings == 0);
+}
+
+static int find_item(void *data, void *arg)
+{
+  return ((struct entry*)data)->owner == *(unsigned long*)arg;
+}
+
+static void bench(size_t maxcount)
+{
+  static struct entry entries[LENGTH];
+  uthread::queue<entry> q;
+  queue_t cq = queue_create();
+  size_t i, rounds = maxcount / LENGTH;
+  double start, c_time, cpp_time;
+  unsigned long found = 0;
+
+  for (i = 0; i < LENGTH; i++) {
+    entries[i].owner = i;
+    entries[i].data = &entries[i];
+    queue_enqueue(cq, &entries[i]);
+    q.enqueue(entries[i]);
+  }
+
+  /* look for the last entry, as get_tps does for the newest thread */
+  start = now();
+  for (i = 0; i < rounds; i++) {
+    unsigned long owner = LENGTH - 1 - (i & 1);
+    struct entry *e = NULL;
+    queue_iterate(cq, find_item, &owner, (void**)&e);
+    found += e->owner;
+  }
+  c_time = now() - start;
+
+  start = now();
+  for (i = 0; i < rounds; i++) {
+    unsigned long owner = LENGTH - 1 - (i & 1);
+    entry *e = q.iterate([owner](entry &item) { return item.owner == owner; });
+    found += e->owner;
+  }
+  cpp_time = now() - start;
+
+  assert(found > 0);
+  printf("queue_t  search %5.2f ns/item\nqueue<T> search %5.2f ns/item\n",
+         c_time * 1e9 / (rounds * LENGTH), cpp_time * 1e9 / (rounds * LENGTH));
+
+  while (queue_length(cq) > 0) {
+    void *data;
+    queue_dequeue(cq, &data);
+  }
+  queue_destroy(cq);
+}
+
+static unsigned int get_argv(char *argv)
+{
+  long int ret = strtol(argv, NULL, 0);
+  if (ret == LONG_MIN || ret == LONG_MAX) {
+    perror("strtol");
+    exit(1);
+  }
+  return ret;
+}
+
+int main(int argc, char **argv)
+{
+  size_t maxcount = MAXCOUNT * 10;
+
+  if (argc > 1)
+    maxcount = get_argv(argv[1]);
+
+  check();
+  bench(maxcount);
+
+  return 0;
+}
@@ -0,0 +1,138 @@
+/*
+ * Node-per-item queue
+ *
+ * The original implementation of queue.h, which allocates one doubly linked
+ * node for every enqueued item. Its functions are named node_queue_* so that
+ * queue_bench.c can link it next to the chunked queue of libuthread and
+ * compare both.
+ */
+
+#include <stdlib.h>
+
+#include <queue.h>
+
+struct node {
+  struct node *prev;
+  struct node *next;
+  void *data;
+};
+
+struct queue {
+  struct node *head;
+  struct node *tail;
+  size_t length;
+};
+
+queue_t node_queue_create(void);
+int node_queue_destroy(queue_t queue);
+int node_queue_enqueue(queue_t queue, void *data);
+int node_queue_dequeue(queue_t queue, void **data);
+int node_queue_delete(queue_t queue, void *data);
+int node_queue_iterate(queue_t queue, queue_func_t func, void *arg,
+                       void **data);
+int node_queue_length(queue_t queue);
+
+static void queue_delete_item(queue_t queue, struct node *node)
+{
+  if (node->prev)
+    node->prev->next = node->next;
+  else
+    queue->head = node->next;
+
+  if (node->next)
+    node->next->prev = node->prev;
+  else
+    queue->tail = node->prev;
+
+  queue->length--;
+  free(node);
+}
+
+queue_t node_queue_create(void)
+{
+  return calloc(1, sizeof(struct queue));
+}
+
+int node_queue_destroy(queue_t queue)
+{
+  if (!queue || queue->length)
+    return -1;
+
+  free(queue);
+  return 0;
+}
+
+int node_queue_enqueue(queue_t queue, void *data)
+{
+  struct node *node;
+
+  if (!queue || !data)
+    return -1;
+
+  node = malloc(sizeof(struct node));
+  if (!node)
+    return -1;
+
+  node->data = data;
+  node->next = NULL;
+  node->prev = queue->tail;
+  if (queue->length)
+    queue->tail->next = node;
+  else
+    queue->head = node;
+  queue->tail = node;
+  queue->length++;
+  return 0;
+}
+
+int node_queue_dequeue(queue_t queue, void **data)
+{
+  if (!queue || !data || !queue->length)
+    return -1;
+
+  *data = queue->head->data;
+  queue_delete_item(queue, queue->head);
+  return 0;
+}
+
+int node_queue_delete(queue_t queue, void *data)
+{
+  struct node *node;
+
+  if (!queue || !data)
+    return -1;
+
+  for (node = queue->head; node; node = node->next) {
+    if (node->data == data) {
+      queue_delete_item(queue, node);
+      return 0;
+    }
+  }
+  return -1;
+}
+
+int node_queue_iterate(queue_t queue, queue_func_t func, void *arg,
+                       void **data)
+{
+  struct node *node;
+
+  if (!queue || !func)
+    return -1;
+
+  for (node = queue->head; node; node = node->next) {
+    if (func(node->data, arg) == 1) {
+      if (data)
+        *data = node->data;
+      break;
+    }
+  }
+  return 0;
+}
+
+int node_queue_length(queue_t queue)
+{
+  if (!queue)
+    return -1;
+
+  return queue->length;
+}
@@ -0,0 +1,94 @@
+/*
+ * Atomic multi-semaphore test
+ *
+ * Dining philosophers: each philosopher needs the fork on its left and the fork
+ * on its right, and takes both at once with sem_down_all(), so that it never
+ * holds one fork while waiting for the other. Every other philosopher lists
+ * the forks in the opposite order, which sem_down_all() must handle the same
+ * way. Two philosophers must never use the same fork at the same time.
+ */
+
+#include <assert.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <sem.h>
+
+#define NPHILOSOPHERS 5
+#define MAXCOUNT      2000
+
+static struct semaphore forks[NPHILOSOPHERS];
+static int used[NPHILOSOPHERS];
+static size_t maxcount = MAXCOUNT;
+
+static void *philosopher(void *arg)
+{
+  int id = (long)arg;
+  int left = id, right = (id + 1) % NPHILOSOPHERS;
+  sem_t mine[2];
+  size_t i;
+
+  if (id % 2) {
+    mine[0] = &forks[left];
+    mine[1] = &forks[right];
+  } else {
+    mine[0] = &forks[right];
+    mine[1] = &forks[left];
+  }
+
+  for (i = 0; i < maxcount; i++) {
+    sem_down_all(mine, 2);
+    assert(__sync_add_and_fetch(&used[left], 1) == 1);
+    assert(__sync_add_and_fetch(&used[right], 1) == 1);
+    sched_yield();
+    __sync_sub_and_fetch(&used[left], 1);
+    __sync_sub_and_fetch(&used[right], 1);
+    sem_up(mine[1]);
+    sem_up(mine[0]);
+  }
+
+  return NULL;
+}
+
+static unsigned int get_argv(char *argv)
+{
+  long int ret = strtol(argv, NULL, 0);
+  if (ret == LONG_MIN || ret == LONG_MAX) {
+    perror("strtol");
+    exit(1);
+  }
+  return ret;
+}
+
+int main(int argc, char **argv)
+{
+  pthread_t tid[NPHILOSOPHERS];
+  sem_t all[NPHILOSOPHERS];
+  int i;
+
+  if (argc > 1)
+    maxcount = get_argv(argv[1]);
+
+  for (i = 0; i < NPHILOSOPHERS; i++) {
+    sem_init(&forks[i], 1);
+    all[i] = &forks[i];
+  }
+
+  for (i = 0; i < NPHILOSOPHERS; i++)
+    pthread_create(&tid[i], NULL, philosopher, (void*)(long)i);
+  for (i = 0; i < NPHILOSOPHERS; i++)
+    pthread_join(tid[i], NULL);
+  printf("%d philosophers ate %zu times each!\n", NPHILOSOPHERS, maxcount);
+
+  /* all the forks are back on the table */
+  sem_down_all(all, NPHILOSOPHERS);
+  for (i = 0; i < NPHILOSOPHERS; i++) {
+    sem_up(&forks[i]);
+    assert(sem_fini(&forks[i]) == 0);
+  }
+
+  return 0;
+}
@@ -0,0 +1,100 @@
+/*
+ * Semaphore handoff test
+ *
+ * Several threads repeatedly take and release a semaphore of count 1 while
+ * competing for it. In handoff mode, a woken thread always owns the resource
+ * so there can never be more wakeups than acquisitions. Both modes must still
+ * provide mutual exclusion. The semaphore is embedded in the test structure and
+ * initialized in place.
+ */
+
+#include <assert.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <sem.h>
+
+#define NTHREADS 4
+#define MAXCOUNT 10000
+
+struct test {
+  struct semaphore sem;
+  size_t maxcount;
+  int inside;
+  size_t total;
+};
+
+static void *worker(void *arg)
+{
+  struct test *t = (struct test*)arg;
+  size_t i;
+
+  for (i = 0; i < t->maxcount; i++) {
+    sem_down(&t->sem);
+    assert(t->inside++ == 0);
+    t->total++;
+    sched_yield();
+    t->inside--;
+    sem_up(&t->sem);
+  }
+
+  return NULL;
+}
+
+static void run(int mode, size_t maxcount)
+{
+  struct test t;
+  struct sem_stats stats;
+  pthread_t tid[NTHREADS];
+  int i;
+
+  sem_init(&t.sem, 1);
+  t.maxcount = maxcount;
+  t.inside = 0;
+  t.total = 0;
+  sem_setmode(&t.sem, mode);
+
+  for (i = 0; i < NTHREADS; i++)
+    pthread_create(&tid[i], NULL, worker, &t);
+  for (i = 0; i < NTHREADS; i++)
+    pthread_join(tid[i], NULL);
+
+  assert(t.total == NTHREADS * maxcount);
+
+  sem_getstats(&t.sem, &stats);
+  assert(stats.acquires == NTHREADS * maxcount);
+  if (mode == SEM_MODE_HANDOFF)
+    assert(stats.wakeups <= stats.acquires);
+
+  printf("%s: %lu acquires, %lu wakeups, %.3f wakeups per acquire\n",
+         mode == SEM_MODE_HANDOFF ? "handoff" : "barging",
+         stats.acquires, stats.wakeups, stats.wakeups_per_acquire);
+
+  assert(sem_fini(&t.sem) == 0);
+}
+
+static unsigned int get_argv(char *argv)
+{
+  long int ret = strtol(argv, NULL, 0);
+  if (ret == LONG_MIN || ret == LONG_MAX) {
+    perror("strtol");
+    exit(1);
+  }
+  return ret;
+}
+
+int main(int argc, char **argv)
+{
+  size_t maxcount = MAXCOUNT;
+
+  if (argc > 1)
+    maxcount = get_argv(argv[1]);
+
+  run(SEM_MODE_BARGING, maxcount);
+  run(SEM_MODE_HANDOFF, maxcount);
+
+  return 0;
+}
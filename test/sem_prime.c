@@ -6,15 +6,19 @@
  * pipeline consists of filtering thread, added dynamically each time a new
  * prime number is found and which filters out subsequent numbers that are
  * multiples of that prime.
+ *
+ * With -u, every thread of the pipeline is a user thread instead of a pthread.
  */
 
 #include <limits.h>
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 #include <sem.h>
+#include <uthread.h>
 
 #define MAXPRIME 1000
 
@@ -33,6 +37,23 @@ struct filter {
 };
 
 static unsigned int max = MAXPRIME;
+static int user;
+
+static void spawn(pthread_t *tid, void *(*func)(void*), void *arg)
+{
+  if (user)
+    uthread_create(tid, func, arg);
+  else
+    pthread_create(tid, NULL, func, arg);
+}
+
+static void join(pthread_t tid)
+{
+  if (user)
+    uthread_join(tid, NULL);
+  else
+    pthread_join(tid, NULL);
+}
 
 /* Producer thread: produces all numbers, from 2 to max */
 static void *source(void *arg)
@@ -90,7 +111,7 @@ static void *sink(void *arg)
   p->produce = sem_create(0);
   p->consume = sem_create(0);
 
-  pthread_create(&tid, NULL, source, p);
+  spawn(&tid, source, p);
 
   while (1) {
     struct filter *f;
@@ -115,21 +136,21 @@ static void *sink(void *arg)
 
     f->right = p;
 
-    pthread_create(&f->tid, NULL, filter, f);
+    spawn(&f->tid, filter, f);
 
     if (f_head)
       f->next = f_head;
     f_head = f;
   }
 
-  pthread_join(tid, NULL);
+  join(tid);
   sem_destroy(init_p->produce);
   sem_destroy(init_p->consume);
 
   while (f_head) {
     struct filter *old = f_head;
 
-    pthread_join(f_head->tid, NULL);
+    join(f_head->tid);
     sem_destroy(f_head->right->produce);
     sem_destroy(f_head->right->consume);
     f_head = f_head->next;
@@ -154,11 +175,17 @@ int main(int argc, char **argv)
 {
   pthread_t tid;
 
+  if (argc > 1 && !strcmp(argv[1], "-u")) {
+    user = 1;
+    argc--;
+    argv++;
+  }
+
   if (argc > 1)
     max = get_argv(argv[1]);
 
-  pthread_create(&tid, NULL, sink, NULL);
-  pthread_join(tid, NULL);
+  spawn(&tid, sink, NULL);
+  join(tid);
 
   return 0;
 }
@@ -0,0 +1,115 @@
+/*
+ * Semaphore contention profiler test
+ *
+ * Worker threads share a heavily contended semaphore of count 1, holding it
+ * for a while, and an uncontended semaphore which each of them takes and
+ * releases right away. Every contended acquisition must land in exactly one
+ * bucket of the wait time histogram, and the contended semaphore must come
+ * first in the contention report. Finalizing a semaphore twice must leave the
+ * other semaphores in the report alone.
+ */
+
+#include <assert.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sem.h>
+
+#define NTHREADS 4
+#define MAXCOUNT 1000
+
+static sem_t hot, cold;
+static size_t maxcount = MAXCOUNT;
+
+static void *worker(void *arg)
+{
+  size_t i;
+
+  for (i = 0; i < maxcount; i++) {
+    sem_down(hot);
+    sched_yield();
+    sem_up(hot);
+
+    sem_down(cold);
+    sem_up(cold);
+  }
+
+  return NULL;
+}
+
+static unsigned int get_argv(char *argv)
+{
+  long int ret = strtol(argv, NULL, 0);
+  if (ret == LONG_MIN || ret == LONG_MAX) {
+    perror("strtol");
+    exit(1);
+  }
+  return ret;
+}
+
+int main(int argc, char **argv)
+{
+  struct sem_stats stats;
+  pthread_t tid[NTHREADS];
+  unsigned long sum = 0;
+  char line[256];
+  int i;
+
+  if (argc > 1)
+    maxcount = get_argv(argv[1]);
+
+  hot = sem_create(1);
+  cold = sem_create(NTHREADS);
+  assert(sem_setname(hot, "hot") == 0);
+  assert(sem_setname(cold, "cold") == 0);
+
+  for (i = 0; i < NTHREADS; i++)
+    pthread_create(&tid[i], NULL, worker, NULL);
+  for (i = 0; i < NTHREADS; i++)
+    pthread_join(tid[i], NULL);
+
+  sem_getstats(hot, &stats);
+  assert(stats.acquires == NTHREADS * maxcount);
+  assert(stats.contended > 0);
+  assert(stats.contended <= stats.acquires);
+  assert(stats.peak_waiting >= 1 && stats.peak_waiting < NTHREADS);
+  assert(stats.wait_max_ns <= stats.wait_total_ns);
+  for (i = 0; i < SEM_STATS_BUCKETS; i++)
+    sum += stats.wait_hist[i];
+  assert(sum == stats.contended);
+
+  // nobody ever has to wait for the cold semaphore
+  sem_getstats(cold, &stats);
+  assert(stats.acquires == NTHREADS * maxcount);
+  assert(stats.contended == 0 && stats.wait_total_ns == 0);
+  assert(stats.peak_waiting == 0);
+
+  // the report is sorted by total wait time, hot comes first
+  FILE *report = tmpfile();
+  assert(report);
+  assert(sem_report(report) == 0);
+  rewind(report);
+  assert(fgets(line, sizeof(line), report));
+  assert(fgets(line, sizeof(line), report));
+  assert(strncmp(line, "hot ", 4) == 0);
+  fclose(report);
+
+  sem_report(stdout);
+
+  /* finalizing again unlinks nothing, even once the neighbours are gone */
+  sem_t first = sem_create(0), second = sem_create(0);
+  assert(sem_setname(first, "first") == 0);
+  assert(sem_fini(first) == 0);
+  assert(sem_destroy(second) == 0);
+  assert(sem_fini(first) == 0);
+  free(first);
+
+  assert(sem_destroy(hot) == 0);
+  assert(sem_destroy(cold) == 0);
+
+  return 0;
+}
@@ -0,0 +1,101 @@
+/*
+ * Timed and non-blocking semaphore test
+ *
+ * Check that sem_trydown() never blocks, that sem_timeddown() gives up once its
+ * deadline is reached, and that many threads timing out on the same semaphore
+ * leave its waiting list empty without stealing resources from each other.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <sem.h>
+
+#define NTHREADS 200
+
+static sem_t sem;
+static int taken;
+
+static void deadline_in(struct timespec *ts, long ms)
+{
+  clock_gettime(CLOCK_REALTIME, ts);
+  ts->tv_sec += ms / 1000;
+  ts->tv_nsec += (ms % 1000) * 1000000;
+  if (ts->tv_nsec >= 1000000000) {
+    ts->tv_sec++;
+    ts->tv_nsec -= 1000000000;
+  }
+}
+
+static long ms_since(struct timespec *start)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  return (now.tv_sec - start->tv_sec) * 1000 +
+    (now.tv_nsec - start->tv_nsec) / 1000000;
+}
+
+static void *waiter(void *arg)
+{
+  struct timespec deadline;
+  long ms = (long)arg;
+
+  deadline_in(&deadline, ms);
+  if (sem_timeddown(sem, &deadline) == 0) {
+    __sync_fetch_and_add(&taken, 1);
+  } else {
+    assert(errno == ETIMEDOUT);
+  }
+
+  return NULL;
+}
+
+int main(int argc, char **argv)
+{
+  struct timespec start, deadline;
+  pthread_t tid[NTHREADS];
+  int i, sval;
+
+  sem = sem_create(0);
+
+  /* sem_trydown never blocks */
+  assert(sem_trydown(sem) == -1 && errno == EAGAIN);
+  sem_up(sem);
+  assert(sem_trydown(sem) == 0);
+  printf("sem_trydown OK!\n");
+
+  /* sem_timeddown gives up at its deadline */
+  clock_gettime(CLOCK_REALTIME, &start);
+  deadline_in(&deadline, 50);
+  assert(sem_timeddown(sem, &deadline) == -1 && errno == ETIMEDOUT);
+  assert(ms_since(&start) >= 50);
+  printf("sem_timeddown timeout OK!\n");
+
+  /* an available semaphore is taken right away */
+  sem_up(sem);
+  assert(sem_timeddown(sem, &deadline) == 0);
+  printf("sem_timeddown take OK!\n");
+
+  /* many timed waiters, with only a few resources released */
+  for (i = 0; i < NTHREADS; i++)
+    pthread_create(&tid[i], NULL, waiter, (void*)(long)(20 + i % 50));
+  sem_up(sem);
+  sem_up(sem);
+  sem_up(sem);
+  for (i = 0; i < NTHREADS; i++)
+    pthread_join(tid[i], NULL);
+
+  /* exactly three waiters got a resource, and nobody is left waiting */
+  assert(taken == 3);
+  sem_getvalue(sem, &sval);
+  assert(sval == 0);
+  printf("sem_timeddown %d waiters OK!\n", NTHREADS);
+
+  assert(sem_destroy(sem) == 0);
+  return 0;
+}
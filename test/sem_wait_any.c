@@ -0,0 +1,78 @@
+/*
+ * Wait-on-any test
+ *
+ * Several producers each signal their own semaphore a given number of times,
+ * and a single dispatcher thread serves all of them with sem_wait_any(). The
+ * dispatcher must see exactly the right number of signals from each producer.
+ */
+
+#include <assert.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <sem.h>
+
+#define NPRODUCERS 12
+#define MAXCOUNT   1000
+
+static struct semaphore channels[NPRODUCERS];
+static size_t maxcount = MAXCOUNT;
+
+static void *producer(void *arg)
+{
+  sem_t sem = arg;
+  size_t i;
+
+  for (i = 0; i < maxcount; i++)
+    sem_up(sem);
+
+  return NULL;
+}
+
+static unsigned int get_argv(char *argv)
+{
+  long int ret = strtol(argv, NULL, 0);
+  if (ret == LONG_MIN || ret == LONG_MAX) {
+    perror("strtol");
+    exit(1);
+  }
+  return ret;
+}
+
+int main(int argc, char **argv)
+{
+  pthread_t tid[NPRODUCERS];
+  sem_t sems[NPRODUCERS];
+  size_t received[NPRODUCERS] = {0};
+  size_t i, index;
+
+  if (argc > 1)
+    maxcount = get_argv(argv[1]);
+
+  for (i = 0; i < NPRODUCERS; i++) {
+    sem_init(&channels[i], 0);
+    sems[i] = &channels[i];
+  }
+
+  for (i = 0; i < NPRODUCERS; i++)
+    pthread_create(&tid[i], NULL, producer, sems[i]);
+
+  /* one thread multiplexes all the producers */
+  for (i = 0; i < NPRODUCERS * maxcount; i++) {
+    assert(sem_wait_any(sems, NPRODUCERS, &index) == 0);
+    assert(index < NPRODUCERS);
+    received[index]++;
+  }
+
+  for (i = 0; i < NPRODUCERS; i++) {
+    pthread_join(tid[i], NULL);
+    assert(received[i] == maxcount);
+    assert(sem_trydown(sems[i]) == -1);
+    assert(sem_fini(sems[i]) == 0);
+  }
+  printf("%d producers, %zu signals each OK!\n", NPRODUCERS, maxcount);
+
+  return 0;
+}
@@ -0,0 +1,200 @@
+/*
+ * Synchronization primitives test
+ *
+ * Exercise the mutex, reader-writer lock, condition variable and barrier
+ * primitives under contention: a counter protected by a mutex, a table read by
+ * many readers while a writer keeps it consistent, a bounded buffer built out
+ * of a mutex and two condition variables, and threads going through several
+ * rounds of a barrier.
+ */
+
+#include <assert.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <barrier.h>
+#include <cond.h>
+#include <mutex.h>
+#include <rwlock.h>
+
+#define NTHREADS    6
+#define MAXCOUNT    20000
+#define TABLE_SIZE  16
+#define BUFFER_SIZE 4
+#define ROUNDS      50
+
+static struct mutex mutex;
+static struct rwlock rwlock;
+static struct cond not_empty, not_full;
+static struct barrier barrier;
+
+static size_t counter;
+static size_t table[TABLE_SIZE];
+static int writing;
+
+static size_t buffer[BUFFER_SIZE];
+static size_t size, head, tail;
+
+static int round_arrived[ROUNDS];
+static int serial[ROUNDS];
+
+static void *mutex_worker(void *arg)
+{
+  size_t i;
+
+  for (i = 0; i < MAXCOUNT; i++) {
+    mutex_lock(&mutex);
+    counter++;
+    if (i % 64 == 0)
+      sched_yield();
+    mutex_unlock(&mutex);
+  }
+
+  return NULL;
+}
+
+static void *reader(void *arg)
+{
+  size_t i, j;
+
+  for (i = 0; i < MAXCOUNT / 10; i++) {
+    rwlock_rdlock(&rwlock);
+    assert(!writing);
+    for (j = 1; j < TABLE_SIZE; j++)
+      assert(table[j] == table[0]);
+    rwlock_unlock(&rwlock);
+  }
+
+  return NULL;
+}
+
+static void *writer(void *arg)
+{
+  size_t i, j;
+
+  for (i = 0; i < MAXCOUNT / 10; i++) {
+    rwlock_wrlock(&rwlock);
+    writing = 1;
+    for (j = 0; j < TABLE_SIZE; j++) {
+      table[j]++;
+      if (j == TABLE_SIZE / 2)
+        sched_yield();
+    }
+    writing = 0;
+    rwlock_unlock(&rwlock);
+  }
+
+  return NULL;
+}
+
+static void *cond_consumer(void *arg)
+{
+  size_t i;
+
+  for (i = 0; i < MAXCOUNT; i++) {
+    mutex_lock(&mutex);
+    while (size == 0)
+      cond_wait(&not_empty, &mutex);
+    assert(buffer[tail] == i);
+    tail = (tail + 1) % BUFFER_SIZE;
+    size--;
+    cond_signal(&not_full);
+    mutex_unlock(&mutex);
+  }
+
+  return NULL;
+}
+
+static void *cond_producer(void *arg)
+{
+  size_t i;
+
+  for (i = 0; i < MAXCOUNT; i++) {
+    mutex_lock(&mutex);
+    while (size == BUFFER_SIZE)
+      cond_wait(&not_full, &mutex);
+    buffer[head] = i;
+    head = (head + 1) % BUFFER_SIZE;
+    size++;
+    cond_signal(&not_empty);
+    mutex_unlock(&mutex);
+  }
+
+  return NULL;
+}
+
+static void *barrier_worker(void *arg)
+{
+  int i, j;
+
+  for (i = 0; i < ROUNDS; i++) {
+    __sync_fetch_and_add(&round_arrived[i], 1);
+    if (barrier_wait(&barrier) == BARRIER_SERIAL_THREAD)
+      __sync_fetch_and_add(&serial[i], 1);
+
+    /* nobody gets past the barrier before everybody reached it */
+    assert(round_arrived[i] == NTHREADS);
+    for (j = i + 1; j < ROUNDS; j++)
+      assert(round_arrived[j] < NTHREADS);
+  }
+
+  return NULL;
+}
+
+int main(int argc, char **argv)
+{
+  pthread_t tid[NTHREADS];
+  int i;
+
+  mutex_init(&mutex);
+  rwlock_init(&rwlock);
+  cond_init(&not_empty);
+  cond_init(&not_full);
+  barrier_init(&barrier, NTHREADS);
+
+  /* mutex */
+  for (i = 0; i < NTHREADS; i++)
+    pthread_create(&tid[i], NULL, mutex_worker, NULL);
+  for (i = 0; i < NTHREADS; i++)
+    pthread_join(tid[i], NULL);
+  assert(counter == NTHREADS * MAXCOUNT);
+  assert(mutex_trylock(&mutex) == 0);
+  assert(mutex_trylock(&mutex) == -1);
+  mutex_unlock(&mutex);
+  printf("mutex OK!\n");
+
+  /* reader-writer lock, with two writers */
+  for (i = 0; i < NTHREADS; i++)
+    pthread_create(&tid[i], NULL, i < 2 ? writer : reader, NULL);
+  for (i = 0; i < NTHREADS; i++)
+    pthread_join(tid[i], NULL);
+  assert(table[0] == 2 * (MAXCOUNT / 10));
+  printf("rwlock OK!\n");
+
+  /* condition variables */
+  pthread_create(&tid[0], NULL, cond_producer, NULL);
+  pthread_create(&tid[1], NULL, cond_consumer, NULL);
+  pthread_join(tid[0], NULL);
+  pthread_join(tid[1], NULL);
+  assert(size == 0);
+  printf("cond OK!\n");
+
+  /* barrier */
+  for (i = 0; i < NTHREADS; i++)
+    pthread_create(&tid[i], NULL, barrier_worker, NULL);
+  for (i = 0; i < NTHREADS; i++)
+    pthread_join(tid[i], NULL);
+  for (i = 0; i < ROUNDS; i++)
+    assert(serial[i] == 1);
+  printf("barrier OK!\n");
+
+  assert(barrier_fini(&barrier) == 0);
+  assert(cond_fini(&not_full) == 0);
+  assert(cond_fini(&not_empty) == 0);
+  assert(rwlock_fini(&rwlock) == 0);
+  assert(mutex_fini(&mutex) == 0);
+
+  return 0;
+}
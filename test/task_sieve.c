@@ -0,0 +1,305 @@
+/*
+ * Task pool test and parallel sieve benchmark
+ *
+ * Futures are waited for, chained with continuations and destroyed before
+ * being done, and tasks recursively fork and join others on a pool with fewer
+ * runners than waiting tasks. The cost of a unit of work is then timed as a
+ * task and as a pthread, and the primes up to a maximum are counted with a
+ * segmented sieve, each range of segments being a task of a parallel loop,
+ * instead of the pipeline of one thread per prime of sem_prime. Finally, a
+ * future left when the pool is destroyed can still be waited for.
+ */
+
+#include <assert.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <task.h>
+
+#define MAXPRIME 10000000
+#define NRUNNERS 4
+#define NTASKS 10000
+#define SEGMENT (32 * 1024)
+
+static task_pool_t pool;
+
+static double now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *increment(void *arg)
+{
+  return (void*)((uintptr_t)arg + 1);
+}
+
+static void test_futures(void)
+{
+  future_t f, g;
+  void *result;
+  int i;
+
+  f = task_submit(pool, increment, (void*)41);
+  assert(f);
+  assert(future_wait(f, &result) == 0);
+  assert(result == (void*)42);
+
+  /* continuation of a future which is already done */
+  g = future_then(f, increment);
+  assert(g);
+  assert(future_wait(g, &result) == 0);
+  assert(result == (void*)43);
+  assert(future_destroy(f) == 0);
+  assert(future_destroy(g) == 0);
+
+  /* chain, only keeping the last future */
+  f = task_submit(pool, increment, (void*)0);
+  for (i = 0; i < 100; i++) {
+    g = future_then(f, increment);
+    assert(g);
+    assert(future_destroy(f) == 0);
+    f = g;
+  }
+  assert(future_wait(f, &result) == 0);
+  assert(result == (void*)101);
+  assert(future_destroy(f) == 0);
+
+  assert(task_submit(NULL, increment, NULL) == NULL);
+  assert(task_submit(pool, NULL, NULL) == NULL);
+  assert(future_wait(NULL, NULL) == -1);
+}
+
+/* each task forks the larger subproblem and solves the smaller one itself */
+static void *fib(void *arg)
+{
+  uintptr_t n = (uintptr_t)arg;
+  void *a, *b;
+
+  if (n < 2)
+    return arg;
+
+  future_t f = task_submit(pool, fib, (void*)(n - 1));
+  assert(f);
+  b = fib((void*)(n - 2));
+  assert(future_wait(f, &a) == 0);
+  future_destroy(f);
+
+  return (void*)((uintptr_t)a + (uintptr_t)b);
+}
+
+static void test_fork_join(void)
+{
+  void *result;
+  future_t f = task_submit(pool, fib, (void*)20);
+
+  assert(future_wait(f, &result) == 0);
+  assert(result == (void*)6765);
+  future_destroy(f);
+}
+
+static void sum_squares(size_t begin, size_t end, void *arg)
+{
+  unsigned long long sum = 0;
+  size_t i;
+
+  for (i = begin; i < end; i++)
+    sum += (unsigned long long)i * i;
+  __atomic_fetch_add((unsigned long long*)arg, sum, __ATOMIC_RELAXED);
+}
+
+static void test_parallel_for(void)
+{
+  unsigned long long sum = 0;
+  size_t n = 100000, grain;
+
+  for (grain = 0; grain < 100000; grain = grain * 10 + 7) {
+    sum = 0;
+    assert(task_parallel_for(pool, 0, n, grain, sum_squares, &sum) == 0);
+    assert(sum == (unsigned long long)(n - 1) * n * (2 * n - 1) / 6);
+  }
+
+  assert(task_parallel_for(pool, 5, 5, 0, sum_squares, &sum) == 0);
+  assert(task_parallel_for(NULL, 0, n, 0, sum_squares, &sum) == -1);
+}
+
+static void *nothing(void *arg)
+{
+  return arg;
+}
+
+/* one unit of work per task, against one per pthread as sem_prime does */
+static void bench_fanout(size_t ntasks)
+{
+  future_t *futures = malloc(ntasks * sizeof(future_t));
+  pthread_t *tids = malloc(ntasks * sizeof(pthread_t));
+  double start, tasks, threads;
+  size_t i;
+
+  start = now();
+  for (i = 0; i < ntasks; i++)
+    futures[i] = task_submit(pool, nothing, NULL);
+  for (i = 0; i < ntasks; i++) {
+    future_wait(futures[i], NULL);
+    future_destroy(futures[i]);
+  }
+  tasks = now() - start;
+
+  start = now();
+  for (i = 0; i < ntasks; i++)
+    pthread_create(&tids[i], NULL, nothing, NULL);
+  for (i = 0; i < ntasks; i++)
+    pthread_join(tids[i], NULL);
+  threads = now() - start;
+
+  printf("fan-out: %.0f ns per task, %.0f ns per pthread\n",
+         tasks * 1e9 / ntasks, threads * 1e9 / ntasks);
+
+  free(futures);
+  free(tids);
+}
+
+struct sieve {
+  size_t max;
+  unsigned int *primes; /* base primes, up to the square root of max */
+  size_t nprimes;
+  size_t *counts;       /* primes found in each segment */
+};
+
+/* count the primes of segments [begin, end) */
+static void sieve_segments(size_t begin, size_t end, void *arg)
+{
+  struct sieve *s = arg;
+  char composite[SEGMENT];
+  size_t seg, i, j;
+
+  for (seg = begin; seg < end; seg++) {
+    size_t low = seg * SEGMENT, high = low + SEGMENT;
+    size_t count = 0;
+
+    if (high > s->max + 1)
+      high = s->max + 1;
+    memset(composite, 0, high - low);
+
+    for (i = 0; i < s->nprimes; i++) {
+      size_t p = s->primes[i];
+      if (p * p >= high)
+        break;
+      j = (low + p - 1) / p * p;
+      if (j < p * p)
+        j = p * p;
+      for (; j < high; j += p)
+        composite[j - low] = 1;
+    }
+
+    for (j = low < 2 ? 2 : low; j < high; j++)
+      count += !composite[j - low];
+    s->counts[seg] = count;
+  }
+}
+
+static size_t sieve(struct sieve *s, int parallel)
+{
+  size_t nsegments = s->max / SEGMENT + 1, total = 0, i;
+
+  if (parallel)
+    task_parallel_for(pool, 0, nsegments, 0, sieve_segments, s);
+  else
+    sieve_segments(0, nsegments, s);
+
+  for (i = 0; i < nsegments; i++)
+    total += s->counts[i];
+  return total;
+}
+
+static void bench_sieve(size_t max)
+{
+  struct sieve s;
+  size_t root = 1, i, j, sequential, parallel;
+  double start, t1, t2;
+  char *composite;
+
+  while (root * root <= max)
+    root++;
+
+  /* base primes, with a plain sieve */
+  composite = calloc(root + 1, 1);
+  s.primes = malloc((root + 1) * sizeof(unsigned int));
+  s.nprimes = 0;
+  for (i = 2; i <= root; i++) {
+    if (composite[i])
+      continue;
+    s.primes[s.nprimes++] = i;
+    for (j = i * i; j <= root; j += i)
+      composite[j] = 1;
+  }
+  free(composite);
+
+  s.max = max;
+  s.counts = calloc(max / SEGMENT + 1, sizeof(size_t));
+
+  start = now();
+  sequential = sieve(&s, 0);
+  t1 = now() - start;
+
+  start = now();
+  parallel = sieve(&s, 1);
+  t2 = now() - start;
+
+  assert(sequential == parallel);
+  printf("sieve: %zu primes up to %zu, sequential %.1f ms, tasks %.1f ms\n",
+         parallel, max, t1 * 1e3, t2 * 1e3);
+
+  free(s.primes);
+  free(s.counts);
+}
+
+static unsigned int get_argv(char *argv)
+{
+  long int ret = strtol(argv, NULL, 0);
+  if (ret == LONG_MIN || ret == LONG_MAX) {
+    perror("strtol");
+    exit(1);
+  }
+  return ret;
+}
+
+int main(int argc, char **argv)
+{
+  size_t max = MAXPRIME;
+  size_t nrunners = NRUNNERS;
+  void *result;
+  future_t f;
+
+  if (argc > 1)
+    max = get_argv(argv[1]);
+  if (argc > 2)
+    nrunners = get_argv(argv[2]);
+
+  pool = task_pool_create(nrunners);
+  assert(pool);
+
+  test_futures();
+  test_fork_join();
+  test_parallel_for();
+
+  bench_fanout(NTASKS);
+  bench_sieve(max);
+
+  /* futures outlive their pool, but cannot be continued anymore */
+  f = task_submit(pool, nothing, (void*)42);
+  assert(f);
+  assert(task_pool_destroy(pool) == 0);
+  assert(future_then(f, nothing) == NULL);
+  assert(future_wait(f, &result) == 0 && result == (void*)42);
+  assert(future_destroy(f) == 0);
+
+  return 0;
+}
@@ -0,0 +1,212 @@
+/*
+ * TPS broadcast region test
+ *
+ * A reader keeps using a version while newer ones are published, and
+ * replaced versions are only unmapped once no reader can be using them
+ * anymore. Then pthreads and user threads read the broadcast region while a
+ * writer publishes new versions: every version a reader gets must be whole,
+ * and newer than or the same as the previous one it got. munmap is wrapped to
+ * count the versions reclaimed.
+ */
+
+#include <assert.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <thread.h>
+#include <tps.h>
+#include <uthread.h>
+
+#define NREADERS 4
+#define NVERSIONS 10000
+
+static size_t nunmapped;
+
+int __real_munmap(void *addr, size_t len);
+int __wrap_munmap(void *addr, size_t len)
+{
+  /* thread stacks are unmapped too */
+  if (len == TPS_SIZE)
+    __atomic_fetch_add(&nunmapped, 1, __ATOMIC_RELAXED);
+  return __real_munmap(addr, len);
+}
+
+/* version @seq: its number, then a byte pattern, with a varying length */
+static size_t make_version(char *buffer, uint32_t seq)
+{
+  size_t length = sizeof(seq) + seq % 512;
+
+  memcpy(buffer, &seq, sizeof(seq));
+  memset(buffer + sizeof(seq), seq & 0xff, length - sizeof(seq));
+  return length;
+}
+
+static uint32_t check_version(const char *data, size_t length)
+{
+  uint32_t seq;
+  size_t i;
+
+  memcpy(&seq, data, sizeof(seq));
+  assert(length == sizeof(seq) + seq % 512);
+  for (i = sizeof(seq); i < length; i++)
+    assert((unsigned char)data[i] == (seq & 0xff));
+  return seq;
+}
+
+static void publish(uint32_t seq)
+{
+  char buffer[TPS_SIZE];
+  size_t length = make_version(buffer, seq);
+
+  assert(tps_broadcast_publish(length, buffer) == 0);
+}
+
+static void test_api(void)
+{
+  tps_reader_t reader = tps_reader_create();
+  char buffer[TPS_SIZE + 1] = { 0 };
+  const char *data;
+  size_t length;
+
+  assert(reader);
+  assert(tps_broadcast_enter(reader, NULL) == NULL);
+  assert(tps_broadcast_exit(reader) == -1);
+  assert(tps_broadcast_enter(NULL, NULL) == NULL);
+  assert(tps_broadcast_exit(NULL) == -1);
+
+  assert(tps_broadcast_publish(TPS_SIZE + 1, buffer) == -1);
+  assert(tps_broadcast_publish(0, NULL) == -1);
+  assert(tps_broadcast_publish(TPS_SIZE, buffer) == 0);
+  publish(1);
+
+  data = tps_broadcast_enter(reader, &length);
+  assert(data);
+  assert(check_version(data, length) == 1);
+
+  /* nested, and on the same version */
+  assert(tps_broadcast_enter(reader, NULL) == data);
+  assert(tps_broadcast_exit(reader) == 0);
+  assert(tps_reader_destroy(reader) == -1);
+  assert(tps_broadcast_exit(reader) == 0);
+  assert(tps_broadcast_exit(reader) == -1);
+
+  assert(tps_reader_destroy(reader) == 0);
+  assert(tps_reader_destroy(NULL) == -1);
+}
+
+static void test_reclaim(void)
+{
+  tps_reader_t reader = tps_reader_create();
+  const char *data;
+  size_t length, unmapped;
+  uint32_t seq;
+
+  publish(2);
+  data = tps_broadcast_enter(reader, &length);
+  assert(check_version(data, length) == 2);
+
+  /* the version being read stays mapped, and unchanged */
+  unmapped = nunmapped;
+  for (seq = 3; seq < 13; seq++)
+    publish(seq);
+  assert(check_version(data, length) == 2);
+  assert(nunmapped == unmapped);
+
+  /* and is reclaimed once done reading, along with all the others */
+  assert(tps_broadcast_exit(reader) == 0);
+  publish(13);
+  assert(nunmapped == unmapped + 11);
+
+  data = tps_broadcast_enter(reader, &length);
+  assert(check_version(data, length) == 13);
+  assert(tps_broadcast_exit(reader) == 0);
+  assert(tps_reader_destroy(reader) == 0);
+}
+
+static int stop;
+
+static void *read_loop(void *arg)
+{
+  tps_reader_t reader = tps_reader_create();
+  uint32_t last = 0, seq;
+  size_t reads = 0;
+
+  assert(reader);
+  while (!__atomic_load_n(&stop, __ATOMIC_ACQUIRE)) {
+    size_t length;
+    const char *data = tps_broadcast_enter(reader, &length);
+
+    seq = check_version(data, length);
+    assert(seq >= last);
+    last = seq;
+    assert(tps_broadcast_exit(reader) == 0);
+
+    reads++;
+    thread_yield();
+  }
+
+  assert(tps_reader_destroy(reader) == 0);
+  return (void*)reads;
+}
+
+static void test_concurrent(size_t nversions)
+{
+  pthread_t ptids[NREADERS];
+  uthread_t utids[NREADERS];
+  size_t unmapped = nunmapped, reads = 0;
+  uint32_t seq;
+  void *ret;
+  int i;
+
+  for (i = 0; i < NREADERS; i++) {
+    assert(pthread_create(&ptids[i], NULL, read_loop, NULL) == 0);
+    assert(uthread_create(&utids[i], read_loop, NULL) == 0);
+  }
+
+  for (seq = 100; seq < 100 + nversions; seq++)
+    publish(seq);
+
+  __atomic_store_n(&stop, 1, __ATOMIC_RELEASE);
+  for (i = 0; i < NREADERS; i++) {
+    assert(pthread_join(ptids[i], &ret) == 0);
+    reads += (size_t)ret;
+    assert(uthread_join(utids[i], &ret) == 0);
+    reads += (size_t)ret;
+  }
+
+  /* with no readers left, every replaced version is reclaimed */
+  publish(seq);
+  assert(nunmapped == unmapped + nversions + 1);
+
+  printf("broadcast: %zu versions, %zu reads\n", nversions, reads);
+}
+
+static unsigned int get_argv(char *argv)
+{
+  long int ret = strtol(argv, NULL, 0);
+  if (ret == LONG_MIN || ret == LONG_MAX) {
+    perror("strtol");
+    exit(1);
+  }
+  return ret;
+}
+
+int main(int argc, char **argv)
+{
+  size_t nversions = NVERSIONS;
+
+  if (argc > 1)
+    nversions = get_argv(argv[1]);
+
+  tps_init(1);
+
+  test_api();
+  test_reclaim();
+  test_concurrent(nversions);
+
+  return 0;
+}
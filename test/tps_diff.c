@@ -0,0 +1,226 @@
+/*
+ * TPS page kernels test
+ *
+ * Each version of the diff kernel the CPU supports (AVX2, SSE2, scalar)
+ * diffs random pages, aligned or not, with random changes, against a byte by
+ * byte reference, and pages are copied and compared along the way. Then tps_snapshot and tps_diff
+ * report the changes made to a TPS, and tps_compare compares the TPS of
+ * threads, shared after a clone, copied, and then written to.
+ */
+
+#include <assert.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <page.h>
+#include <sem.h>
+#include <tps.h>
+
+#define NROUNDS 1000
+#define MAXRANGES 64
+
+static const char *isas[] = { "avx2", "sse2", "scalar" };
+
+/* reference diff, one byte at a time */
+static size_t diff_bytes(const char *a, const char *b, struct tps_range *ranges)
+{
+  size_t count = 0, i = 0;
+
+  while (i < TPS_SIZE) {
+    if (a[i] == b[i]) {
+      i++;
+      continue;
+    }
+
+    ranges[count].offset = i;
+    while (i < TPS_SIZE && a[i] != b[i])
+      i++;
+    ranges[count].length = i - ranges[count].offset;
+    count++;
+  }
+  return count;
+}
+
+/* change some random runs of bytes, sometimes none, sometimes a lot */
+static void mutate(char *page)
+{
+  int n = rand() % 4 == 0 ? 0 : rand() % 200, i;
+
+  for (i = 0; i < n; i++) {
+    size_t offset = rand() % TPS_SIZE;
+    size_t length = 1 + rand() % (rand() % 8 == 0 ? 300 : 4);
+
+    if (offset + length > TPS_SIZE)
+      length = TPS_SIZE - offset;
+    while (length--)
+      page[offset + length] ^= 1 + rand() % 255;
+  }
+}
+
+static void test_kernels(const char *isa, size_t nrounds)
+{
+  static struct tps_range expected[TPS_SIZE], ranges[TPS_SIZE];
+  static char buffer[3 * TPS_SIZE + 64] __attribute__((aligned(64)));
+  size_t round, i, count;
+
+  if (page_use(isa) == -1) {
+    printf("%s: not supported\n", isa);
+    return;
+  }
+  assert(strcmp(page_isa(), isa) == 0);
+
+  for (round = 0; round < nrounds; round++) {
+    /* every other round, unaligned pages */
+    char *a = buffer + (round % 2) * (1 + rand() % 63);
+    char *b = a + TPS_SIZE;
+    char *c = b + TPS_SIZE;
+
+    for (i = 0; i < TPS_SIZE; i++)
+      a[i] = rand();
+
+    page_copy(b, a);
+    assert(memcmp(a, b, TPS_SIZE) == 0);
+    assert(page_equal(a, b));
+    assert(page_diff(a, b, ranges, TPS_SIZE) == 0);
+
+    mutate(b);
+    count = diff_bytes(a, b, expected);
+    assert(page_equal(a, b) == (count == 0));
+    assert(page_diff(a, b, ranges, TPS_SIZE) == count);
+    assert(memcmp(ranges, expected, count * sizeof(ranges[0])) == 0);
+
+    /* only the first ranges are stored, but all are counted */
+    memset(ranges, 0xff, sizeof(ranges));
+    assert(page_diff(a, b, ranges, 3) == count);
+    assert(memcmp(ranges, expected,
+                  (count < 3 ? count : 3) * sizeof(ranges[0])) == 0);
+    assert(ranges[3].offset == (size_t)-1);
+
+    /* applying the ranges gives the changed page back */
+    memcpy(c, a, TPS_SIZE);
+    for (i = 0; i < count; i++)
+      memcpy(c + expected[i].offset, b + expected[i].offset,
+             expected[i].length);
+    assert(memcmp(b, c, TPS_SIZE) == 0);
+  }
+
+  /* every byte changed, and only the last one */
+  memset(buffer, 0, TPS_SIZE);
+  memset(buffer + TPS_SIZE, 1, TPS_SIZE);
+  assert(page_diff(buffer, buffer + TPS_SIZE, ranges, 1) == 1);
+  assert(ranges[0].offset == 0 && ranges[0].length == TPS_SIZE);
+  memset(buffer + TPS_SIZE, 0, TPS_SIZE - 1);
+  assert(!page_equal(buffer, buffer + TPS_SIZE));
+  assert(page_diff(buffer, buffer + TPS_SIZE, ranges, 1) == 1);
+  assert(ranges[0].offset == TPS_SIZE - 1 && ranges[0].length == 1);
+
+  printf("%s: ok\n", isa);
+}
+
+static pthread_t main_tid;
+static sem_t compared, cloned;
+
+/* clone the main thread's TPS, write @arg to it if not NULL, and wait */
+static void *cloner(void *arg)
+{
+  assert(tps_clone(main_tid) == 0);
+  if (arg)
+    assert(tps_write(0, strlen(arg) + 1, arg) == 0);
+
+  sem_up(cloned);
+  sem_down(compared);
+  assert(tps_destroy() == 0);
+  return NULL;
+}
+
+static int compare_clone(char *write)
+{
+  pthread_t tid;
+  int ret;
+
+  assert(pthread_create(&tid, NULL, cloner, write) == 0);
+  sem_down(cloned);
+  ret = tps_compare(main_tid, tid);
+  assert(tps_compare(tid, main_tid) == ret);
+  sem_up(compared);
+  assert(pthread_join(tid, NULL) == 0);
+  return ret;
+}
+
+static void test_tps(void)
+{
+  static char snapshot[TPS_SIZE];
+  struct tps_range ranges[MAXRANGES];
+  char hello[] = "hello", bye[] = "bye";
+
+  main_tid = pthread_self();
+  compared = sem_create(0);
+  cloned = sem_create(0);
+
+  assert(tps_snapshot(snapshot) == -1);
+  assert(tps_diff(snapshot, ranges, MAXRANGES) == -1);
+  assert(tps_create() == 0);
+  assert(tps_snapshot(NULL) == -1);
+  assert(tps_diff(NULL, ranges, MAXRANGES) == -1);
+  assert(tps_diff(snapshot, NULL, 1) == -1);
+
+  assert(tps_write(100, sizeof(hello), hello) == 0);
+  assert(tps_snapshot(snapshot) == 0);
+  assert(tps_diff(snapshot, ranges, MAXRANGES) == 0);
+  assert(tps_diff(snapshot, NULL, 0) == 0);
+
+  /* "hello" to "jello", and a new byte further */
+  assert(tps_write(100, 1, "j") == 0);
+  assert(tps_write(4000, 1, "!") == 0);
+  assert(tps_diff(snapshot, ranges, MAXRANGES) == 2);
+  assert(ranges[0].offset == 100 && ranges[0].length == 1);
+  assert(ranges[1].offset == 4000 && ranges[1].length == 1);
+  assert(tps_diff(snapshot, NULL, 0) == 2);
+  assert(tps_write(100, 1, "h") == 0);
+  assert(tps_write(4000, 1, "") == 0);
+  assert(tps_diff(snapshot, ranges, MAXRANGES) == 0);
+
+  /* shared page, same data in a copy, different data */
+  assert(tps_compare(main_tid, main_tid) == 0);
+  assert(compare_clone(NULL) == 0);
+  assert(tps_write(0, sizeof(bye), bye) == 0);
+  assert(compare_clone(bye) == 0);
+  assert(compare_clone(hello) == 1);
+  assert(tps_compare(main_tid, (pthread_t)1) == -1);
+
+  assert(tps_destroy() == 0);
+  sem_destroy(compared);
+  sem_destroy(cloned);
+}
+
+static unsigned int get_argv(char *argv)
+{
+  long int ret = strtol(argv, NULL, 0);
+  if (ret == LONG_MIN || ret == LONG_MAX) {
+    perror("strtol");
+    exit(1);
+  }
+  return ret;
+}
+
+int main(int argc, char **argv)
+{
+  const char *best = page_isa();
+  size_t nrounds = NROUNDS, i;
+
+  if (argc > 1)
+    nrounds = get_argv(argv[1]);
+
+  for (i = 0; i < sizeof(isas) / sizeof(isas[0]); i++)
+    test_kernels(isas[i], nrounds);
+  assert(page_use("mmx") == -1);
+  assert(page_use(best) == 0);
+
+  tps_init(1);
+  test_tps();
+
+  return 0;
+}
@@ -0,0 +1,211 @@
+/*
+ * Cross-process TPS test
+ *
+ * A worker process keeps its TPS in shared memory, and a supervisor process
+ * maps it read-only and sees the worker's writes as they happen. The
+ * supervisor then clones the worker's TPS, sees the same data until its first
+ * write, which neither the worker nor the supervisor's mapping see, and the
+ * worker maps the supervisor's copy in return. Freed slots come back zeroed.
+ * Finally, a clone's first write fails while every slot is taken, and
+ * succeeds once one is freed.
+ */
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <tps.h>
+
+#define NSLOTS 4
+
+/* pipes from the supervisor to the worker, and back */
+static int down[2], up[2];
+
+/* pipes releasing the threads holding slots, and acknowledging them */
+static int release[2], held[2];
+static pthread_t owner;
+
+static void send_slot(int fd, ssize_t slot)
+{
+  assert(write(fd, &slot, sizeof(slot)) == sizeof(slot));
+}
+
+static ssize_t recv_slot(int fd)
+{
+  ssize_t slot;
+
+  assert(read(fd, &slot, sizeof(slot)) == sizeof(slot));
+  return slot;
+}
+
+static void check_tps(const char *expected)
+{
+  char buffer[16] = { 0 };
+
+  assert(tps_read(0, sizeof(buffer), buffer) == 0);
+  assert(strcmp(buffer, expected) == 0);
+}
+
+static void worker(void)
+{
+  char buffer[16] = "hello";
+  const char *data;
+  ssize_t slot;
+
+  assert(tps_init_shared(1, NSLOTS) == 0);
+  assert(tps_create() == 0);
+  assert(tps_write(0, sizeof(buffer), buffer) == 0);
+  assert(tps_slot() == 0);
+  send_slot(up[1], tps_slot());
+
+  /* written while the supervisor has our TPS mapped */
+  recv_slot(down[0]);
+  strcpy(buffer, "world");
+  assert(tps_write(0, sizeof(buffer), buffer) == 0);
+  send_slot(up[1], 0);
+
+  /* the supervisor's own copy of our TPS, which we must not see */
+  slot = recv_slot(down[0]);
+  data = tps_map(getppid(), slot);
+  assert(data);
+  assert(strcmp(data, "supervisor") == 0);
+  assert(tps_unmap(data) == 0);
+  check_tps("world");
+
+  assert(tps_destroy() == 0);
+  send_slot(up[1], 0);
+  exit(0);
+}
+
+/* take a slot until released */
+static void *holder(void *arg)
+{
+  assert(tps_create() == 0);
+  send_slot(held[1], tps_slot());
+  recv_slot(release[0]);
+  assert(tps_destroy() == 0);
+  send_slot(held[1], 0);
+  return NULL;
+}
+
+/* copy on write with no slot left, then with one */
+static void *cloner(void *arg)
+{
+  char buffer[16] = "clone";
+
+  assert(tps_clone(owner) == 0);
+  assert(tps_write(0, sizeof(buffer), buffer) == -1);
+  check_tps("full");
+
+  send_slot(release[1], 0);
+  recv_slot(held[0]);
+  assert(tps_write(0, sizeof(buffer), buffer) == 0);
+  check_tps("clone");
+  assert(tps_destroy() == 0);
+  return NULL;
+}
+
+static void test_full(void)
+{
+  char buffer[16] = "full";
+  pthread_t tid[NSLOTS];
+  int i;
+
+  assert(pipe(release) == 0);
+  assert(pipe(held) == 0);
+  owner = pthread_self();
+  assert(tps_create() == 0);
+  assert(tps_write(0, sizeof(buffer), buffer) == 0);
+
+  for (i = 0; i < NSLOTS - 1; i++) {
+    assert(pthread_create(&tid[i], NULL, holder, NULL) == 0);
+    assert(recv_slot(held[0]) != -1);
+  }
+
+  assert(pthread_create(&tid[NSLOTS - 1], NULL, cloner, NULL) == 0);
+  assert(pthread_join(tid[NSLOTS - 1], NULL) == 0);
+  check_tps("full");
+
+  for (i = 1; i < NSLOTS - 1; i++)
+    send_slot(release[1], 0);
+  for (i = 0; i < NSLOTS - 1; i++)
+    assert(pthread_join(tid[i], NULL) == 0);
+  assert(tps_destroy() == 0);
+}
+
+static void supervisor(pid_t pid)
+{
+  char buffer[16] = "supervisor", zeros[TPS_SIZE - 1] = { 0 };
+  char area[TPS_SIZE - 1];
+  const char *data;
+  ssize_t slot;
+  int status;
+
+  assert(tps_init_shared(0, NSLOTS) == 0);
+  assert(tps_init_shared(0, NSLOTS) == -1);
+  assert(tps_slot() == -1);
+
+  /* the worker's TPS, mapped read-only */
+  slot = recv_slot(up[0]);
+  data = tps_map(pid, slot);
+  assert(data);
+  assert(strcmp(data, "hello") == 0);
+  assert(tps_map(pid, NSLOTS) == NULL);
+  assert(tps_map(getpid() + 1000000, 0) == NULL);
+  assert(tps_unmap(NULL) == -1);
+
+  send_slot(down[1], 0);
+  recv_slot(up[0]);
+  assert(strcmp(data, "world") == 0);
+
+  /* a clone shares the worker's page until its first write */
+  assert(tps_clone_remote(pid, NSLOTS) == -1);
+  assert(tps_clone_remote(pid, slot) == 0);
+  assert(tps_clone_remote(pid, slot) == -1);
+  check_tps("world");
+  assert(tps_slot() == -1);
+  assert(tps_write(0, sizeof(buffer), buffer) == 0);
+  check_tps("supervisor");
+  assert(strcmp(data, "world") == 0);
+  assert(tps_slot() == 0);
+
+  send_slot(down[1], tps_slot());
+  recv_slot(up[0]);
+  assert(tps_unmap(data) == 0);
+  assert(waitpid(pid, &status, 0) == pid);
+  assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+  /* the worker is gone, and so is its shared memory object */
+  assert(tps_map(pid, slot) == NULL);
+
+  /* a freed slot is reused, and zeroed */
+  assert(tps_destroy() == 0);
+  assert(tps_create() == 0);
+  assert(tps_slot() == 0);
+  assert(tps_read(0, sizeof(area), area) == 0);
+  assert(memcmp(area, zeros, sizeof(area)) == 0);
+  assert(tps_destroy() == 0);
+
+  test_full();
+}
+
+int main(void)
+{
+  pid_t pid;
+
+  assert(pipe(down) == 0);
+  assert(pipe(up) == 0);
+
+  pid = fork();
+  assert(pid != -1);
+  if (pid == 0)
+    worker();
+  supervisor(pid);
+
+  printf("tps_shared: ok\n");
+  return 0;
+}
@@ -0,0 +1,205 @@
+/*
+ * Event tracer test
+ *
+ * Pthreads and user threads play ping-pong with semaphores, and TPS areas are
+ * created, cloned, copied on write and destroyed while tracing. The trace is
+ * then dumped and read back: every event must be there exactly as many times
+ * as it happened, in time order, and nothing must be recorded once tracing is
+ * stopped, until it is started again. The trace is kept if a path is given.
+ */
+
+#include <assert.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sem.h>
+#include <thread.h>
+#include <tps.h>
+#include <trace.h>
+#include <uthread.h>
+
+#define MAXCOUNT 1000
+
+struct pingpong {
+  sem_t ping;
+  sem_t pong;
+  size_t rounds;
+};
+
+static void *pinger(void *arg)
+{
+  struct pingpong *p = arg;
+  size_t i;
+
+  for (i = 0; i < p->rounds; i++) {
+    sem_up(p->ping);
+    sem_down(p->pong);
+  }
+  return NULL;
+}
+
+static void *ponger(void *arg)
+{
+  struct pingpong *p = arg;
+  size_t i;
+
+  for (i = 0; i < p->rounds; i++) {
+    sem_down(p->ping);
+    sem_up(p->pong);
+  }
+  return NULL;
+}
+
+static void pingpong(size_t rounds, int user)
+{
+  struct pingpong p = { sem_create(0), sem_create(0), rounds };
+  pthread_t a, b;
+
+  if (user) {
+    assert(uthread_create(&b, ponger, &p) == 0);
+    assert(uthread_create(&a, pinger, &p) == 0);
+    assert(uthread_join(a, NULL) == 0);
+    assert(uthread_join(b, NULL) == 0);
+  } else {
+    assert(pthread_create(&b, NULL, ponger, &p) == 0);
+    assert(pthread_create(&a, NULL, pinger, &p) == 0);
+    assert(pthread_join(a, NULL) == 0);
+    assert(pthread_join(b, NULL) == 0);
+  }
+
+  sem_destroy(p.ping);
+  sem_destroy(p.pong);
+}
+
+static pthread_t owner;
+
+static void *cloner(void *arg)
+{
+  char buffer[8] = "clone";
+
+  assert(tps_clone(owner) == 0);
+  assert(tps_write(0, sizeof(buffer), buffer) == 0);
+  assert(tps_destroy() == 0);
+  return NULL;
+}
+
+static void tps_ops(void)
+{
+  pthread_t tid;
+
+  owner = thread_self();
+  assert(tps_create() == 0);
+  assert(pthread_create(&tid, NULL, cloner, NULL) == 0);
+  assert(pthread_join(tid, NULL) == 0);
+  assert(tps_destroy() == 0);
+}
+
+/* number of events named @name of phase @ph, checking they come in order */
+static size_t count_events(const char *path, const char *name, char ph)
+{
+  char line[512], key[64];
+  double ts, last = -1e30;
+  size_t count = 0;
+  FILE *file = fopen(path, "r");
+
+  assert(file);
+  snprintf(key, sizeof(key), "\"name\": \"%s\"", name);
+  while (fgets(line, sizeof(line), file)) {
+    char *p = strstr(line, "\"ts\": ");
+    if (!p)
+      continue;
+
+    ts = strtod(p + 6, NULL);
+    assert(ts >= last);
+    last = ts;
+
+    p = strstr(line, "\"ph\": \"");
+    if (strstr(line, key) && p && p[7] == ph)
+      count++;
+  }
+
+  fclose(file);
+  return count;
+}
+
+static unsigned int get_argv(char *argv)
+{
+  long int ret = strtol(argv, NULL, 0);
+  if (ret == LONG_MIN || ret == LONG_MAX) {
+    perror("strtol");
+    exit(1);
+  }
+  return ret;
+}
+
+int main(int argc, char **argv)
+{
+  size_t maxcount = MAXCOUNT;
+  char path[] = "/tmp/trace-XXXXXX";
+  int fd;
+
+  if (argc > 1)
+    maxcount = get_argv(argv[1]);
+
+  assert(trace_dump("/dev/null") == -1);
+  assert(trace_stop() == -1);
+  if (trace_start(NULL) == -1) {
+    printf("tracing compiled out\n");
+    return 0;
+  }
+  assert(trace_start(NULL) == -1);
+
+  tps_init(0);
+  pingpong(maxcount, 0);
+  pingpong(maxcount, 1);
+  tps_ops();
+
+  /* nothing is recorded once stopped */
+  assert(trace_stop() == 0);
+  assert(trace_stop() == -1);
+  pingpong(maxcount, 0);
+
+  if (argc > 2) {
+    assert(trace_dump(argv[2]) == 0);
+    strcpy(path, argv[2]);
+  } else {
+    fd = mkstemp(path);
+    assert(fd != -1);
+    close(fd);
+    assert(trace_dump(path) == 0);
+  }
+
+  /* each round has two sem_up, and every sem_down which blocked woke up */
+  assert(count_events(path, "sem_up", 'i') == 4 * maxcount);
+  assert(count_events(path, "sem_down", 'B') ==
+         count_events(path, "sem_down", 'E'));
+  assert(count_events(path, "sem_down", 'B') > 0);
+  assert(count_events(path, "blocked", 'B') ==
+         count_events(path, "blocked", 'E'));
+  assert(count_events(path, "blocked", 'B') ==
+         count_events(path, "thread_unblock", 'i'));
+
+  assert(count_events(path, "tps_create", 'i') == 1);
+  assert(count_events(path, "tps_clone", 'i') == 1);
+  assert(count_events(path, "tps_cow", 'i') == 1);
+  assert(count_events(path, "tps_destroy", 'i') == 2);
+
+  printf("trace: %zu blocking sem_down\n",
+         count_events(path, "sem_down", 'B'));
+
+  /* tracing starts again, keeping what was recorded before */
+  assert(trace_start(NULL) == 0);
+  assert(trace_start(NULL) == -1);
+  pingpong(maxcount, 0);
+  assert(trace_stop() == 0);
+  assert(trace_dump(path) == 0);
+  assert(count_events(path, "sem_up", 'i') == 6 * maxcount);
+
+  if (argc <= 2)
+    unlink(path);
+  return 0;
+}
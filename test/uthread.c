@@ -0,0 +1,236 @@
+/*
+ * User thread test
+ *
+ * Run user threads on a small pool of workers: many short threads are created
+ * and joined (some from other user threads), threads yield and block on
+ * semaphores, wake up from timed waits, and keep their own thread private
+ * storage and priority even though they share and move between workers. A
+ * semaphore ping-pong is then timed between two pthreads and between two
+ * user threads.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <prio_sem.h>
+#include <sem.h>
+#include <tps.h>
+#include <uthread.h>
+
+#define NWORKERS 2
+#define NTHREADS 1000
+#define MAXCOUNT 100000
+
+static int counter;
+
+static void *increment(void *arg)
+{
+  __atomic_fetch_add(&counter, 1, __ATOMIC_RELAXED);
+  uthread_yield();
+  return (void*)((uintptr_t)arg * 2);
+}
+
+/* join from a user thread */
+static void *spawner(void *arg)
+{
+  uthread_t tid;
+  void *ret;
+
+  assert(uthread_create(&tid, increment, arg) == 0);
+  assert(uthread_join(tid, &ret) == 0);
+  return ret;
+}
+
+static void test_create(void)
+{
+  static uthread_t tids[NTHREADS];
+  void *ret;
+  uintptr_t i;
+
+  for (i = 0; i < NTHREADS; i++)
+    assert(uthread_create(&tids[i], i % 2 ? increment : spawner,
+                          (void*)i) == 0);
+  for (i = 0; i < NTHREADS; i++) {
+    assert(uthread_join(tids[i], &ret) == 0);
+    assert(ret == (void*)(i * 2));
+  }
+  assert(counter == NTHREADS);
+
+  /* only user threads can be joined */
+  assert(uthread_join(pthread_self(), NULL) == -1);
+}
+
+static void *tps_worker(void *arg)
+{
+  char buffer[16], check[16];
+  int i;
+
+  snprintf(buffer, sizeof(buffer), "thread %d", (int)(uintptr_t)arg);
+  assert(tps_create() == 0);
+  assert(tps_write(0, sizeof(buffer), buffer) == 0);
+
+  /* let the other threads, on the same workers, create their own */
+  for (i = 0; i < 10; i++) {
+    uthread_yield();
+    assert(tps_read(0, sizeof(check), check) == 0);
+    assert(!strcmp(buffer, check));
+  }
+
+  assert(tps_destroy() == 0);
+  return NULL;
+}
+
+static void *prio_worker(void *arg)
+{
+  int prio = (uintptr_t)arg, i;
+
+  assert(prio_sem_setprio(prio) == 0);
+  for (i = 0; i < 10; i++) {
+    uthread_yield();
+    assert(prio_sem_getprio() == prio);
+  }
+  return NULL;
+}
+
+static void test_private(void)
+{
+  uthread_t tids[16];
+  uintptr_t i;
+
+  assert(tps_init(0) == 0);
+  for (i = 0; i < 16; i++)
+    assert(uthread_create(&tids[i], tps_worker, (void*)i) == 0);
+  for (i = 0; i < 16; i++)
+    assert(uthread_join(tids[i], NULL) == 0);
+
+  for (i = 0; i < 16; i++)
+    assert(uthread_create(&tids[i], prio_worker, (void*)i) == 0);
+  for (i = 0; i < 16; i++)
+    assert(uthread_join(tids[i], NULL) == 0);
+}
+
+static void *timed_worker(void *arg)
+{
+  sem_t sem = arg;
+  struct timespec deadline;
+
+  clock_gettime(CLOCK_REALTIME, &deadline);
+  deadline.tv_nsec += 10000000;
+  if (deadline.tv_nsec >= 1000000000) {
+    deadline.tv_sec++;
+    deadline.tv_nsec -= 1000000000;
+  }
+
+  /* woken up by the timer thread */
+  assert(sem_timeddown(sem, &deadline) == -1 && errno == ETIMEDOUT);
+  /* woken up by the main pthread */
+  assert(sem_down(sem) == 0);
+  return NULL;
+}
+
+static void test_timed(void)
+{
+  sem_t sem = sem_create(0);
+  struct timespec pause = { 0, 50000000 };
+  uthread_t tid;
+
+  assert(uthread_create(&tid, timed_worker, sem) == 0);
+  nanosleep(&pause, NULL);
+  sem_up(sem);
+  assert(uthread_join(tid, NULL) == 0);
+  assert(sem_destroy(sem) == 0);
+}
+
+struct pingpong {
+  sem_t ping;
+  sem_t pong;
+  size_t maxcount;
+};
+
+static void *ping(void *arg)
+{
+  struct pingpong *p = arg;
+  size_t i;
+
+  for (i = 0; i < p->maxcount; i++) {
+    sem_up(p->ping);
+    sem_down(p->pong);
+  }
+  return NULL;
+}
+
+static void *pong(void *arg)
+{
+  struct pingpong *p = arg;
+  size_t i;
+
+  for (i = 0; i < p->maxcount; i++) {
+    sem_down(p->ping);
+    sem_up(p->pong);
+  }
+  return NULL;
+}
+
+static double bench(int user, size_t maxcount)
+{
+  struct pingpong p = { sem_create(0), sem_create(0), maxcount };
+  struct timespec start, end;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  if (user) {
+    uthread_t a, b;
+    uthread_create(&a, ping, &p);
+    uthread_create(&b, pong, &p);
+    uthread_join(a, NULL);
+    uthread_join(b, NULL);
+  } else {
+    pthread_t a, b;
+    pthread_create(&a, NULL, ping, &p);
+    pthread_create(&b, NULL, pong, &p);
+    pthread_join(a, NULL);
+    pthread_join(b, NULL);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  sem_destroy(p.ping);
+  sem_destroy(p.pong);
+  return ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec))
+    / maxcount;
+}
+
+static unsigned int get_argv(char *argv)
+{
+  long int ret = strtol(argv, NULL, 0);
+  if (ret == LONG_MIN || ret == LONG_MAX) {
+    perror("strtol");
+    exit(1);
+  }
+  return ret;
+}
+
+int main(int argc, char **argv)
+{
+  size_t maxcount = MAXCOUNT;
+
+  if (argc > 1)
+    maxcount = get_argv(argv[1]);
+
+  assert(uthread_init(NWORKERS) == 0);
+  assert(uthread_init(NWORKERS) == -1);
+
+  test_create();
+  test_private();
+  test_timed();
+
+  printf("ping-pong: pthreads %.0f ns/round trip, user threads %.0f ns/round "
+         "trip\n", bench(0, maxcount), bench(1, maxcount));
+
+  return 0;
+}
@@ -0,0 +1,174 @@
+/*
+ * User thread scheduler benchmark
+ *
+ * Pairs of user threads run the producer/consumer of sem_buffer.c, each pair
+ * through its own bounded buffer, with the runtime started with 1 to 64
+ * workers (one process per worker count since the runtime can only be started
+ * once). Producers stamp every item with the time right before releasing it,
+ * so that a consumer which had to block can measure how long it took from the
+ * sem_up() that woke it to running again. The aggregate throughput and the
+ * wake-to-run latencies are reported for every worker count.
+ */
+
+#include <assert.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sem.h>
+#include <uthread.h>
+
+#define NPAIRS 16
+#define BUFFER_SIZE 16
+#define MAXCOUNT 20000
+#define MAXWORKERS 64
+#define BUCKETS 32
+
+struct pair {
+  sem_t empty;
+  sem_t full;
+  size_t head, tail;
+  uint64_t buffer[BUFFER_SIZE];
+  size_t maxcount;
+};
+
+static unsigned long wakeups;
+static unsigned long latency_hist[BUCKETS];
+static uint64_t latency_total;
+
+static uint64_t now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void *producer(void *arg)
+{
+  struct pair *p = arg;
+  size_t i;
+
+  for (i = 0; i < p->maxcount; i++) {
+    sem_down(p->empty);
+    p->buffer[p->head++ % BUFFER_SIZE] = now();
+    sem_up(p->full);
+  }
+
+  return NULL;
+}
+
+static void *consumer(void *arg)
+{
+  struct pair *p = arg;
+  size_t i;
+
+  for (i = 0; i < p->maxcount; i++) {
+    int blocked = sem_trydown(p->full) == -1;
+    if (blocked)
+      sem_down(p->full);
+    uint64_t stamp = p->buffer[p->tail++ % BUFFER_SIZE];
+    sem_up(p->empty);
+
+    if (blocked) {
+      uint64_t latency = now() - stamp;
+      int bucket = latency ? 63 - __builtin_clzll(latency) : 0;
+
+      __atomic_fetch_add(&wakeups, 1, __ATOMIC_RELAXED);
+      __atomic_fetch_add(&latency_total, latency, __ATOMIC_RELAXED);
+      __atomic_fetch_add(&latency_hist[bucket < BUCKETS ? bucket : BUCKETS - 1],
+                         1, __ATOMIC_RELAXED);
+    }
+  }
+
+  return NULL;
+}
+
+/* upper bound of the bucket where percent % of the latencies fall */
+static double percentile(double percent)
+{
+  unsigned long seen = 0;
+  int i;
+
+  for (i = 0; i < BUCKETS; i++) {
+    seen += latency_hist[i];
+    if (seen > 0 && seen >= wakeups * percent / 100)
+      return (2ULL << i) / 1e3;
+  }
+  return 0;
+}
+
+static void run(int nworkers, size_t maxcount)
+{
+  static struct pair pairs[NPAIRS];
+  uthread_t producers[NPAIRS], consumers[NPAIRS];
+  uint64_t start, elapsed;
+  int i;
+
+  assert(uthread_init(nworkers) == 0);
+
+  start = now();
+  for (i = 0; i < NPAIRS; i++) {
+    pairs[i].empty = sem_create(BUFFER_SIZE);
+    pairs[i].full = sem_create(0);
+    pairs[i].head = pairs[i].tail = 0;
+    pairs[i].maxcount = maxcount;
+    uthread_create(&consumers[i], consumer, &pairs[i]);
+    uthread_create(&producers[i], producer, &pairs[i]);
+  }
+  for (i = 0; i < NPAIRS; i++) {
+    uthread_join(producers[i], NULL);
+    uthread_join(consumers[i], NULL);
+  }
+  elapsed = now() - start;
+
+  printf("%3d workers: %9.0f items/s, %8lu wakeups, wake-to-run avg %7.1f us "
+         "p50 %7.1f us p99 %8.1f us\n", nworkers,
+         NPAIRS * maxcount * 1e9 / elapsed, wakeups,
+         wakeups ? latency_total / 1e3 / wakeups : 0.0, percentile(50),
+         percentile(99));
+
+  for (i = 0; i < NPAIRS; i++) {
+    sem_destroy(pairs[i].empty);
+    sem_destroy(pairs[i].full);
+  }
+}
+
+static unsigned int get_argv(char *argv)
+{
+  long int ret = strtol(argv, NULL, 0);
+  if (ret == LONG_MIN || ret == LONG_MAX) {
+    perror("strtol");
+    exit(1);
+  }
+  return ret;
+}
+
+int main(int argc, char **argv)
+{
+  size_t maxcount = MAXCOUNT;
+  int nworkers, status;
+
+  if (argc > 1)
+    maxcount = get_argv(argv[1]);
+
+  for (nworkers = 1; nworkers <= MAXWORKERS; nworkers *= 2) {
+    pid_t pid = fork();
+
+    assert(pid != -1);
+    if (pid == 0) {
+      run(nworkers, maxcount);
+      fflush(stdout);
+      _exit(0);
+    }
+
+    assert(waitpid(pid, &status, 0) == pid);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+  }
+
+  return 0;
+}
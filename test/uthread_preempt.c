@@ -0,0 +1,179 @@
+/*
+ * User thread preemption test
+ *
+ * Run CPU-bound user threads on a single worker (by default) with a 1 ms time
+ * slice: a thread spinning until another one runs must be preempted, spinning
+ * threads must all make progress, and threads repeatedly entering critical
+ * sections and semaphores must never be preempted while holding the critical
+ * section (the only worker would then deadlock on it).
+ */
+
+#include <assert.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sem.h>
+#include <thread.h>
+#include <uthread.h>
+
+#define SLICE_USEC 1000
+#define NSPINNERS 4
+#define NPAIRS 4
+#define MAXCOUNT 20000
+
+static int stop;
+
+static void *spin(void *arg)
+{
+  unsigned long *count = arg;
+
+  while (!__atomic_load_n(&stop, __ATOMIC_RELAXED))
+    (*count)++;
+  return NULL;
+}
+
+static void *set_stop(void *arg)
+{
+  __atomic_store_n(&stop, 1, __ATOMIC_RELAXED);
+  return NULL;
+}
+
+/* without preemption, the spinner would keep the only worker forever */
+static void test_spin(void)
+{
+  unsigned long count = 0;
+  uthread_t a, b;
+
+  stop = 0;
+  assert(uthread_create(&a, spin, &count) == 0);
+  assert(uthread_create(&b, set_stop, NULL) == 0);
+  assert(uthread_join(a, NULL) == 0);
+  assert(uthread_join(b, NULL) == 0);
+}
+
+static void test_fair(void)
+{
+  static unsigned long counts[NSPINNERS];
+  struct timespec ts = { 0, 200 * 1000 * 1000 };
+  uthread_t tids[NSPINNERS];
+  unsigned long min = ULONG_MAX, max = 0;
+  int i;
+
+  stop = 0;
+  for (i = 0; i < NSPINNERS; i++)
+    assert(uthread_create(&tids[i], spin, &counts[i]) == 0);
+
+  /* the main pthread is not a user thread, it runs beside the worker */
+  nanosleep(&ts, NULL);
+  __atomic_store_n(&stop, 1, __ATOMIC_RELAXED);
+
+  for (i = 0; i < NSPINNERS; i++) {
+    assert(uthread_join(tids[i], NULL) == 0);
+    assert(counts[i] > 0);
+    if (counts[i] < min)
+      min = counts[i];
+    if (counts[i] > max)
+      max = counts[i];
+  }
+
+  printf("spinners: min %lu, max %lu iterations\n", min, max);
+}
+
+struct pair {
+  sem_t sem;
+  size_t maxcount;
+};
+
+static unsigned long shared;
+
+/* a critical section long enough to be hit by the timer */
+static void *producer(void *arg)
+{
+  struct pair *p = arg;
+  volatile int j;
+  size_t i;
+
+  for (i = 0; i < p->maxcount; i++) {
+    enter_critical_section();
+    unsigned long value = shared;
+    for (j = 0; j < 200; j++)
+      ;
+    shared = value + 1;
+    exit_critical_section();
+
+    sem_up(p->sem);
+  }
+  return NULL;
+}
+
+static void *consumer(void *arg)
+{
+  struct pair *p = arg;
+  size_t i;
+
+  for (i = 0; i < p->maxcount; i++)
+    sem_down(p->sem);
+  return NULL;
+}
+
+static void test_sem(size_t maxcount)
+{
+  struct pair pairs[NPAIRS];
+  uthread_t tids[NPAIRS * 2];
+  int i;
+
+  shared = 0;
+  for (i = 0; i < NPAIRS; i++) {
+    pairs[i].sem = sem_create(0);
+    pairs[i].maxcount = maxcount;
+    assert(uthread_create(&tids[i * 2], consumer, &pairs[i]) == 0);
+    assert(uthread_create(&tids[i * 2 + 1], producer, &pairs[i]) == 0);
+  }
+
+  for (i = 0; i < NPAIRS * 2; i++)
+    assert(uthread_join(tids[i], NULL) == 0);
+  for (i = 0; i < NPAIRS; i++)
+    assert(sem_destroy(pairs[i].sem) == 0);
+
+  assert(shared == NPAIRS * maxcount);
+}
+
+static unsigned int get_argv(char *argv)
+{
+  long int ret = strtol(argv, NULL, 0);
+  if (ret == LONG_MIN || ret == LONG_MAX) {
+    perror("strtol");
+    exit(1);
+  }
+  return ret;
+}
+
+int main(int argc, char **argv)
+{
+  size_t maxcount = MAXCOUNT;
+  int nworkers = 1;
+
+  if (argc > 1)
+    maxcount = get_argv(argv[1]);
+  if (argc > 2)
+    nworkers = get_argv(argv[2]);
+
+  /* a deadlock or a thread never preempted is a failure */
+  alarm(30);
+
+  assert(uthread_setpreempt(-1) == -1);
+  assert(uthread_setpreempt(SLICE_USEC) == 0);
+  assert(uthread_init(nworkers) == 0);
+  assert(uthread_setpreempt(0) == -1);
+
+  test_spin();
+  test_fair();
+  test_sem(maxcount);
+
+  return 0;
+}